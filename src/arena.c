@@ -0,0 +1,73 @@
+#include "arena.h"
+#include "buffer.h"
+
+#define ARENA_CHUNK_MIN 4096
+#define ARENA_ALIGN     (sizeof(max_align_t))
+
+struct arena_chunk {
+    arena_chunk_t *prev;   // older chunk
+    size_t cap;            // usable bytes after the header
+    size_t used;
+    size_t block;          // pool capacity of the whole block
+};
+
+// Header size rounded so the first allocation stays aligned
+#define ARENA_HEADER ((sizeof(arena_chunk_t) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+static char *chunk_data(arena_chunk_t *c) {
+    return (char *)c + ARENA_HEADER;
+}
+
+void arena_init(arena_t *a) {
+    a->head = NULL;
+}
+
+void *arena_alloc(arena_t *a, size_t n) {
+    n = (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    arena_chunk_t *c = a->head;
+    if (!c || c->cap - c->used < n) {
+        size_t need = ARENA_HEADER + n;
+        if (need < ARENA_CHUNK_MIN) need = ARENA_CHUNK_MIN;
+
+        size_t block;
+        c = pool_alloc(need, &block);
+        if (!c) return NULL;
+        c->prev = a->head;
+        c->cap = block - ARENA_HEADER;
+        c->used = 0;
+        c->block = block;
+        a->head = c;
+    }
+
+    void *p = chunk_data(c) + c->used;
+    c->used += n;
+    return p;
+}
+
+arena_mark_t arena_mark(const arena_t *a) {
+    arena_mark_t m = { a->head, a->head ? a->head->used : 0 };
+    return m;
+}
+
+void arena_rewind(arena_t *a, arena_mark_t mark) {
+    while (a->head && a->head != mark.chunk) {
+        arena_chunk_t *prev = a->head->prev;
+        pool_free(a->head, a->head->block);
+        a->head = prev;
+    }
+    if (a->head) a->head->used = mark.used;
+}
+
+void arena_reset(arena_t *a) {
+    if (!a->head) return;
+    arena_chunk_t *oldest = a->head;
+    while (oldest->prev) oldest = oldest->prev;
+    arena_mark_t start = { oldest, 0 };
+    arena_rewind(a, start);
+}
+
+void arena_free(arena_t *a) {
+    arena_mark_t empty = { NULL, 0 };
+    arena_rewind(a, empty);
+}
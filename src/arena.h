@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Per-session bump allocator for short-lived data (serialized and received
+// datagrams). Chunks come from the block pool; everything allocated after a
+// mark is released at once by rewinding to it.
+typedef struct arena_chunk arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t *head;   // newest chunk, allocations are carved from it
+} arena_t;
+
+typedef struct {
+    arena_chunk_t *chunk;
+    size_t used;
+} arena_mark_t;
+
+void arena_init(arena_t *a);
+
+// Returns n bytes aligned for any scalar type, or NULL when out of memory
+void *arena_alloc(arena_t *a, size_t n);
+
+// Current position, for a later arena_rewind
+arena_mark_t arena_mark(const arena_t *a);
+
+// Releases everything allocated since the mark
+void arena_rewind(arena_t *a, arena_mark_t mark);
+
+// Releases everything but keeps the oldest chunk for reuse
+void arena_reset(arena_t *a);
+
+// Returns all chunks to the pool
+void arena_free(arena_t *a);
+
+#endif // ARENA_H
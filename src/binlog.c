@@ -0,0 +1,162 @@
+#include "binlog.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+const uint8_t binlog_format_level[BINLOG_FORMAT_COUNT] = {
+#define BINLOG_LEVEL(id, level, text) [id] = level,
+    BINLOG_FORMATS(BINLOG_LEVEL)
+#undef BINLOG_LEVEL
+};
+
+const char *const binlog_format_text[BINLOG_FORMAT_COUNT] = {
+#define BINLOG_TEXT(id, level, text) [id] = text,
+    BINLOG_FORMATS(BINLOG_TEXT)
+#undef BINLOG_TEXT
+};
+
+const char *const binlog_level_name[BINLOG_LEVELS] = {
+    "error", "warn", "info", "debug", "trace"
+};
+
+volatile sig_atomic_t binlog_level = -1;
+
+static binlog_header_t *binlog_map;   // header followed by the ring
+static size_t binlog_map_len;
+
+static uint64_t binlog_clock(clockid_t clk) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint32_t binlog_catalogue_hash(void) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < BINLOG_FORMAT_COUNT; i++) {
+        for (const char *p = binlog_format_text[i]; *p; p++) {
+            h ^= (uint8_t)*p;
+            h *= 16777619u;
+        }
+        h ^= binlog_format_level[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int binlog_parse_level(const char *s) {
+    if (s[0] >= '0' && s[0] < '0' + BINLOG_LEVELS && s[1] == '\0') return s[0] - '0';
+    for (int i = 0; i < BINLOG_LEVELS; i++) {
+        if (strcasecmp(s, binlog_level_name[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// SIGUSR1 / SIGUSR2: one level more / less verbose
+static void binlog_signal(int signum) {
+    if (!binlog_map) return;
+    if (signum == SIGUSR1 && binlog_level < BINLOG_LEVELS - 1) binlog_level++;
+    if (signum == SIGUSR2 && binlog_level > BINLOG_ERROR) binlog_level--;
+}
+
+int binlog_open(const char *path, int level, size_t ring_size) {
+    ring_size &= ~(size_t)7;
+    if (ring_size < 4096) ring_size = 4096;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    binlog_map_len = sizeof(binlog_header_t) + ring_size;
+    if (ftruncate(fd, binlog_map_len) != 0) {
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+    void *p = mmap(NULL, binlog_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    binlog_map = p;
+    binlog_map->magic = BINLOG_MAGIC;
+    binlog_map->version = BINLOG_VERSION;
+    binlog_map->format_count = BINLOG_FORMAT_COUNT;
+    binlog_map->catalogue_hash = binlog_catalogue_hash();
+    binlog_map->size = ring_size;
+    binlog_map->head = 0;
+    binlog_map->mono0_ns = binlog_clock(CLOCK_MONOTONIC);
+    binlog_map->real0_ns = binlog_clock(CLOCK_REALTIME);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = binlog_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+    sigaction(SIGUSR2, &sa, NULL);
+
+    binlog_level = level;
+    return 0;
+}
+
+void binlog_close(void) {
+    if (!binlog_map) return;
+    binlog_level = -1;
+    munmap(binlog_map, binlog_map_len);
+    binlog_map = NULL;
+}
+
+void binlog_write(binlog_format_e id, const uint64_t *args, unsigned nargs,
+                  const void *blob, size_t blob_len) {
+    binlog_header_t *h = binlog_map;
+    if (!h) return;
+    if (blob_len > BINLOG_BLOB_MAX) blob_len = BINLOG_BLOB_MAX;
+    if (nargs > UINT8_MAX) nargs = UINT8_MAX;
+
+    uint32_t size = (sizeof(binlog_record_t) + nargs * sizeof(uint64_t) + blob_len + 7) & ~7u;
+    uint64_t ring = h->size;
+    uint8_t *data = (uint8_t *)(h + 1);
+
+    // Reserve space; a record never straddles the end of the ring
+    uint64_t head = __atomic_load_n(&h->head, __ATOMIC_RELAXED);
+    uint64_t pos, pad;
+    do {
+        pos = head % ring;
+        pad = pos + size > ring ? ring - pos : 0;
+    } while (!__atomic_compare_exchange_n(&h->head, &head, head + pad + size, true,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    if (pad) {
+        if (pad >= sizeof(binlog_record_t)) {
+            binlog_record_t *filler = (binlog_record_t *)(data + pos);
+            filler->size = 0;
+            filler->sync = BINLOG_SYNC;
+            filler->format = BINLOG_PAD;
+            __atomic_store_n(&filler->size, (uint32_t)pad, __ATOMIC_RELEASE);
+        }
+        pos = 0;
+    }
+
+    binlog_record_t *r = (binlog_record_t *)(data + pos);
+    r->size = 0;
+    r->ts_ns = binlog_clock(CLOCK_MONOTONIC);
+    r->sync = BINLOG_SYNC;
+    r->format = id;
+    r->blob_len = blob_len;
+    r->nargs = nargs;
+    r->reserved = 0;
+    r->pad = 0;
+    memcpy(r + 1, args, nargs * sizeof(uint64_t));
+    if (blob_len) memcpy((uint8_t *)(r + 1) + nargs * sizeof(uint64_t), blob, blob_len);
+    __atomic_store_n(&r->size, size, __ATOMIC_RELEASE);
+}
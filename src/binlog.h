@@ -0,0 +1,139 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact binary logging. A log site stores its format ID and raw 64-bit
+// arguments (plus at most one byte blob) in a memory-mapped ring file; the
+// text is produced offline by ipk25chat-logdump. A site above the runtime
+// level costs one comparison, and SIGUSR1 / SIGUSR2 raise / lower the level
+// of a running client.
+
+typedef enum {
+    BINLOG_ERROR,
+    BINLOG_WARN,
+    BINLOG_INFO,
+    BINLOG_DEBUG,
+    BINLOG_TRACE,
+    BINLOG_LEVELS
+} binlog_level_e;
+
+// Format catalogue: id, level, text. Placeholders consume the arguments in order:
+//   %u unsigned, %x hex, %a IPv4 address and port packed by BINLOG_ADDR,
+//   %s the blob as text, %p the blob as an IPK25-CHAT UDP datagram
+#define BINLOG_FORMATS(X) \
+    X(LOG_TCP_CONNECTED,       BINLOG_INFO,  "TCP connected to %s port %u") \
+    X(LOG_TCP_SERVER_CLOSED,   BINLOG_INFO,  "Server closed the connection or failed") \
+    X(LOG_STDIN_EOF,           BINLOG_DEBUG, "EOF on stdin") \
+    X(LOG_RENAMED,             BINLOG_DEBUG, "Display name set to %s") \
+    X(LOG_UDP_START,           BINLOG_INFO,  "UDP client started as %s") \
+    X(LOG_UDP_TX,              BINLOG_TRACE, "TX %u bytes to %a: %p") \
+    X(LOG_UDP_RX,              BINLOG_TRACE, "RX %u bytes from %a: %p") \
+    X(LOG_UDP_CONFIRM_QUEUED,  BINLOG_DEBUG, "Queued CONFIRM for MessageID %u") \
+    X(LOG_UDP_RETRANSMIT,      BINLOG_WARN,  "Retransmitting MessageID %u, attempt %u") \
+    X(LOG_UDP_CONFIRM_LOST,    BINLOG_ERROR, "No CONFIRM for MessageID %u after %u retries") \
+    X(LOG_UDP_REPLY_LOST,      BINLOG_ERROR, "No REPLY for MessageID %u") \
+    X(LOG_UDP_PORT_SWITCH,     BINLOG_INFO,  "Server switched to port %u") \
+    X(LOG_UDP_CONNECTED,       BINLOG_INFO,  "Socket connected to %a") \
+    X(LOG_UDP_UNREACHABLE,     BINLOG_ERROR, "Server %a unreachable") \
+    X(LOG_UDP_KERNEL_DROP,     BINLOG_WARN,  "Kernel dropped %u datagrams (receive queue full), %u in total") \
+    X(LOG_UDP_RCVBUF,          BINLOG_INFO,  "Receive buffer %u bytes for bursts of %u x %u bytes") \
+    X(LOG_UDP_SNDBUF,          BINLOG_INFO,  "Send buffer %u bytes for bursts of %u x %u bytes") \
+    X(LOG_UDP_RTT,             BINLOG_DEBUG, "RTT of MessageID %u: %u us, srtt %u us, rto %u ms") \
+    X(LOG_UDP_REPLY_RTT,       BINLOG_DEBUG, "REPLY to MessageID %u after %u us") \
+    X(LOG_UDP_RTT_STATS,       BINLOG_INFO,  "RTT %u samples, min/avg/max %u/%u/%u us; REPLY %u samples, min/avg/max %u/%u/%u us") \
+    X(LOG_LOWLAT_NO_BUSY_POLL, BINLOG_WARN,  "SO_BUSY_POLL not available (errno %u), spinning in user space only") \
+    X(LOG_LOWLAT_STATS,        BINLOG_INFO,  "Low latency %u: %u reads, socket to handler min/avg/max %u/%u/%u us, %u of %u wakeups while spinning") \
+    X(LOG_RESUME_SCHEDULED,    BINLOG_WARN,  "Resume attempt %u in %u ms") \
+    X(LOG_RESUME_DONE,         BINLOG_INFO,  "Session resumed after %u ms, %u attempts") \
+    X(LOG_RESUME_GAVE_UP,      BINLOG_ERROR, "Resume given up after %u attempts, %u ms") \
+    X(LOG_UDP_STATS,           BINLOG_INFO,  "TX %u datagrams (%u bytes), RX %u datagrams (%u bytes), %u retransmitted, %u duplicates, %u kernel drops") \
+    X(LOG_UDP_MALFORMED,       BINLOG_ERROR, "Malformed datagram of %u bytes: %p") \
+    X(LOG_REPLAY_DONE,         BINLOG_INFO,  "Replay finished") \
+    X(LOG_FILESEND_START,      BINLOG_INFO,  "Sending file %s, %u bytes") \
+    X(LOG_FILESEND_DONE,       BINLOG_INFO,  "File of %u bytes sent in %u messages, %u ms") \
+    X(LOG_FILESEND_ABORTED,    BINLOG_WARN,  "File sending stopped after %u of %u bytes")
+
+typedef enum {
+#define BINLOG_ENUM(id, level, text) id,
+    BINLOG_FORMATS(BINLOG_ENUM)
+#undef BINLOG_ENUM
+    BINLOG_FORMAT_COUNT
+} binlog_format_e;
+
+extern const uint8_t binlog_format_level[BINLOG_FORMAT_COUNT];
+extern const char *const binlog_format_text[BINLOG_FORMAT_COUNT];
+extern const char *const binlog_level_name[BINLOG_LEVELS];
+
+// Records up to this level are written; -1 while no log is open
+extern volatile sig_atomic_t binlog_level;
+
+#define BINLOG_BLOB_MAX     256            // longer blobs are truncated
+#define BINLOG_DEFAULT_SIZE (4u << 20)     // ring bytes
+#define BINLOG_ADDR(sin) (((uint64_t)ntohl((sin)->sin_addr.s_addr) << 16) | ntohs((sin)->sin_port))
+
+#define BINLOG_ON(id) ((int)binlog_format_level[id] <= binlog_level)
+
+#define BLOG(id, ...) do { \
+    if (BINLOG_ON(id)) { \
+        const uint64_t blog_args_[] = { 0, ##__VA_ARGS__ }; \
+        binlog_write(id, blog_args_ + 1, sizeof(blog_args_) / sizeof(uint64_t) - 1, NULL, 0); \
+    } \
+} while (0)
+
+#define BLOG_BLOB(id, blob, blob_len, ...) do { \
+    if (BINLOG_ON(id)) { \
+        const uint64_t blog_args_[] = { 0, ##__VA_ARGS__ }; \
+        binlog_write(id, blog_args_ + 1, sizeof(blog_args_) / sizeof(uint64_t) - 1, \
+                     (blob), (blob_len)); \
+    } \
+} while (0)
+
+// Creates the ring file and installs the level signals. Returns 0 on success.
+int binlog_open(const char *path, int level, size_t ring_size);
+void binlog_close(void);
+
+// Parses "error".."trace" or a digit; returns -1 when unknown
+int binlog_parse_level(const char *s);
+
+// Lock-free: any thread (or signal handler) may append
+void binlog_write(binlog_format_e id, const uint64_t *args, unsigned nargs,
+                  const void *blob, size_t blob_len);
+
+// --- File layout, shared with the decoder ---
+
+#define BINLOG_MAGIC   0x474C4249u  // "IBLG"
+#define BINLOG_VERSION 1
+#define BINLOG_SYNC    0xB10Cu
+#define BINLOG_PAD     0xFFFFu      // format of the filler before a wrap
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t format_count;
+    uint32_t catalogue_hash;   // FNV-1a over the format texts
+    uint32_t reserved;
+    uint64_t size;             // ring bytes following the header
+    uint64_t head;             // bytes ever reserved (updated atomically)
+    uint64_t mono0_ns;         // CLOCK_MONOTONIC at open ...
+    uint64_t real0_ns;         // ... and the matching CLOCK_REALTIME
+    uint8_t  pad[16];
+} binlog_header_t;             // 64 bytes
+
+typedef struct {
+    uint64_t ts_ns;            // CLOCK_MONOTONIC
+    uint16_t sync;             // BINLOG_SYNC, lets the decoder resynchronise after a wrap
+    uint16_t format;
+    uint16_t blob_len;
+    uint8_t  nargs;
+    uint8_t  reserved;
+    uint32_t size;             // whole record, 8-aligned; stored last (0 = not committed)
+    uint32_t pad;
+    // uint64_t args[nargs], then blob_len bytes
+} binlog_record_t;             // 24 bytes
+
+uint32_t binlog_catalogue_hash(void);
+
+#endif // BINLOG_H
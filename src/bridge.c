@@ -0,0 +1,684 @@
+// ipk25chat-bridge: relays IPK25-CHAT between its TCP and UDP variants. Local
+// clients of one variant connect to the bridge and each of them becomes a
+// libipk25chat session of the other variant towards the server. Every session
+// runs on one poll() loop, so a single process stands in for hundreds of
+// per-user client processes.
+//
+//   tcp2udp  local TCP clients, UDP server: the session confirms,
+//            retransmits and follows the server's dynamic port
+//   udp2tcp  local UDP clients, TCP server: the bridge plays the UDP server
+//            side, confirming, deduplicating and retransmitting towards each
+//            client from a dynamic port of its own
+//
+// Usage: ipk25chat-bridge -m <tcp2udp|udp2tcp> -s <server> [-p <port>] [-l <port>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "ipk25chat.h"
+#include "client.h"
+#include "buffer.h"
+#include "tcp.h"
+#include "udp.h"
+#include "utils.h"
+
+#define BRIDGE_MAX_SESSIONS 1024
+#define BRIDGE_MAX_FDS      (1 + 2 * BRIDGE_MAX_SESSIONS)
+#define BRIDGE_NAME         "Bridge"  // display name of what the bridge itself reports
+#define BRIDGE_DRAIN_MS     2000      // time given to the closing BYEs at shutdown
+
+typedef enum {
+    BRIDGE_TCP2UDP,
+    BRIDGE_UDP2TCP
+} bridge_mode_e;
+
+// One local client and its session towards the server
+typedef struct {
+    int fd;                        // TCP connection, or the client's dynamic-port UDP socket
+    ipk_session_t *session;        // opened by the client's AUTH
+    char display_name[IPK_MAX_DNAME_LEN + 1];
+    udp_ring_t pending;            // requests the session did not take yet (IPK_EBUSY)
+    bool local_done;               // the local client left or was told BYE
+    bool ended;                    // the session has ended
+
+    // TCP client
+    line_reader_t rx;
+    buffer_t tx;
+
+    // UDP client
+    struct sockaddr_in peer;
+    msgid_buffer_t seen;
+    udp_ring_t queue;              // reliable datagrams to the client, the head is in flight
+    bool inflight;
+    uint16_t inflight_id;
+    int attempts;
+    int64_t resend_at;
+    uint16_t next_id;
+    uint16_t reply_ref;            // MessageID of the AUTH/JOIN awaiting its REPLY
+    int64_t linger_until;          // re-confirms a retransmitted BYE until then
+} bridge_conn_t;
+
+static volatile sig_atomic_t terminate_bridge = 0;
+
+static bridge_mode_e mode;
+static ipk_config_t session_cfg;
+static char server_ip[INET_ADDRSTRLEN];
+static uint16_t udp_timeout_ms = 250;
+static uint8_t udp_retries = 3;
+
+static bridge_conn_t *conns[BRIDGE_MAX_SESSIONS];
+static int conn_count;
+static unsigned long served, relayed_up, relayed_down;
+
+static void handle_sigint_bridge(int signo) {
+    (void)signo;
+    terminate_bridge = 1;
+}
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool same_addr(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+// --- Local UDP side ---
+
+static void udp_local_send_head(bridge_conn_t *c, int64_t now) {
+    buffer_t *b = &c->queue.items[c->queue.head];
+    sendto(c->fd, b->data, b->len, MSG_DONTWAIT, (struct sockaddr *)&c->peer, sizeof(c->peer));
+    uint16_t id;
+    memcpy(&id, &b->data[1], sizeof(uint16_t));
+    c->inflight_id = ntohs(id);
+    c->inflight = true;
+    c->attempts++;
+    c->resend_at = now + udp_timeout_ms;
+}
+
+// Retransmits an unconfirmed datagram or starts the next one
+static void udp_local_service(bridge_conn_t *c, int64_t now) {
+    if (c->inflight && now >= c->resend_at) {
+        if (c->attempts > udp_retries) {
+            // The client is gone: nothing more can reach it
+            c->queue.head = c->queue.count = 0;
+            c->inflight = false;
+            c->local_done = true;
+            if (!c->ended && c->session) ipk_bye(c->session);
+            return;
+        }
+        udp_local_send_head(c, now);
+    }
+    if (!c->inflight && c->queue.count > 0) {
+        c->attempts = 0;
+        udp_local_send_head(c, now);
+    }
+}
+
+// Queues a reliable datagram to the client
+static void udp_local_queue(bridge_conn_t *c, UdpMessageType type, const char *display_name,
+                            const char *content, uint8_t result) {
+    packetContent_t pkt = {
+        .type = type,
+        .messageID = c->next_id,
+        .ref_messageID = c->reply_ref,
+        .result = result,
+        .payload = (uint8_t *)content,
+        .length = content ? strlen(content) + 1 : 0
+    };
+    size_t cap;
+    uint8_t *packet = pool_alloc(UDP_ENCODED_MAX(pkt.length), &cap);
+    if (!packet) return;
+    size_t len = udp_encode(&pkt, "", display_name, packet);
+    if (len > 0 && udp_ring_push(&c->queue, packet, len)) c->next_id++;
+    pool_free(packet, cap);
+    udp_local_service(c, now_ms());
+}
+
+// --- Local TCP side ---
+
+static void tcp_local_flush(bridge_conn_t *c) {
+    while (c->tx.len > 0) {
+        ssize_t n = send(c->fd, c->tx.data, c->tx.len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                c->tx.len = 0;  // the client is gone
+                c->local_done = true;
+            }
+            return;
+        }
+        buffer_consume(&c->tx, n);
+    }
+}
+
+// Appends a message line for the client
+static void tcp_local_send(bridge_conn_t *c, const ipk_msg_t *m) {
+    ipk_tcp_encode(m, &c->tx);
+    tcp_local_flush(c);
+}
+
+// --- Messages to the local client, in its variant ---
+
+static void local_reply(bridge_conn_t *c, bool ok, const char *content) {
+    if (mode == BRIDGE_TCP2UDP)
+        tcp_local_send(c, &(ipk_msg_t){ .type = MSG_REPLY, .result = ok, .content = ipk_text(content) });
+    else
+        udp_local_queue(c, MSG_REPLY, NULL, content, ok ? 1 : 0);
+}
+
+static void local_msg(bridge_conn_t *c, bool err, const char *display_name, const char *content) {
+    if (mode == BRIDGE_TCP2UDP)
+        tcp_local_send(c, &(ipk_msg_t){ .type = err ? MSG_ERR : MSG_MSG,
+                                        .display = ipk_text(display_name),
+                                        .content = ipk_text(content) });
+    else
+        udp_local_queue(c, err ? MSG_ERR : MSG_MSG, display_name, content, 0);
+}
+
+// Ends the local side with BYE (after an ERR when 'err' is set)
+static void local_bye(bridge_conn_t *c, const char *err) {
+    if (c->local_done) return;
+    if (err) local_msg(c, true, BRIDGE_NAME, err);
+    if (mode == BRIDGE_TCP2UDP)
+        tcp_local_send(c, &(ipk_msg_t){ .type = MSG_BYE, .display = ipk_text(BRIDGE_NAME) });
+    else
+        udp_local_queue(c, MSG_BYE, BRIDGE_NAME, NULL, 0);
+    c->local_done = true;
+}
+
+// --- Session callbacks: server -> local client ---
+
+static void on_reply(void *user, bool ok, const char *content) {
+    relayed_down++;
+    local_reply(user, ok, content);
+}
+
+static void on_msg(void *user, const char *display_name, const char *content) {
+    relayed_down++;
+    local_msg(user, false, display_name, content);
+}
+
+static void on_err(void *user, const char *display_name, const char *content) {
+    relayed_down++;
+    local_msg(user, true, display_name, content);
+}
+
+static void on_closed(void *user, ipk_status_e status) {
+    bridge_conn_t *c = user;
+    c->ended = true;
+    // After an orderly end (server BYE, or the client's own) only BYE is left
+    local_bye(c, status == IPK_OK || status == IPK_EREMOTE ? NULL : ipk_strerror(status));
+}
+
+// --- Local client -> server ---
+
+// A request parsed from either variant
+typedef struct {
+    tcp_msg_type_e type;
+    const char *display_name;
+    const char *username, *secret, *channel, *content;
+    uint16_t id;                   // UDP MessageID (REPLY reference)
+} bridge_request_t;
+
+static int bridge_open_session(bridge_conn_t *c) {
+    if (c->session) return IPK_OK;
+    ipk_config_t cfg = session_cfg;
+    cfg.user = c;
+    c->session = ipk_session_open(&cfg);
+    if (!c->session) return IPK_EIO;
+    served++;
+    return IPK_OK;
+}
+
+// Hands a request to the session. Returns IPK_EBUSY when it has to wait.
+static int bridge_apply(bridge_conn_t *c, const bridge_request_t *r) {
+    int rc = IPK_OK;
+    if (r->type == TCP_MSG_AUTH) {
+        rc = bridge_open_session(c);
+        if (rc != IPK_OK) return rc;
+    } else if (!c->session) {
+        return r->type == TCP_MSG_BYE ? IPK_OK : IPK_ESTATE;
+    }
+
+    // The display name travels with every message; the session keeps one
+    if (r->type != TCP_MSG_AUTH && r->display_name[0] &&
+        strcmp(r->display_name, c->display_name) != 0) {
+        if (ipk_session_state(c->session) == IPK_STATE_AUTH ||
+            ipk_session_state(c->session) == IPK_STATE_JOIN)
+            return IPK_EBUSY;  // renamed once the REPLY is in
+        if (ipk_rename(c->session, r->display_name) == IPK_OK)
+            strcpy(c->display_name, r->display_name);
+    }
+
+    switch (r->type) {
+        case TCP_MSG_AUTH:
+            rc = ipk_auth(c->session, r->username, r->secret, r->display_name);
+            if (rc == IPK_OK) strcpy(c->display_name, r->display_name);
+            break;
+        case TCP_MSG_JOIN:
+            rc = ipk_join(c->session, r->channel);
+            break;
+        case TCP_MSG_MSG:
+            rc = ipk_send(c->session, r->content);
+            break;
+        case TCP_MSG_ERR:   // the client gives up; the session can only say BYE
+        case TCP_MSG_BYE:
+            c->local_done = true;
+            // Our CONFIRM may get lost; stay to confirm the retransmissions
+            c->linger_until = now_ms() + (int64_t)udp_timeout_ms * (udp_retries + 1);
+            rc = ipk_bye(c->session);
+            if (rc == IPK_ESTATE) rc = IPK_OK;  // already ending
+            break;
+        default:
+            rc = IPK_EINVAL;
+            break;
+    }
+    if (rc == IPK_OK && (r->type == TCP_MSG_AUTH || r->type == TCP_MSG_JOIN))
+        c->reply_ref = r->id;
+    return rc;
+}
+
+// A request the session refused for good: AUTH/JOIN are answered with
+// REPLY NOK, anything else ends the client like a server would
+static void bridge_refuse(bridge_conn_t *c, const bridge_request_t *r, int rc) {
+    if (r->type == TCP_MSG_AUTH || r->type == TCP_MSG_JOIN) {
+        c->reply_ref = r->id;
+        local_reply(c, false, ipk_strerror(rc));
+        return;
+    }
+    local_bye(c, ipk_strerror(rc));
+    if (c->session && !c->ended) ipk_bye(c->session);
+}
+
+// Fills a request from a TCP line; false when it is malformed
+static bool bridge_parse_tcp(const char *line, tcp_message_t *msg, bridge_request_t *r) {
+    if (!tcp_parse_line(line, msg) || msg->type == TCP_MSG_REPLY) return false;
+    *r = (bridge_request_t){
+        .type = msg->type, .display_name = msg->displayName,
+        .username = msg->username, .secret = msg->secret,
+        .channel = msg->channel, .content = msg->content
+    };
+    return true;
+}
+
+// Fills a request from a datagram; false when it is malformed or no request
+static bool bridge_parse_udp(const uint8_t *buf, size_t len, bridge_request_t *r) {
+    ipk_msg_t m;
+    if (!ipk_udp_decode(buf, len, &m) || m.type == MSG_CNFRM || m.type == MSG_REPLY ||
+        m.type == MSG_PING)
+        return false;
+    // The strings are NUL-terminated in the datagram
+    *r = (bridge_request_t){
+        .type = (tcp_msg_type_e)m.type, .id = m.id,
+        .display_name = m.display.ptr, .username = m.username.ptr,
+        .secret = m.secret.ptr, .channel = m.channel.ptr, .content = m.content.ptr
+    };
+    return true;
+}
+
+// Applies the queued requests in order until the session asks to wait
+static void bridge_drain_pending(bridge_conn_t *c) {
+    while (c->pending.count > 0 && !c->ended) {
+        buffer_t *b = &c->pending.items[c->pending.head];
+        tcp_message_t msg;
+        bridge_request_t r;
+        bool ok = mode == BRIDGE_TCP2UDP
+            ? bridge_parse_tcp(b->data, &msg, &r)
+            : bridge_parse_udp((const uint8_t *)b->data, b->len, &r);
+        if (!ok) {
+            udp_ring_pop(&c->pending);
+            local_bye(c, "Malformed message");
+            if (c->session && !c->ended) ipk_bye(c->session);
+            continue;
+        }
+        int rc = bridge_apply(c, &r);
+        if (rc == IPK_EBUSY) return;
+        udp_ring_pop(&c->pending);
+        relayed_up++;
+        if (rc != IPK_OK) bridge_refuse(c, &r, rc);
+    }
+}
+
+// --- Connections ---
+
+static bridge_conn_t *conn_new(int fd) {
+    if (conn_count == BRIDGE_MAX_SESSIONS) return NULL;
+    bridge_conn_t *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->fd = fd;
+    line_reader_init(&c->rx, "\r\n", TCP_MAX_LINE_LEN);
+    buffer_init(&c->tx);
+    msgid_buffer_init(&c->seen);
+    conns[conn_count++] = c;
+    return c;
+}
+
+static void conn_free(int i) {
+    bridge_conn_t *c = conns[i];
+    if (c->session) ipk_session_close(c->session);
+    close(c->fd);
+    line_reader_free(&c->rx);
+    buffer_free(&c->tx);
+    udp_ring_free(&c->pending);
+    udp_ring_free(&c->queue);
+    free(c);
+    conns[i] = conns[--conn_count];
+}
+
+// Finished once both sides are done and the local side has been told everything
+static bool conn_finished(const bridge_conn_t *c) {
+    if (!c->local_done) return false;
+    if (c->session && !c->ended) return false;
+    if (mode == BRIDGE_TCP2UDP) return c->tx.len == 0;
+    return c->queue.count == 0 && now_ms() >= c->linger_until;
+}
+
+// Local side gone: the session says BYE on its behalf
+static void conn_local_closed(bridge_conn_t *c) {
+    c->local_done = true;
+    c->tx.len = 0;
+    c->pending.head = c->pending.count = 0;
+    if (c->session && !c->ended) ipk_bye(c->session);
+}
+
+static void tcp_local_read(bridge_conn_t *c) {
+    ssize_t n = line_reader_fill(&c->rx, c->fd);
+    if (n <= 0) {
+        conn_local_closed(c);
+        return;
+    }
+    char *line;
+    size_t len;
+    while (c->pending.count < UDP_RING_SIZE && (line = line_reader_next(&c->rx, &len)) != NULL)
+        udp_ring_push(&c->pending, (const uint8_t *)line, len + 1);
+    if (c->rx.overflow) {
+        c->rx.overflow = false;
+        local_bye(c, "Line too long");
+        if (c->session && !c->ended) ipk_bye(c->session);
+    }
+    bridge_drain_pending(c);
+}
+
+// Handles a datagram from a UDP client
+static void udp_local_datagram(bridge_conn_t *c, int fd, const uint8_t *buf, size_t len) {
+    if (udp_is_malformed(buf, len) || buf[0] == MSG_REPLY || buf[0] == MSG_PING) {
+        local_bye(c, "Malformed message");
+        if (c->session && !c->ended) ipk_bye(c->session);
+        return;
+    }
+    uint16_t id;
+    memcpy(&id, &buf[1], sizeof(uint16_t));
+    id = ntohs(id);
+    if (buf[0] == MSG_CNFRM) {
+        if (c->inflight && id == c->inflight_id) {
+            udp_ring_pop(&c->queue);
+            c->inflight = false;
+            udp_local_service(c, now_ms());
+        }
+        return;
+    }
+    // Without room it is not confirmed; the client's retransmission tries again
+    if (c->pending.count == UDP_RING_SIZE) return;
+    uint8_t confirm[3] = { MSG_CNFRM, buf[1], buf[2] };
+    sendto(fd, confirm, sizeof(confirm), MSG_DONTWAIT, (struct sockaddr *)&c->peer, sizeof(c->peer));
+    if (msgid_buffer_contains(&c->seen, id)) return;
+    msgid_buffer_add(&c->seen, id);
+    udp_ring_push(&c->pending, buf, len);
+    bridge_drain_pending(c);
+}
+
+static int socket_bound(int type, uint16_t port) {
+    int fd = socket(AF_INET, type, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in local = { .sin_family = AF_INET, .sin_port = htons(port) };
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) != 0 ||
+        (type == SOCK_STREAM && listen(fd, SOMAXCONN) != 0)) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// New datagram on the well-known port: a retransmitted AUTH of a known client
+// or the AUTH of a new one, which gets its own dynamic port
+static void udp_listener_read(int listen_fd) {
+    uint8_t buf[MAX_MESSAGE_SIZE];
+    struct sockaddr_in src;
+    socklen_t slen = sizeof(src);
+    ssize_t n = recvfrom(listen_fd, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr *)&src, &slen);
+    if (n < 3) return;
+
+    for (int i = 0; i < conn_count; i++) {
+        if (same_addr(&conns[i]->peer, &src)) {
+            udp_local_datagram(conns[i], listen_fd, buf, n);
+            return;
+        }
+    }
+    if (buf[0] != MSG_AUTH) {
+        uint8_t confirm[3] = { MSG_CNFRM, buf[1], buf[2] };
+        if (buf[0] != MSG_CNFRM)
+            sendto(listen_fd, confirm, sizeof(confirm), MSG_DONTWAIT, (struct sockaddr *)&src, slen);
+        return;
+    }
+    int fd = socket_bound(SOCK_DGRAM, 0);
+    if (fd < 0) return;
+    bridge_conn_t *c = conn_new(fd);
+    if (!c) {
+        close(fd);
+        return;
+    }
+    c->peer = src;
+    udp_local_datagram(c, listen_fd, buf, n);
+}
+
+static void tcp_listener_accept(int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return;
+    if (!conn_new(fd)) close(fd);
+}
+
+// Sends BYE on every session and tells every client
+static void bridge_shutdown(void) {
+    for (int i = 0; i < conn_count; i++) {
+        bridge_conn_t *c = conns[i];
+        if (c->session && !c->ended) ipk_bye(c->session);
+        local_bye(c, NULL);
+    }
+}
+
+static int bridge_run(int listen_port) {
+    int listen_fd = socket_bound(mode == BRIDGE_TCP2UDP ? SOCK_STREAM : SOCK_DGRAM, listen_port);
+    if (listen_fd < 0) return 1;
+    fprintf(stderr, "bridge: %s, local %s port %d, server %s %s:%u\n",
+            mode == BRIDGE_TCP2UDP ? "tcp2udp" : "udp2tcp",
+            mode == BRIDGE_TCP2UDP ? "TCP" : "UDP", listen_port,
+            mode == BRIDGE_TCP2UDP ? "UDP" : "TCP", server_ip, session_cfg.port);
+
+    static struct pollfd fds[BRIDGE_MAX_FDS];
+    static bridge_conn_t *owner[BRIDGE_MAX_FDS];
+    static bool is_session[BRIDGE_MAX_FDS];
+    int64_t drain_until = -1;
+
+    for (;;) {
+        if (terminate_bridge && drain_until < 0) {
+            bridge_shutdown();
+            drain_until = now_ms() + BRIDGE_DRAIN_MS;
+        }
+        if (drain_until >= 0 && (conn_count == 0 || now_ms() >= drain_until)) break;
+
+        int nfds = 0;
+        int timeout = -1;
+        fds[nfds++] = (struct pollfd){ .fd = drain_until < 0 ? listen_fd : -1, .events = POLLIN };
+        int64_t now = now_ms();
+        for (int i = 0; i < conn_count; i++) {
+            bridge_conn_t *c = conns[i];
+            short events = POLLIN;
+            if (mode == BRIDGE_TCP2UDP && c->tx.len > 0) events |= POLLOUT;
+            if (mode == BRIDGE_TCP2UDP && c->pending.count == UDP_RING_SIZE) events &= ~POLLIN;
+            owner[nfds] = c;
+            is_session[nfds] = false;
+            fds[nfds++] = (struct pollfd){ .fd = c->fd, .events = events };
+            if (mode == BRIDGE_UDP2TCP && (c->inflight || c->linger_until > now)) {
+                int64_t at = c->inflight ? c->resend_at : c->linger_until;
+                int left = at > now ? (int)(at - now) : 0;
+                if (timeout < 0 || left < timeout) timeout = left;
+            }
+            if (c->session && !c->ended) {
+                owner[nfds] = c;
+                is_session[nfds] = true;
+                fds[nfds++] = (struct pollfd){ .fd = ipk_session_fd(c->session),
+                                               .events = ipk_session_events(c->session) };
+                int t = ipk_session_timeout(c->session);
+                if (t >= 0 && (timeout < 0 || t < timeout)) timeout = t;
+            }
+        }
+        if (drain_until >= 0) {
+            int left = (int)(drain_until - now);
+            if (timeout < 0 || left < timeout) timeout = left > 0 ? left : 0;
+        }
+
+        if (poll(fds, nfds, timeout) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            if (mode == BRIDGE_TCP2UDP)
+                tcp_listener_accept(listen_fd);
+            else
+                udp_listener_read(listen_fd);
+        }
+
+        // Sessions are stepped on every pass so their timers fire
+        for (int k = 1; k < nfds; k++) {
+            bridge_conn_t *c = owner[k];
+            if (is_session[k]) {
+                if (!c->ended) ipk_session_step(c->session, fds[k].revents);
+                bridge_drain_pending(c);
+                continue;
+            }
+            if (mode == BRIDGE_TCP2UDP) {
+                if (fds[k].revents & POLLOUT) tcp_local_flush(c);
+                if (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) {
+                    if (c->local_done) conn_local_closed(c);
+                    else tcp_local_read(c);
+                }
+            } else {
+                if (fds[k].revents & POLLIN) {
+                    uint8_t buf[MAX_MESSAGE_SIZE];
+                    struct sockaddr_in src;
+                    socklen_t slen = sizeof(src);
+                    ssize_t n = recvfrom(c->fd, buf, sizeof(buf), MSG_DONTWAIT,
+                                         (struct sockaddr *)&src, &slen);
+                    if (n >= 3 && same_addr(&src, &c->peer)) udp_local_datagram(c, c->fd, buf, n);
+                }
+                udp_local_service(c, now_ms());
+            }
+        }
+
+        for (int i = conn_count - 1; i >= 0; i--) {
+            if (conn_finished(conns[i])) conn_free(i);
+        }
+    }
+
+    while (conn_count > 0) conn_free(conn_count - 1);
+    close(listen_fd);
+    return 0;
+}
+
+static void print_usage(void) {
+    fprintf(stderr, "Usage: ipk25chat-bridge [OPTIONS]\n");
+    fprintf(stderr, "  -m <tcp2udp|udp2tcp> Local clients' variant to the server's (required)\n");
+    fprintf(stderr, "  -s <server>          Server IP or hostname (required)\n");
+    fprintf(stderr, "  -p <port>            Server port (default: 4567)\n");
+    fprintf(stderr, "  -l <port>            Local port the clients connect to (default: 4568)\n");
+    fprintf(stderr, "  -d <timeout_ms>      UDP confirmation timeout in ms (default: 250)\n");
+    fprintf(stderr, "  -r <retries>         UDP max retries (default: 3)\n");
+    fprintf(stderr, "  -h                   Print this help\n");
+}
+
+int main(int argc, char *argv[]) {
+    char mode_name[16] = "";
+    char server_host[256] = "";
+    int server_port = 4567, listen_port = 4568;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0) {
+            print_usage();
+            return 0;
+        } else if (strcmp(argv[i], "-m") == 0 && (i+1 < argc)) {
+            strncpy(mode_name, argv[++i], sizeof(mode_name)-1);
+        } else if (strcmp(argv[i], "-s") == 0 && (i+1 < argc)) {
+            strncpy(server_host, argv[++i], sizeof(server_host)-1);
+        } else if (strcmp(argv[i], "-p") == 0 && (i+1 < argc)) {
+            server_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && (i+1 < argc)) {
+            listen_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && (i+1 < argc)) {
+            udp_timeout_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && (i+1 < argc)) {
+            udp_retries = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (strlen(mode_name) == 0 || strlen(server_host) == 0) {
+        fprintf(stderr, "Error: -m and -s are required.\n");
+        return 1;
+    }
+    if (strcmp(mode_name, "tcp2udp") == 0) {
+        mode = BRIDGE_TCP2UDP;
+    } else if (strcmp(mode_name, "udp2tcp") == 0) {
+        mode = BRIDGE_UDP2TCP;
+    } else {
+        fprintf(stderr, "Unsupported mode: %s\n", mode_name);
+        return 1;
+    }
+
+    // Resolved once; every session connects to the address
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    if (resolve_server_address(server_host, server_port, &server) != 0) return 1;
+    inet_ntop(AF_INET, &server.sin_addr, server_ip, sizeof(server_ip));
+
+    ipk_config_defaults(&session_cfg);
+    session_cfg.transport = mode == BRIDGE_TCP2UDP ? IPK_UDP : IPK_TCP;
+    session_cfg.host = server_ip;
+    session_cfg.port = server_port;
+    session_cfg.udp_timeout_ms = udp_timeout_ms;
+    session_cfg.udp_retries = udp_retries;
+    session_cfg.callbacks = (ipk_callbacks_t){ on_reply, on_msg, on_err, on_closed };
+
+    signal(SIGINT, handle_sigint_bridge);
+    signal(SIGTERM, handle_sigint_bridge);
+    signal(SIGPIPE, SIG_IGN);
+
+    int rc = bridge_run(listen_port);
+    fprintf(stderr, "bridge: %lu sessions, %lu messages to the server, %lu to the clients\n",
+            served, relayed_up, relayed_down);
+    return rc;
+}
@@ -0,0 +1,278 @@
+#define _GNU_SOURCE  // memmem
+
+#include "buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define POOL_CLASSES      5      // 256 B, 1 KiB, 4 KiB, 16 KiB, 64 KiB
+#define POOL_MIN_SHIFT    8
+#define POOL_CLASS_STEP   2      // each class is four times the previous one
+#define POOL_DEPTH        8      // retired blocks kept per class
+#define READ_MIN          1023   // free bytes before a read; a fresh reader fits a 1 KiB block
+
+// Retired blocks of one size class, linked through their first bytes
+// (the client is single-threaded)
+static struct {
+    void *free;
+    int   count;
+} pool[POOL_CLASSES];
+
+static size_t pool_class_size(int c) {
+    return (size_t)1 << (POOL_MIN_SHIFT + c * POOL_CLASS_STEP);
+}
+
+// Smallest class holding 'need' bytes, or -1 when it is larger than every class
+static int pool_class(size_t need) {
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        if (need <= pool_class_size(c)) return c;
+    }
+    return -1;
+}
+
+void *pool_alloc(size_t need, size_t *cap) {
+    int c = pool_class(need);
+    if (c < 0) {
+        // Oversized blocks are not pooled
+        void *data = malloc(need);
+        if (data) *cap = need;
+        return data;
+    }
+    *cap = pool_class_size(c);
+    if (pool[c].free) {
+        void *data = pool[c].free;
+        memcpy(&pool[c].free, data, sizeof(void *));
+        pool[c].count--;
+        return data;
+    }
+    return malloc(*cap);
+}
+
+void pool_free(void *data, size_t cap) {
+    if (!data) return;
+    int c = pool_class(cap);
+    if (c < 0 || pool_class_size(c) != cap || pool[c].count >= POOL_DEPTH) {
+        free(data);
+        return;
+    }
+    memcpy(data, &pool[c].free, sizeof(void *));
+    pool[c].free = data;
+    pool[c].count++;
+}
+
+void buffer_init(buffer_t *b) {
+    b->data = NULL;
+    b->len = 0;
+    b->cap = 0;
+}
+
+bool buffer_reserve(buffer_t *b, size_t extra) {
+    size_t need = b->len + extra + 1;
+    if (need <= b->cap) return true;
+
+    // Grow geometrically so repeated appends past the largest class stay cheap
+    if (need < 2 * b->cap) need = 2 * b->cap;
+
+    size_t cap;
+    char *data = pool_alloc(need, &cap);
+    if (!data) return false;
+    if (b->data) {
+        memcpy(data, b->data, b->len);
+        pool_free(b->data, b->cap);
+    }
+    b->data = data;
+    b->cap = cap;
+    b->data[b->len] = '\0';
+    return true;
+}
+
+bool buffer_append(buffer_t *b, const void *data, size_t n) {
+    if (!buffer_reserve(b, n)) return false;
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+    return true;
+}
+
+bool buffer_append_str(buffer_t *b, const char *s) {
+    return buffer_append(b, s, strlen(s));
+}
+
+void buffer_consume(buffer_t *b, size_t n) {
+    if (n >= b->len) {
+        buffer_clear(b);
+        return;
+    }
+    memmove(b->data, b->data + n, b->len - n);
+    b->len -= n;
+    b->data[b->len] = '\0';
+}
+
+void buffer_clear(buffer_t *b) {
+    b->len = 0;
+    if (b->data) b->data[0] = '\0';
+}
+
+void buffer_free(buffer_t *b) {
+    pool_free(b->data, b->cap);
+    buffer_init(b);
+}
+
+void line_reader_init(line_reader_t *r, const char *eol, size_t max_line) {
+    buffer_init(&r->buf);
+    r->scan = 0;
+    r->pending = 0;
+    r->max_line = max_line;
+    r->eol = eol;
+    r->eol_len = strlen(eol);
+    r->eof = false;
+    r->discarding = false;
+    r->overflow = false;
+}
+
+// Removes the line returned by the previous line_reader_next call
+static void line_reader_drop_pending(line_reader_t *r) {
+    if (r->pending == 0) return;
+    buffer_consume(&r->buf, r->pending);
+    r->pending = 0;
+    r->scan = 0;
+}
+
+ssize_t line_reader_fill(line_reader_t *r, int fd) {
+    line_reader_drop_pending(r);
+    if (!buffer_reserve(&r->buf, READ_MIN)) return -1;
+
+    ssize_t n;
+    do {
+        n = read(fd, r->buf.data + r->buf.len, r->buf.cap - r->buf.len - 1);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) return -1;
+    if (n == 0) {
+        r->eof = true;
+        return 0;
+    }
+    r->buf.len += n;
+    r->buf.data[r->buf.len] = '\0';
+    return n;
+}
+
+ssize_t line_reader_recv(line_reader_t *r, int fd, int64_t *stamp_ns) {
+    line_reader_drop_pending(r);
+    *stamp_ns = 0;
+    if (!buffer_reserve(&r->buf, READ_MIN)) return -1;
+
+    struct iovec iov = {
+        .iov_base = r->buf.data + r->buf.len,
+        .iov_len = r->buf.cap - r->buf.len - 1
+    };
+    union {
+        char buf[CMSG_SPACE(sizeof(struct timespec))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf)
+    };
+    ssize_t n;
+    do {
+        n = recvmsg(fd, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) return -1;
+    if (n == 0) {
+        r->eof = true;
+        return 0;
+    }
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            *stamp_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+        }
+    }
+    r->buf.len += n;
+    r->buf.data[r->buf.len] = '\0';
+    return n;
+}
+
+char *line_reader_next(line_reader_t *r, size_t *len) {
+    line_reader_drop_pending(r);
+
+    while (r->buf.len > 0) {
+        // Resume the search where the last one stopped; back off so a
+        // delimiter split across two reads is still found
+        size_t from = r->scan >= r->eol_len ? r->scan - (r->eol_len - 1) : 0;
+        char *hit = memmem(r->buf.data + from, r->buf.len - from, r->eol, r->eol_len);
+
+        if (!hit) {
+            r->scan = r->buf.len;
+            if (r->buf.len > r->max_line) {
+                // Too long: forget it and skip everything up to the next delimiter.
+                // The tail may hold the start of a split delimiter, so it stays.
+                if (!r->discarding) r->overflow = true;
+                r->discarding = true;
+                buffer_consume(&r->buf, r->buf.len - (r->eol_len - 1));
+                r->scan = r->buf.len;
+                return NULL;
+            }
+            if (r->eof && !r->discarding) {
+                // Last line without a delimiter
+                *len = r->buf.len;
+                r->pending = r->buf.len;
+                return r->buf.data;
+            }
+            if (r->eof) buffer_clear(&r->buf);
+            return NULL;
+        }
+
+        size_t line_len = hit - r->buf.data;
+        size_t consumed = line_len + r->eol_len;
+
+        if (r->discarding || line_len > r->max_line) {
+            if (!r->discarding) r->overflow = true;
+            r->discarding = false;
+            buffer_consume(&r->buf, consumed);
+            r->scan = 0;
+            continue;
+        }
+
+        // Hand the line out in place; it is dropped on the next call
+        *hit = '\0';
+        *len = line_len;
+        r->pending = consumed;
+        return r->buf.data;
+    }
+    return NULL;
+}
+
+bool line_reader_pending(line_reader_t *r) {
+    size_t len = r->buf.len - r->pending;
+    if (len == 0) return false;
+    if (r->eof && !r->discarding) return true;
+    return memmem(r->buf.data + r->pending, len, r->eol, r->eol_len) != NULL;
+}
+
+void line_reader_free(line_reader_t *r) {
+    buffer_free(&r->buf);
+}
+
+int send_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
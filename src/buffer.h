@@ -0,0 +1,81 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Size-class block pool (256 B to 64 KiB in steps of four) backing buffers
+// and arenas. Returns a block of at least 'need' bytes and its capacity.
+void *pool_alloc(size_t need, size_t *cap);
+
+// Returns a block for reuse; blocks beyond the per-class depth are freed
+void pool_free(void *data, size_t cap);
+
+// Growable byte buffer. The data is always NUL-terminated so it can be
+// handed to string functions; storage comes from the block pool.
+typedef struct {
+    char  *data;
+    size_t len;
+    size_t cap;
+} buffer_t;
+
+// Initialize an empty buffer (no allocation until first use)
+void buffer_init(buffer_t *b);
+
+// Make room for 'extra' more bytes (plus the terminating NUL)
+bool buffer_reserve(buffer_t *b, size_t extra);
+
+// Append raw bytes
+bool buffer_append(buffer_t *b, const void *data, size_t n);
+
+// Append a NUL-terminated string
+bool buffer_append_str(buffer_t *b, const char *s);
+
+// Drop the first n bytes
+void buffer_consume(buffer_t *b, size_t n);
+
+// Reset length to zero, keep storage
+void buffer_clear(buffer_t *b);
+
+// Return storage to the pool
+void buffer_free(buffer_t *b);
+
+// Reads newline-delimited records from a file descriptor without stdio,
+// so poll() and the read position never disagree.
+typedef struct {
+    buffer_t buf;
+    size_t   scan;        // bytes already searched for the delimiter
+    size_t   pending;     // bytes of the last returned line, dropped lazily
+    size_t   max_line;    // longer lines are dropped and reported
+    const char *eol;      // "\n" for stdin, "\r\n" for the TCP stream
+    size_t   eol_len;
+    bool     eof;
+    bool     discarding;  // skipping the rest of an overlong line
+    bool     overflow;    // set when a line was dropped, cleared by the caller
+} line_reader_t;
+
+void line_reader_init(line_reader_t *r, const char *eol, size_t max_line);
+
+// Reads once from fd. Returns bytes read, 0 on EOF, -1 on error.
+ssize_t line_reader_fill(line_reader_t *r, int fd);
+
+// line_reader_fill for a socket with SO_TIMESTAMPNS: also stores the kernel
+// RX time of the data read (CLOCK_REALTIME ns, 0 when none came with it)
+ssize_t line_reader_recv(line_reader_t *r, int fd, int64_t *stamp_ns);
+
+// Returns the next complete line (NUL-terminated, delimiter stripped) or NULL.
+// After EOF a trailing line without delimiter is returned as well.
+// The pointer is valid until the next call to line_reader_fill/next.
+char *line_reader_next(line_reader_t *r, size_t *len);
+
+// True when line_reader_next would return a line without reading more
+bool line_reader_pending(line_reader_t *r);
+
+void line_reader_free(line_reader_t *r);
+
+// Writes the whole buffer to a socket/fd, retrying on partial writes
+int send_all(int fd, const void *data, size_t len);
+
+#endif // BUFFER_H
@@ -0,0 +1,172 @@
+#include "capture.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint64_t ns_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000ull + now.tv_nsec - start->tv_nsec;
+}
+
+int capture_open(capture_t *c, const char *path) {
+    c->fp = fopen(path, "wb");
+    if (!c->fp) {
+        perror(path);
+        return -1;
+    }
+    // Datagrams are small; a large stdio buffer keeps capture off the syscall path
+    setvbuf(c->fp, NULL, _IOFBF, 1 << 16);
+
+    capture_file_header_t hdr = {
+        .magic = CAPTURE_MAGIC,
+        .version = CAPTURE_VERSION,
+        .record_size = sizeof(capture_record_t)
+    };
+    fwrite(&hdr, sizeof(hdr), 1, c->fp);
+    clock_gettime(CLOCK_MONOTONIC, &c->start);
+    return 0;
+}
+
+void capture_record(capture_t *c, uint8_t direction, const struct sockaddr_in *peer,
+                    const uint8_t *buf, size_t len) {
+    if (!c || !c->fp) return;
+    capture_record_t rec = {
+        .mono_ns   = ns_since(&c->start),
+        .addr      = peer ? peer->sin_addr.s_addr : 0,
+        .port      = peer ? peer->sin_port : 0,
+        .length    = len,
+        .direction = direction
+    };
+    fwrite(&rec, sizeof(rec), 1, c->fp);
+    fwrite(buf, 1, len, c->fp);
+}
+
+void capture_close(capture_t *c) {
+    if (c && c->fp) {
+        fclose(c->fp);
+        c->fp = NULL;
+    }
+}
+
+int replay_open(replay_t *r, const char *path, double speed) {
+    memset(r, 0, sizeof(*r));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(capture_file_header_t)) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        close(fd);
+        return -1;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    const capture_file_header_t *hdr = p;
+    if (hdr->magic != CAPTURE_MAGIC || hdr->version != CAPTURE_VERSION ||
+        hdr->record_size != sizeof(capture_record_t)) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        munmap(p, st.st_size);
+        return -1;
+    }
+
+    r->map = p;
+    r->size = st.st_size;
+    r->rx_off = r->tx_off = sizeof(capture_file_header_t);
+    r->speed = speed;
+    clock_gettime(CLOCK_MONOTONIC, &r->start);
+    return 0;
+}
+
+// Advances *off to the next record of the given direction; returns it or NULL
+static const capture_record_t *next_record(const replay_t *r, size_t *off, uint8_t direction) {
+    while (*off + sizeof(capture_record_t) <= r->size) {
+        capture_record_t rec;
+        memcpy(&rec, r->map + *off, sizeof(rec));
+        if (*off + sizeof(rec) + rec.length > r->size) break;  // truncated tail
+        if (rec.direction == direction)
+            return (const capture_record_t *)(r->map + *off);
+        *off += sizeof(rec) + rec.length;
+    }
+    *off = r->size;
+    return NULL;
+}
+
+long replay_next_due_ms(replay_t *r) {
+    const capture_record_t *p = next_record(r, &r->rx_off, CAPTURE_RX);
+    if (!p) return -1;
+
+    long wait = 0;
+    if (r->speed > 0) {
+        capture_record_t rec;
+        memcpy(&rec, p, sizeof(rec));
+        double due_ns = rec.mono_ns / r->speed;
+        double now_ns = ns_since(&r->start);
+        if (due_ns > now_ns) wait = (long)((due_ns - now_ns) / 1e6) + 1;
+    }
+
+    // The server answered the TX datagrams captured before this one, so they
+    // are sent first. A client that sends fewer than were captured is waited
+    // for at most REPLAY_GATE_MS.
+    if (next_record(r, &r->tx_off, CAPTURE_TX) && r->tx_off < r->rx_off) {
+        if (r->gate_off != r->rx_off) {
+            r->gate_off = r->rx_off;
+            clock_gettime(CLOCK_MONOTONIC, &r->gate_start);
+        }
+        long held = REPLAY_GATE_MS - (long)(ns_since(&r->gate_start) / 1000000);
+        if (held > wait) wait = held;
+    }
+    return wait;
+}
+
+int replay_next_rx(replay_t *r, const uint8_t **data, struct sockaddr_in *src) {
+    const capture_record_t *p = next_record(r, &r->rx_off, CAPTURE_RX);
+    if (!p) return -1;
+
+    capture_record_t rec;
+    memcpy(&rec, p, sizeof(rec));
+    *data = (const uint8_t *)p + sizeof(rec);
+
+    if (src) {
+        memset(src, 0, sizeof(*src));
+        src->sin_family = AF_INET;
+        src->sin_addr.s_addr = rec.addr;
+        src->sin_port = rec.port;
+    }
+    r->rx_off += sizeof(rec) + rec.length;
+    r->delivered++;
+    return (int)rec.length;
+}
+
+void replay_note_tx(replay_t *r, const uint8_t *buf, size_t len) {
+    r->sent++;
+    const capture_record_t *p = next_record(r, &r->tx_off, CAPTURE_TX);
+    if (!p) {
+        r->mismatched++;
+        return;
+    }
+    capture_record_t rec;
+    memcpy(&rec, p, sizeof(rec));
+    if (rec.length != len || memcmp((const uint8_t *)p + sizeof(rec), buf, len) != 0)
+        r->mismatched++;
+    r->tx_off += sizeof(rec) + rec.length;
+}
+
+void replay_close(replay_t *r) {
+    if (!r || !r->map) return;
+    fprintf(stderr, "Replay: %lu datagrams delivered, %lu sent, %lu differ from the capture\n",
+            r->delivered, r->sent, r->mismatched);
+    munmap((void *)r->map, r->size);
+    r->map = NULL;
+}
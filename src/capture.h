@@ -0,0 +1,82 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+#include <netinet/in.h>
+
+// Capture file layout: capture_file_header_t, then for every datagram a
+// packed capture_record_t immediately followed by 'length' raw bytes.
+
+#define CAPTURE_MAGIC   0x43504B49u  // "IKPC"
+#define CAPTURE_VERSION 1
+
+enum {
+    CAPTURE_RX = 0,   // datagram received from the server
+    CAPTURE_TX = 1    // datagram sent by the client
+};
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+} capture_file_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint64_t mono_ns;     // CLOCK_MONOTONIC, relative to the start of the capture
+    uint32_t addr;        // peer IPv4 address (network order)
+    uint16_t port;        // peer port (network order)
+    uint16_t length;      // datagram length
+    uint8_t  direction;   // CAPTURE_RX / CAPTURE_TX
+} capture_record_t;
+
+// Writer
+typedef struct {
+    FILE *fp;
+    struct timespec start;
+} capture_t;
+
+int  capture_open(capture_t *c, const char *path);
+void capture_record(capture_t *c, uint8_t direction, const struct sockaddr_in *peer,
+                    const uint8_t *buf, size_t len);
+void capture_close(capture_t *c);
+
+// Longest wait for a captured TX datagram that the client does not repeat
+#define REPLAY_GATE_MS 200
+
+// Replays the RX side of a capture; TX datagrams are compared, not sent
+typedef struct {
+    const uint8_t *map;
+    size_t   size;
+    size_t   rx_off;       // next RX record to deliver
+    size_t   tx_off;       // next TX record to compare against
+    double   speed;        // 1.0 = original timing, 2.0 = twice as fast, 0 = no delays
+    struct timespec start;
+    size_t   gate_off;     // RX record held back until the TX before it is sent ...
+    struct timespec gate_start;  // ... since this time
+    unsigned long delivered;
+    unsigned long sent;
+    unsigned long mismatched;
+} replay_t;
+
+// speed <= 0 delivers every datagram as soon as it is asked for
+int  replay_open(replay_t *r, const char *path, double speed);
+
+// Milliseconds until the next RX datagram is due (0 = now), -1 when exhausted.
+// A datagram is due at its captured time (scaled by the speed) and once the
+// TX datagrams captured before it have been sent.
+long replay_next_due_ms(replay_t *r);
+
+// Pops the next RX datagram regardless of its time. Returns its length or -1;
+// *data points into the mapped capture and stays valid until replay_close.
+int  replay_next_rx(replay_t *r, const uint8_t **data, struct sockaddr_in *src);
+
+// Compares an outgoing datagram with the next captured TX datagram
+void replay_note_tx(replay_t *r, const uint8_t *buf, size_t len);
+
+// Prints a summary and unmaps the capture
+void replay_close(replay_t *r);
+
+#endif // CAPTURE_H
@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -45,3 +46,96 @@ int resolve_server_address(const char *host, uint16_t port, struct sockaddr_in *
     freeaddrinfo(res);
     return 0;
 }
+
+int client_set_field(char *dst, size_t size, const char *value, field_class_e cls) {
+    if (strlen(value) >= size) {
+        fprintf(stderr, "Error: %s too long: %s\n", validate_field_name(cls), value);
+        return -1;
+    }
+    strcpy(dst, value);
+    return 0;
+}
+
+int client_add_channel(client_config_t *cfg, const char *channel) {
+    if (cfg->channel_count == CLIENT_MAX_CHANNELS) {
+        fprintf(stderr, "Error: at most %d initial channels.\n", CLIENT_MAX_CHANNELS);
+        return -1;
+    }
+    if (!validate_field_str(FIELD_CHANNEL, channel)) {
+        fprintf(stderr, "Error: invalid %s: %s\n", validate_field_name(FIELD_CHANNEL), channel);
+        return -1;
+    }
+    strcpy(cfg->channels[cfg->channel_count++], channel);
+    return 0;
+}
+
+int client_load_config(client_config_t *cfg, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char line[512];
+    int lineno = 0;
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *key = line + strspn(line, " \t");
+        key[strcspn(key, "#\r\n")] = '\0';
+        size_t end = strlen(key);
+        while (end > 0 && (key[end - 1] == ' ' || key[end - 1] == '\t')) key[--end] = '\0';
+        if (!key[0]) continue;
+
+        // "key = value", "key=value" or "key value"
+        size_t klen = strcspn(key, " \t=");
+        char *value = key + klen;
+        value += strspn(value, " \t");
+        if (*value == '=') value++;
+        value += strspn(value, " \t");
+        key[klen] = '\0';
+
+        if (!value[0]) {
+            fprintf(stderr, "Error: %s:%d: %s has no value\n", path, lineno, key);
+            rc = -1;
+        } else if (strcmp(key, "username") == 0) {
+            rc = client_set_field(cfg->username, sizeof(cfg->username), value, FIELD_USERNAME);
+        } else if (strcmp(key, "secret") == 0) {
+            rc = client_set_field(cfg->secret, sizeof(cfg->secret), value, FIELD_SECRET);
+        } else if (strcmp(key, "display_name") == 0) {
+            rc = client_set_field(cfg->display_name, sizeof(cfg->display_name), value,
+                                  FIELD_DISPLAY_NAME);
+        } else if (strcmp(key, "channel") == 0) {
+            rc = client_add_channel(cfg, value);
+        } else {
+            fprintf(stderr, "Error: %s:%d: unknown key %s\n", path, lineno, key);
+            rc = -1;
+        }
+    }
+    fclose(f);
+    return rc;
+}
+
+int client_check_login(client_config_t *cfg) {
+    if (!cfg->username[0] && !cfg->secret[0] && !cfg->display_name[0] && cfg->channel_count == 0)
+        return 0;
+    if (!cfg->username[0] || !cfg->secret[0]) {
+        fprintf(stderr, "Error: a username and a secret are needed to authenticate at startup.\n");
+        return -1;
+    }
+    if (!cfg->display_name[0]) strcpy(cfg->display_name, cfg->username);
+
+    const struct { field_class_e cls; const char *value; } fields[] = {
+        { FIELD_USERNAME, cfg->username },
+        { FIELD_SECRET, cfg->secret },
+        { FIELD_DISPLAY_NAME, cfg->display_name },
+    };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (!validate_field_str(fields[i].cls, fields[i].value)) {
+            fprintf(stderr, "Error: invalid %s: %s\n", validate_field_name(fields[i].cls),
+                    fields[i].value);
+            return -1;
+        }
+    }
+    return 0;
+}
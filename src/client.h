@@ -4,6 +4,10 @@
 #include <stdint.h>
 #include <netinet/in.h>
 
+#include "validate.h"
+
+#define CLIENT_MAX_CHANNELS 8   // initial channels (-j / "channel" lines)
+
 // Configuration structure for the entire client
 typedef struct {
     char transport[8];               // "tcp" or "udp"
@@ -11,10 +15,48 @@ typedef struct {
     int  port;                       // Server port
     int  udp_confirm_timeout_ms;     // UDP confirmation timeout (ms)
     int  udp_max_retries;            // UDP max retransmissions
+    char transcript[256];            // Transcript path prefix (empty = off)
+    char capture[256];               // UDP datagram capture file (empty = off)
+    char replay[256];                // UDP capture to replay instead of a server
+    double replay_speed;             // Replay speed factor (0 = no delays)
+    double pace_rate;                // Outgoing messages per second (0 = unpaced)
+    double pace_burst;               // Messages that may be sent back to back
+    char trace[256];                 // Chrome trace-event JSON output (empty = off)
+    char binlog[256];                // Binary log ring file (empty = off)
+    int  log_level;                  // Binary log level (binlog_level_e)
+    int  print_stats;                // UDP: socket statistics to stderr at exit
+    int  adaptive_rto;               // UDP: CONFIRM timeout from the measured RTT
+    int  lowlat_spin_us;             // Low-latency mode spin budget (0 = default mode)
+    int  cpu;                        // CPU to pin the client to (-1 = any)
+    int  resume_ms;                  // Session resume window after a lost connection (0 = off)
+    char ring[256];                  // Shared-memory message ring name (empty = off)
+
+    // Non-interactive start: with a username the client sends AUTH as soon as
+    // it is connected and then JOINs the first of the channels that accepts it
+    char username[IPK_MAX_USERNAME_LEN + 1];
+    char secret[IPK_MAX_SECRET_LEN + 1];
+    char display_name[IPK_MAX_DNAME_LEN + 1];  // defaults to the username
+    char channels[CLIENT_MAX_CHANNELS][IPK_MAX_CHANNEL_LEN + 1];
+    int  channel_count;
 } client_config_t;
 
 struct timespec start_timer();
 long get_elapsed_ms(struct timespec start);
+// Reads "key = value" lines (username, secret, display_name, channel; '#'
+// starts a comment) into the configuration. Returns -1 after reporting the
+// first bad line.
+int client_load_config(client_config_t *cfg, const char *path);
+
+// Copies a startup credential into its field. Returns -1 after reporting one that does not fit.
+int client_set_field(char *dst, size_t size, const char *value, field_class_e cls);
+
+// Appends an initial channel. Returns -1 after reporting a bad or surplus one.
+int client_add_channel(client_config_t *cfg, const char *channel);
+
+// Checks the non-interactive start settings and fills in the display name.
+// Returns -1 after reporting what is missing or invalid.
+int client_check_login(client_config_t *cfg);
+
 int resolve_server_address(const char *host, uint16_t port, struct sockaddr_in *out_addr);
 
 #endif // CLIENT_H
@@ -0,0 +1,136 @@
+#define _DEFAULT_SOURCE  // madvise
+
+#include "filesend.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "binlog.h"
+#include "validate.h"
+
+#define FILESEND_REPORT_MS 1000
+#define FILESEND_MIB (1024.0 * 1024.0)
+
+static int64_t filesend_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// MiB/s over the time since the transfer started
+static double filesend_rate(const filesend_t *fs, int64_t now) {
+    int64_t ms = now - fs->started_ms;
+    return ms > 0 ? fs->off / FILESEND_MIB * 1000.0 / ms : 0.0;
+}
+
+static void filesend_unmap(filesend_t *fs) {
+    if (fs->map) munmap((void *)fs->map, fs->size);
+    filesend_init(fs);
+}
+
+void filesend_init(filesend_t *fs) {
+    memset(fs, 0, sizeof(*fs));
+}
+
+int filesend_open(filesend_t *fs, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stdout, "ERROR: Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stdout, "ERROR: %s is not a regular file.\n", path);
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        fprintf(stdout, "ERROR: %s is empty.\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping keeps the file
+    if (map == MAP_FAILED) {
+        fprintf(stdout, "ERROR: Cannot map %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    filesend_init(fs);
+    const char *base = strrchr(path, '/');
+    snprintf(fs->name, sizeof(fs->name), "%s", base ? base + 1 : path);
+    fs->map = map;
+    fs->size = st.st_size;
+    fs->started_ms = fs->reported_ms = filesend_now_ms();
+    BLOG_BLOB(LOG_FILESEND_START, fs->name, strlen(fs->name), (uint64_t)fs->size);
+    return 0;
+}
+
+bool filesend_active(const filesend_t *fs) {
+    return fs->map != NULL;
+}
+
+bool filesend_eof(const filesend_t *fs) {
+    return fs->off == fs->size;
+}
+
+size_t filesend_next(filesend_t *fs, char *out) {
+    size_t n = 0;
+    // Chunks left empty (blank lines, lone CRs) are skipped
+    while (n == 0 && fs->off < fs->size) {
+        size_t in = fs->off;
+        size_t cut_in = 0, cut_out = 0;  // just past the last line break
+        while (in < fs->size && n < IPK_MAX_CONTENT_LEN) {
+            unsigned char c = fs->map[in++];
+            if (c == '\r' || (c == '\n' && n == 0)) continue;
+            if (c == '\n') {
+                cut_in = in;
+                cut_out = n;
+            } else if (c == '\t') {
+                c = ' ';
+            } else if (!validate_char(FIELD_CONTENT, c)) {
+                c = '?';
+            }
+            out[n++] = (char)c;
+        }
+        if (in < fs->size && cut_out > 0) {
+            in = cut_in;
+            n = cut_out;
+        }
+        while (n > 0 && out[n - 1] == '\n') n--;
+        fs->off = in;
+    }
+    if (n > 0) fs->chunks++;
+    return n;
+}
+
+void filesend_progress(filesend_t *fs) {
+    int64_t now = filesend_now_ms();
+    if (now - fs->reported_ms < FILESEND_REPORT_MS) return;
+    fs->reported_ms = now;
+    fprintf(stderr, "Sending %s: %.2f of %.2f MiB (%d%%), %.2f MiB/s\n", fs->name,
+            fs->off / FILESEND_MIB, fs->size / FILESEND_MIB,
+            (int)(fs->off * 100 / fs->size), filesend_rate(fs, now));
+}
+
+void filesend_finish(filesend_t *fs) {
+    int64_t now = filesend_now_ms();
+    fprintf(stderr, "Sent %s: %zu bytes in %lu messages, %.2f s, %.2f MiB/s\n", fs->name,
+            fs->size, fs->chunks, (now - fs->started_ms) / 1000.0, filesend_rate(fs, now));
+    BLOG(LOG_FILESEND_DONE, (uint64_t)fs->size, (uint64_t)fs->chunks, now - fs->started_ms);
+    filesend_unmap(fs);
+}
+
+void filesend_abort(filesend_t *fs, const char *reason) {
+    fprintf(stdout, "ERROR: Sending %s stopped after %zu of %zu bytes: %s.\n", fs->name,
+            fs->off, fs->size, reason);
+    BLOG(LOG_FILESEND_ABORTED, (uint64_t)fs->off, (uint64_t)fs->size);
+    filesend_unmap(fs);
+}
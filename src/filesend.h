@@ -0,0 +1,48 @@
+#ifndef FILESEND_H
+#define FILESEND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// /sendfile: a memory-mapped file cut into MSG contents of up to the protocol
+// maximum. Bytes outside the content character class are replaced (CR
+// dropped, TAB as a space, anything else as '?'), and a chunk that has to be
+// cut ends at its last line break so lines are not split between messages.
+// The transport decides how many chunks it keeps in flight; this only
+// produces them and reports progress and throughput on stderr.
+typedef struct {
+    char name[64];              // file name for the progress lines
+    const unsigned char *map;
+    size_t size;
+    size_t off;                 // file bytes taken into chunks so far
+    unsigned long chunks;
+    int64_t started_ms, reported_ms;  // monotonic
+} filesend_t;
+
+// Zeroed state: no file being sent
+void filesend_init(filesend_t *fs);
+
+// Maps the file. Prints why and returns -1 when it cannot be sent.
+int filesend_open(filesend_t *fs, const char *path);
+
+// True between filesend_open and filesend_finish/filesend_abort
+bool filesend_active(const filesend_t *fs);
+
+// True once every byte of the file is in a chunk
+bool filesend_eof(const filesend_t *fs);
+
+// Writes the next chunk (at most IPK_MAX_CONTENT_LEN bytes, not
+// NUL-terminated) to 'out'. Returns its length, 0 at the end of the file.
+size_t filesend_next(filesend_t *fs, char *out);
+
+// Prints a progress line, at most every FILESEND_REPORT_MS
+void filesend_progress(filesend_t *fs);
+
+// Prints the summary and unmaps the file
+void filesend_finish(filesend_t *fs);
+
+// Gives up the transfer, saying why, and unmaps the file
+void filesend_abort(filesend_t *fs, const char *reason);
+
+#endif // FILESEND_H
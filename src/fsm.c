@@ -0,0 +1,92 @@
+#include "fsm.h"
+
+#define T(next, action) { FSM_##next, FSM_ACT_##action }
+
+// Rows are states, columns events; every cell is spelled out so that a missing
+// entry cannot silently fall back to { START, NONE }.
+const fsm_transition_t fsm_table[FSM_STATE_COUNT][FSM_EVENT_COUNT] = {
+    [FSM_START] = {
+        [FSM_EV_CMD_AUTH]     = T(AUTH,  REQUEST),
+        [FSM_EV_CMD_JOIN]     = T(START, DENY),
+        [FSM_EV_CMD_MSG]      = T(START, DENY),
+        [FSM_EV_CMD_BYE]      = T(END,   BYE),
+        [FSM_EV_RX_REPLY_OK]  = T(END,   ERR_BYE),
+        [FSM_EV_RX_REPLY_NOK] = T(END,   ERR_BYE),
+        [FSM_EV_RX_MSG]       = T(END,   ERR_BYE),
+        [FSM_EV_RX_ERR]       = T(END,   REMOTE_ERR),
+        [FSM_EV_RX_BYE]       = T(END,   FINISH),
+        [FSM_EV_RX_INVALID]   = T(END,   ERR_BYE),
+        [FSM_EV_TIMEOUT]      = T(END,   ERR_BYE),
+        [FSM_EV_CLOSED]       = T(END,   FINISH),
+        [FSM_EV_RESUME]       = T(START, DENY),
+    },
+    [FSM_AUTH] = {
+        [FSM_EV_CMD_AUTH]     = T(AUTH,  BUSY),
+        [FSM_EV_CMD_JOIN]     = T(AUTH,  BUSY),
+        [FSM_EV_CMD_MSG]      = T(AUTH,  BUSY),
+        [FSM_EV_CMD_BYE]      = T(END,   BYE),
+        [FSM_EV_RX_REPLY_OK]  = T(OPEN,  REPLY),
+        [FSM_EV_RX_REPLY_NOK] = T(START, REPLY),   // AUTH may be retried
+        [FSM_EV_RX_MSG]       = T(AUTH,  DELIVER),
+        [FSM_EV_RX_ERR]       = T(END,   REMOTE_ERR),
+        [FSM_EV_RX_BYE]       = T(END,   FINISH),
+        [FSM_EV_RX_INVALID]   = T(END,   ERR_BYE),
+        [FSM_EV_TIMEOUT]      = T(END,   ERR_BYE),
+        [FSM_EV_CLOSED]       = T(END,   FINISH),
+        [FSM_EV_RESUME]       = T(AUTH,  REQUEST),  // the replayed AUTH was lost too
+    },
+    [FSM_OPEN] = {
+        [FSM_EV_CMD_AUTH]     = T(OPEN,  DENY),
+        [FSM_EV_CMD_JOIN]     = T(JOIN,  REQUEST),
+        [FSM_EV_CMD_MSG]      = T(OPEN,  SEND),
+        [FSM_EV_CMD_BYE]      = T(END,   BYE),
+        [FSM_EV_RX_REPLY_OK]  = T(END,   ERR_BYE),
+        [FSM_EV_RX_REPLY_NOK] = T(END,   ERR_BYE),
+        [FSM_EV_RX_MSG]       = T(OPEN,  DELIVER),
+        [FSM_EV_RX_ERR]       = T(END,   REMOTE_ERR),
+        [FSM_EV_RX_BYE]       = T(END,   FINISH),
+        [FSM_EV_RX_INVALID]   = T(END,   ERR_BYE),
+        [FSM_EV_TIMEOUT]      = T(END,   ERR_BYE),
+        [FSM_EV_CLOSED]       = T(END,   FINISH),
+        [FSM_EV_RESUME]       = T(AUTH,  REQUEST),
+    },
+    [FSM_JOIN] = {
+        [FSM_EV_CMD_AUTH]     = T(JOIN,  DENY),
+        [FSM_EV_CMD_JOIN]     = T(JOIN,  BUSY),
+        [FSM_EV_CMD_MSG]      = T(JOIN,  BUSY),
+        [FSM_EV_CMD_BYE]      = T(END,   BYE),
+        [FSM_EV_RX_REPLY_OK]  = T(OPEN,  REPLY),
+        [FSM_EV_RX_REPLY_NOK] = T(OPEN,  REPLY),
+        [FSM_EV_RX_MSG]       = T(JOIN,  DELIVER),
+        [FSM_EV_RX_ERR]       = T(END,   REMOTE_ERR),
+        [FSM_EV_RX_BYE]       = T(END,   FINISH),
+        [FSM_EV_RX_INVALID]   = T(END,   ERR_BYE),
+        [FSM_EV_TIMEOUT]      = T(END,   ERR_BYE),
+        [FSM_EV_CLOSED]       = T(END,   FINISH),
+        [FSM_EV_RESUME]       = T(AUTH,  REQUEST),
+    },
+    [FSM_END] = {
+        [FSM_EV_CMD_AUTH]     = T(END,   DENY),
+        [FSM_EV_CMD_JOIN]     = T(END,   DENY),
+        [FSM_EV_CMD_MSG]      = T(END,   DENY),
+        [FSM_EV_CMD_BYE]      = T(END,   NONE),
+        [FSM_EV_RX_REPLY_OK]  = T(END,   NONE),
+        [FSM_EV_RX_REPLY_NOK] = T(END,   NONE),
+        [FSM_EV_RX_MSG]       = T(END,   NONE),
+        [FSM_EV_RX_ERR]       = T(END,   NONE),
+        [FSM_EV_RX_BYE]       = T(END,   NONE),
+        [FSM_EV_RX_INVALID]   = T(END,   NONE),
+        [FSM_EV_TIMEOUT]      = T(END,   FINISH),  // the closing BYE was not confirmed
+        [FSM_EV_CLOSED]       = T(END,   FINISH),
+        [FSM_EV_RESUME]       = T(END,   DENY),
+    },
+};
+
+#undef T
+
+const char *fsm_state_name(fsm_state_e state) {
+    static const char *const names[FSM_STATE_COUNT] = {
+        "start", "auth", "open", "join", "end"
+    };
+    return state < FSM_STATE_COUNT ? names[state] : "?";
+}
@@ -0,0 +1,82 @@
+#ifndef FSM_H
+#define FSM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// IPK25-CHAT client state machine shared by the TCP and UDP clients and the
+// session library. The transports translate what happened (user command,
+// server message, timer) into an fsm_event_e; one table lookup yields the
+// next state and the action the transport has to perform, so a session is
+// nothing more than its state and the same core can drive any number of them.
+
+typedef enum {
+    FSM_START,      // not authenticated
+    FSM_AUTH,       // AUTH sent, waiting for its REPLY
+    FSM_OPEN,       // authenticated
+    FSM_JOIN,       // JOIN sent, waiting for its REPLY
+    FSM_END,        // BYE sent or received, nothing else may be sent
+    FSM_STATE_COUNT
+} fsm_state_e;
+
+typedef enum {
+    // User commands
+    FSM_EV_CMD_AUTH,
+    FSM_EV_CMD_JOIN,
+    FSM_EV_CMD_MSG,
+    FSM_EV_CMD_BYE,
+    // Server messages
+    FSM_EV_RX_REPLY_OK,
+    FSM_EV_RX_REPLY_NOK,
+    FSM_EV_RX_MSG,
+    FSM_EV_RX_ERR,
+    FSM_EV_RX_BYE,
+    FSM_EV_RX_INVALID,  // malformed or not allowed from a server
+    // Timers and transport
+    FSM_EV_TIMEOUT,     // CONFIRM or REPLY not received in time
+    FSM_EV_CLOSED,      // connection lost
+    FSM_EV_RESUME,      // connection lost or replaced, AUTH is replayed (-K)
+    FSM_EVENT_COUNT
+} fsm_event_e;
+
+typedef enum {
+    FSM_ACT_NONE,       // nothing to do
+    FSM_ACT_SEND,       // send the message
+    FSM_ACT_REQUEST,    // send the request and arm the REPLY timer
+    FSM_ACT_REPLY,      // report the REPLY and disarm the timer
+    FSM_ACT_DELIVER,    // show the server message
+    FSM_ACT_DENY,       // refuse the command, it is not allowed in this state
+    FSM_ACT_BUSY,       // refuse the command until the pending REPLY arrives
+    FSM_ACT_BYE,        // send BYE
+    FSM_ACT_REMOTE_ERR, // report the server's ERR and send BYE
+    FSM_ACT_ERR_BYE,    // protocol error: send ERR and BYE
+    FSM_ACT_FINISH      // stop without sending anything
+} fsm_action_e;
+
+typedef struct {
+    uint8_t next;       // fsm_state_e
+    uint8_t action;     // fsm_action_e
+} fsm_transition_t;
+
+extern const fsm_transition_t fsm_table[FSM_STATE_COUNT][FSM_EVENT_COUNT];
+
+// Looks the transition up without taking it (to check a command first)
+static inline fsm_transition_t fsm_lookup(fsm_state_e state, fsm_event_e event) {
+    return fsm_table[state][event];
+}
+
+// Takes the transition and returns the action to perform
+static inline fsm_action_e fsm_step(fsm_state_e *state, fsm_event_e event) {
+    fsm_transition_t t = fsm_table[*state][event];
+    *state = (fsm_state_e)t.next;
+    return (fsm_action_e)t.action;
+}
+
+// True while a REPLY is outstanding
+static inline bool fsm_awaiting_reply(fsm_state_e state) {
+    return state == FSM_AUTH || state == FSM_JOIN;
+}
+
+const char *fsm_state_name(fsm_state_e state);
+
+#endif // FSM_H
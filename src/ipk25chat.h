@@ -0,0 +1,105 @@
+#ifndef IPK25CHAT_H
+#define IPK25CHAT_H
+
+// libipk25chat: non-blocking IPK25-CHAT sessions for embedding in an
+// external event loop. A session never blocks (apart from resolving a host
+// name in ipk_session_open), never touches stdin/stdout and never exits the
+// process. All sessions share one buffer pool and must be driven from a
+// single thread.
+//
+// Typical loop:
+//   struct pollfd p = { ipk_session_fd(s), ipk_session_events(s), 0 };
+//   poll(&p, 1, ipk_session_timeout(s));
+//   ipk_session_step(s, p.revents);
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IPK_API __attribute__((visibility("default")))
+
+typedef struct ipk_session ipk_session_t;
+
+typedef enum {
+    IPK_TCP,
+    IPK_UDP
+} ipk_transport_e;
+
+typedef enum {
+    IPK_OK       =  0,
+    IPK_EINVAL   = -1,  // a field failed validation
+    IPK_ESTATE   = -2,  // request not allowed in the current state
+    IPK_EBUSY    = -3,  // a REPLY is pending or the send queue is full; retry later
+    IPK_ENOMEM   = -4,
+    IPK_EIO      = -5,  // socket error or connection lost
+    IPK_ETIMEOUT = -6,  // CONFIRM or REPLY not received in time
+    IPK_EPROTO   = -7,  // malformed or unexpected message from the server
+    IPK_EREMOTE  = -8   // the server reported an ERR
+} ipk_status_e;
+
+typedef enum {
+    IPK_STATE_START,    // connected, not authenticated
+    IPK_STATE_AUTH,     // AUTH sent, waiting for its REPLY
+    IPK_STATE_OPEN,     // authenticated
+    IPK_STATE_JOIN,     // JOIN sent, waiting for its REPLY
+    IPK_STATE_END       // finished, only ipk_session_close is useful
+} ipk_state_e;
+
+// Server events. The strings are only valid during the call.
+typedef struct {
+    void (*on_reply)(void *user, bool ok, const char *content);
+    void (*on_msg)(void *user, const char *display_name, const char *content);
+    void (*on_err)(void *user, const char *display_name, const char *content);
+    // Called once when the session ends; IPK_OK after an orderly BYE
+    void (*on_closed)(void *user, ipk_status_e status);
+} ipk_callbacks_t;
+
+typedef struct {
+    ipk_transport_e transport;
+    const char *host;
+    uint16_t port;
+    uint16_t udp_timeout_ms;   // CONFIRM timeout
+    uint8_t udp_retries;       // retransmissions before giving up
+    ipk_callbacks_t callbacks; // any of them may be NULL
+    void *user;                // passed to the callbacks
+} ipk_config_t;
+
+// Fills in the protocol defaults (port 4567, 250 ms, 3 retries)
+IPK_API void ipk_config_defaults(ipk_config_t *cfg);
+
+// Creates the socket and starts connecting. Returns NULL on failure.
+IPK_API ipk_session_t *ipk_session_open(const ipk_config_t *cfg);
+
+// Releases the session without sending BYE
+IPK_API void ipk_session_close(ipk_session_t *s);
+
+// Descriptor to watch and the poll() events the session currently needs
+IPK_API int ipk_session_fd(const ipk_session_t *s);
+IPK_API short ipk_session_events(const ipk_session_t *s);
+
+// Next timer as CLOCK_MONOTONIC milliseconds, -1 when none is armed
+IPK_API int64_t ipk_session_deadline(const ipk_session_t *s);
+
+// Milliseconds until the next timer (a poll() timeout), -1 when none is armed
+IPK_API int ipk_session_timeout(const ipk_session_t *s);
+
+// Performs the I/O signalled in 'revents' (0 for a timer tick), fires due
+// timers and callbacks. Returns IPK_OK while the session runs and the final
+// status once it has ended (IPK_OK after an orderly BYE, so check
+// ipk_session_state). The session must not be closed from a callback.
+IPK_API int ipk_session_step(ipk_session_t *s, short revents);
+
+IPK_API ipk_state_e ipk_session_state(const ipk_session_t *s);
+
+// Requests; they are queued and sent by ipk_session_step. Each returns an
+// ipk_status_e.
+IPK_API int ipk_auth(ipk_session_t *s, const char *username, const char *secret,
+                     const char *display_name);
+IPK_API int ipk_join(ipk_session_t *s, const char *channel);
+IPK_API int ipk_send(ipk_session_t *s, const char *content);
+IPK_API int ipk_rename(ipk_session_t *s, const char *display_name);
+// Sends BYE; the session ends once it has been delivered
+IPK_API int ipk_bye(ipk_session_t *s);
+
+IPK_API const char *ipk_strerror(int status);
+
+#endif // IPK25CHAT_H
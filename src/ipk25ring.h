@@ -0,0 +1,117 @@
+#ifndef IPK25RING_H
+#define IPK25RING_H
+
+// Reader side of the client's shared-memory message ring (-O <name>). The
+// client publishes every message it receives as a record in a POSIX
+// shared-memory object; local consumers take them from there instead of
+// parsing its stdout. Records are read in place: the strings a reader gets
+// point into the mapping and nothing is copied or formatted.
+//
+// There is one writer and any number of independent readers. The writer
+// never waits for them: a reader that falls more than the ring size behind
+// loses the oldest records (counted by ipk_ring_lost). A record handed out
+// stays readable until the writer laps it, so a consumer that keeps the
+// strings past the next ipk_ring_next should confirm with ipk_ring_valid
+// after using them.
+//
+//   ipk_ring_t *r = ipk_ring_open("ipk25chat", false);
+//   ipk_ring_msg_t m;
+//   int rc;
+//   while ((rc = ipk_ring_next(r, &m)) >= 0) {
+//       if (rc == 0) { ipk_ring_wait(r, -1); continue; }
+//       index(m.sender, m.content, m.content_len);
+//   }
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef IPK_API
+#define IPK_API __attribute__((visibility("default")))
+#endif
+
+// --- Shared layout, written by the client ---
+
+#define IPK_RING_MAGIC   0x474E5249u  // "IRNG"
+#define IPK_RING_VERSION 1
+
+// Record types, numbered by the IPK25-CHAT UDP type byte
+#define IPK_RING_REPLY 0x01
+#define IPK_RING_MSG   0x04
+#define IPK_RING_ERR   0xFE
+#define IPK_RING_BYE   0xFF
+#define IPK_RING_PAD   0x00   // filler up to the end of the ring, skipped by readers
+
+#define IPK_RING_F_OK  0x01   // REPLY: positive
+
+#define IPK_RING_TCP   0
+#define IPK_RING_UDP   1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;   // sizeof(ipk_ring_record_t)
+    uint64_t size;          // ring bytes following the header
+    uint64_t head;          // bytes ever written; everything below is complete
+    uint64_t tail;          // oldest byte not yet given up for overwriting
+    uint32_t notify;        // bumped with every record (futex word)
+    uint32_t waiters;       // readers sleeping in ipk_ring_wait
+    uint32_t writer_pid;
+    uint32_t closed;        // the writer has finished
+    uint8_t  pad[16];
+} ipk_ring_header_t;        // 64 bytes
+
+// A record is 8-aligned and never wraps. Offsets count from its start; each
+// string is followed by a NUL that its length does not include.
+typedef struct {
+    uint32_t size;          // whole record
+    uint8_t  type;          // IPK_RING_*
+    uint8_t  flags;         // IPK_RING_F_*
+    uint8_t  transport;     // IPK_RING_TCP / IPK_RING_UDP
+    uint8_t  reserved;
+    uint64_t seq;           // record number, from 0
+    int64_t  ts_ns;         // CLOCK_REALTIME when the client received the message
+    uint16_t sender_off, sender_len;     // display name (empty for a REPLY)
+    uint16_t channel_off, channel_len;   // channel joined at the time (empty before a JOIN)
+    uint32_t content_off, content_len;
+} ipk_ring_record_t;        // 40 bytes
+
+// --- Reader ---
+
+typedef struct ipk_ring ipk_ring_t;
+
+// One record, pointing into the shared mapping
+typedef struct {
+    uint8_t type, flags, transport;
+    uint64_t seq;
+    int64_t ts_ns;
+    const char *sender;
+    size_t sender_len;
+    const char *channel;
+    size_t channel_len;
+    const char *content;
+    size_t content_len;
+    uint64_t pos;           // ring position, for ipk_ring_valid
+} ipk_ring_msg_t;
+
+// Attaches to the ring published as 'name' (as given to -O). A new reader
+// starts with the oldest record still in the ring, or with the next one to
+// be written when 'from_oldest' is false. NULL with errno set on failure.
+IPK_API ipk_ring_t *ipk_ring_open(const char *name, bool from_oldest);
+IPK_API void ipk_ring_close(ipk_ring_t *r);
+
+// Takes the next record: 1 when 'm' was filled, 0 when there is nothing new,
+// -1 once the writer has finished and every record was taken
+IPK_API int ipk_ring_next(ipk_ring_t *r, ipk_ring_msg_t *m);
+
+// True when the record's strings have not been overwritten since it was taken
+IPK_API bool ipk_ring_valid(const ipk_ring_t *r, const ipk_ring_msg_t *m);
+
+// Sleeps until a record is written or the writer finishes, at most
+// timeout_ms (-1 = no limit). Returns 1 when there is something to take.
+IPK_API int ipk_ring_wait(ipk_ring_t *r, int timeout_ms);
+
+// Records overwritten before this reader got to them
+IPK_API uint64_t ipk_ring_lost(const ipk_ring_t *r);
+
+#endif // IPK25RING_H
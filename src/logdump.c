@@ -0,0 +1,222 @@
+// ipk25chat-logdump: formats a binary log written with -G
+//
+// Usage: ipk25chat-logdump [-l <level>] <file>
+
+#include "binlog.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char *type_name(uint8_t type) {
+    switch (type) {
+        case 0x00: return "CONFIRM";
+        case 0x01: return "REPLY";
+        case 0x02: return "AUTH";
+        case 0x03: return "JOIN";
+        case 0x04: return "MSG";
+        case 0xFD: return "PING";
+        case 0xFE: return "ERR";
+        case 0xFF: return "BYE";
+        default:   return "UNKNOWN";
+    }
+}
+
+// Next NUL-terminated field of a (possibly truncated) datagram
+static const char *take_field(const uint8_t *buf, size_t len, size_t *off, int *width) {
+    if (*off >= len) {
+        *width = 0;
+        return "";
+    }
+    const char *s = (const char *)buf + *off;
+    size_t n = strnlen(s, len - *off);
+    *off += n + 1;
+    *width = (int)n;
+    return s;
+}
+
+// Decodes a logged UDP datagram; every read stays within the blob
+static void print_packet(const uint8_t *buf, size_t len) {
+    if (len < 3) {
+        printf("(%zu bytes)", len);
+        return;
+    }
+    unsigned id = (unsigned)buf[1] << 8 | buf[2];
+    printf("%s id=%u", type_name(buf[0]), id);
+
+    size_t off = 3;
+    int w1, w2;
+    const char *a, *b;
+    switch (buf[0]) {
+        case 0x01:
+            if (len < 6) break;
+            off = 6;
+            a = take_field(buf, len, &off, &w1);
+            printf(" %s ref=%u \"%.*s\"", buf[3] ? "OK" : "NOK",
+                   (unsigned)buf[4] << 8 | buf[5], w1, a);
+            break;
+        case 0x02:
+            a = take_field(buf, len, &off, &w1);
+            b = take_field(buf, len, &off, &w2);
+            printf(" user=%.*s name=%.*s secret=<not logged>", w1, a, w2, b);
+            break;
+        case 0x03:
+            a = take_field(buf, len, &off, &w1);
+            b = take_field(buf, len, &off, &w2);
+            printf(" channel=%.*s name=%.*s", w1, a, w2, b);
+            break;
+        case 0x04:
+        case 0xFE:
+            a = take_field(buf, len, &off, &w1);
+            b = take_field(buf, len, &off, &w2);
+            printf(" [%.*s] \"%.*s\"", w1, a, w2, b);
+            break;
+        case 0xFF:
+            a = take_field(buf, len, &off, &w1);
+            printf(" name=%.*s", w1, a);
+            break;
+        default:
+            break;
+    }
+}
+
+static void print_record(const binlog_header_t *h, const binlog_record_t *r) {
+    const uint64_t *args = (const uint64_t *)(r + 1);
+    const uint8_t *blob = (const uint8_t *)(args + r->nargs);
+    unsigned next = 0;
+
+    uint64_t real = h->real0_ns + (r->ts_ns - h->mono0_ns);
+    time_t sec = real / 1000000000ull;
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%H:%M:%S", &tm);
+    printf("%s.%06llu %-5s ", stamp, (unsigned long long)(real % 1000000000ull / 1000),
+           binlog_level_name[binlog_format_level[r->format]]);
+
+    for (const char *p = binlog_format_text[r->format]; *p; p++) {
+        if (*p != '%' || !p[1]) {
+            putchar(*p);
+            continue;
+        }
+        uint64_t v = next < r->nargs ? args[next] : 0;
+        switch (*++p) {
+            case 'u': printf("%llu", (unsigned long long)v); next++; break;
+            case 'x': printf("%llx", (unsigned long long)v); next++; break;
+            case 'a':
+                printf("%u.%u.%u.%u:%u", (unsigned)(v >> 40) & 0xFF, (unsigned)(v >> 32) & 0xFF,
+                       (unsigned)(v >> 24) & 0xFF, (unsigned)(v >> 16) & 0xFF, (unsigned)v & 0xFFFF);
+                next++;
+                break;
+            case 's': printf("%.*s", (int)strnlen((const char *)blob, r->blob_len), blob); break;
+            case 'p': print_packet(blob, r->blob_len); break;
+            default:  putchar('%'); putchar(*p); break;
+        }
+    }
+    putchar('\n');
+}
+
+// A record at this position is plausible and committed
+static bool record_valid(const binlog_record_t *r, uint64_t room) {
+    if (r->sync != BINLOG_SYNC || r->size < sizeof(*r) || r->size > room || (r->size & 7))
+        return false;
+    if (r->format == BINLOG_PAD) return true;
+    return r->format < BINLOG_FORMAT_COUNT &&
+           sizeof(*r) + r->nargs * sizeof(uint64_t) + r->blob_len <= r->size;
+}
+
+int main(int argc, char *argv[]) {
+    int max_level = BINLOG_LEVELS - 1;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            max_level = binlog_parse_level(argv[++i]);
+            if (max_level < 0) {
+                fprintf(stderr, "Unknown level: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "Usage: ipk25chat-logdump [-l <level>] <file>\n");
+            return 1;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "Usage: ipk25chat-logdump [-l <level>] <file>\n");
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(binlog_header_t)) {
+        fprintf(stderr, "%s: not a binary log\n", path);
+        close(fd);
+        return 1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    const binlog_header_t *h = map;
+    if (h->magic != BINLOG_MAGIC || h->version != BINLOG_VERSION ||
+        sizeof(*h) + h->size > (size_t)st.st_size) {
+        fprintf(stderr, "%s: not a binary log\n", path);
+        return 1;
+    }
+    if (h->format_count != BINLOG_FORMAT_COUNT || h->catalogue_hash != binlog_catalogue_hash()) {
+        fprintf(stderr, "%s: written by a client with a different format catalogue\n", path);
+        return 1;
+    }
+
+    const uint8_t *data = (const uint8_t *)(h + 1);
+    uint64_t ring = h->size;
+    uint64_t head = h->head;
+
+    // Without a wrap the records run from 0 to head. After one, the oldest
+    // surviving bytes start at head % ring and the first of them may be the
+    // tail of an overwritten record, so the walk resynchronises on BINLOG_SYNC.
+    uint64_t pos = head > ring ? head % ring : 0;
+    uint64_t left = head > ring ? ring : head;
+    unsigned long skipped = 0;
+
+    while (left >= 8) {
+        uint64_t room = ring - pos;
+        if (room < sizeof(binlog_record_t)) {
+            left -= room < left ? room : left;
+            pos = 0;
+            continue;
+        }
+        const binlog_record_t *r = (const binlog_record_t *)(data + pos);
+        uint64_t size = __atomic_load_n(&r->size, __ATOMIC_ACQUIRE);
+        if (!record_valid(r, room < left ? room : left) || size == 0) {
+            pos += 8;
+            left -= 8;
+            skipped += 8;
+            if (pos == ring) pos = 0;
+            continue;
+        }
+        if (r->format != BINLOG_PAD && binlog_format_level[r->format] <= max_level)
+            print_record(h, r);
+        pos = (pos + size) % ring;
+        left -= size;
+    }
+
+    if (skipped)
+        fprintf(stderr, "%lu bytes skipped while resynchronising\n", skipped);
+    munmap(map, st.st_size);
+    return 0;
+}
@@ -0,0 +1,118 @@
+#define _GNU_SOURCE  // sched_setaffinity, TCP_QUICKACK
+
+#include "lowlat.h"
+#include "binlog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+static int64_t lowlat_clock(clockid_t clk) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int lowlat_init(lowlat_t *ll, int spin_us, int cpu) {
+    memset(ll, 0, sizeof(*ll));
+    ll->enabled = spin_us > 0;
+    ll->spin_us = spin_us > 0 ? spin_us : 0;
+    ll->cpu = -1;
+    if (cpu < 0) return 0;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        perror("sched_setaffinity");
+        return -1;
+    }
+    ll->cpu = cpu;
+    return 0;
+}
+
+void lowlat_socket(const lowlat_t *ll, int fd, bool tcp) {
+    if (!ll->enabled) return;
+    int on = 1;
+    // Raising it above net.core.busy_read needs CAP_NET_ADMIN; spinning in
+    // user space still works without it
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &ll->spin_us, sizeof(ll->spin_us)) != 0)
+        BLOG(LOG_LOWLAT_NO_BUSY_POLL, errno);
+    if (tcp) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+    }
+}
+
+void lowlat_rearm(const lowlat_t *ll, int fd) {
+    if (!ll->enabled) return;
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+}
+
+int lowlat_poll(lowlat_t *ll, struct pollfd *fds, nfds_t nfds, int timeout_ms) {
+    int ready;
+    if (!ll->enabled || timeout_ms == 0) {
+        ready = poll(fds, nfds, timeout_ms);
+        if (ready > 0) ll->wakeups++;
+        return ready;
+    }
+
+    int64_t start = lowlat_clock(CLOCK_MONOTONIC);
+    int64_t spin_end = start + (int64_t)ll->spin_us * 1000;
+    if (timeout_ms > 0 && spin_end > start + (int64_t)timeout_ms * 1000000)
+        spin_end = start + (int64_t)timeout_ms * 1000000;
+    int64_t now;
+    do {
+        ready = poll(fds, nfds, 0);
+        if (ready != 0) {
+            if (ready > 0) {
+                ll->wakeups++;
+                ll->spin_hits++;
+            }
+            return ready;
+        }
+        now = lowlat_clock(CLOCK_MONOTONIC);
+    } while (now < spin_end);
+
+    int left = -1;
+    if (timeout_ms > 0) {
+        int64_t ms = timeout_ms - (now - start) / 1000000;
+        left = ms > 0 ? (int)ms : 0;
+    }
+    ready = poll(fds, nfds, left);
+    if (ready > 0) ll->wakeups++;
+    return ready;
+}
+
+void lowlat_sample(lowlat_t *ll, int64_t stamp_ns) {
+    int64_t ns = lowlat_clock(CLOCK_REALTIME) - stamp_ns;
+    if (stamp_ns <= 0 || ns < 0) return;
+    if (ll->samples == 0 || (uint64_t)ns < ll->min_ns) ll->min_ns = ns;
+    if ((uint64_t)ns > ll->max_ns) ll->max_ns = ns;
+    ll->samples++;
+    ll->sum_ns += ns;
+}
+
+void lowlat_report(const lowlat_t *ll, const char *transport, bool print) {
+    uint64_t avg = ll->samples ? ll->sum_ns / ll->samples : 0;
+    BLOG(LOG_LOWLAT_STATS, ll->enabled, ll->samples, ll->min_ns / 1000, avg / 1000,
+         ll->max_ns / 1000, ll->spin_hits, ll->wakeups);
+    if (!print) return;
+    if (ll->enabled && ll->cpu >= 0)
+        fprintf(stderr, "%s: low-latency mode (spin %d us, cpu %d)", transport, ll->spin_us, ll->cpu);
+    else if (ll->enabled)
+        fprintf(stderr, "%s: low-latency mode (spin %d us)", transport, ll->spin_us);
+    else
+        fprintf(stderr, "%s: default mode", transport);
+    fprintf(stderr, ": socket to handler min/avg/max %.1f/%.1f/%.1f us over %llu reads, "
+                    "%llu of %llu wakeups while spinning\n",
+            ll->min_ns / 1000.0, avg / 1000.0, ll->max_ns / 1000.0,
+            (unsigned long long)ll->samples, (unsigned long long)ll->spin_hits,
+            (unsigned long long)ll->wakeups);
+}
@@ -4,10 +4,14 @@
 #include "client.h"
 #include "tcp.h"
 #include "udp.h"
+#include "trace.h"
+#include "binlog.h"
+#include "shmring.h"
 
 #define DEFAULT_PORT 4567
 #define DEFAULT_UDP_TIMEOUT 250 // ms
 #define DEFAULT_UDP_RETRIES 3
+#define DEFAULT_PACE_BURST 5
 
 void print_usage()
 {
@@ -17,6 +21,31 @@ void print_usage()
     fprintf(stderr, "  -p <port>           Server port (default: 4567)\n");
     fprintf(stderr, "  -d <timeout_ms>     UDP confirmation timeout in ms (default: 250)\n");
     fprintf(stderr, "  -r <retries>        UDP max retries (default: 3)\n");
+    fprintf(stderr, "  -l <prefix>         Write a binary transcript to <prefix>.NNNNNN.seg\n");
+    fprintf(stderr, "  -C <file>           UDP: capture every datagram to <file>\n");
+    fprintf(stderr, "  -R <file>           UDP: replay a capture instead of talking to the server\n");
+    fprintf(stderr, "  -S <speed>          Replay speed factor, 0 = no delays (default: 1)\n");
+    fprintf(stderr, "  -P <msgs_per_sec>   Pace outgoing messages, adapting to retransmissions (default: off)\n");
+    fprintf(stderr, "  -B <burst>          Messages sent back to back when paced (default: 5)\n");
+    fprintf(stderr, "  -T <file>           Write a Chrome/Perfetto latency trace to <file> at exit\n");
+    fprintf(stderr, "  -G <file>           Write a binary log to <file> (read it with ipk25chat-logdump)\n");
+    fprintf(stderr, "  -v <level>          Binary log level: error, warn, info, debug, trace (default: info)\n");
+    fprintf(stderr, "                      SIGUSR1 / SIGUSR2 raise / lower it at runtime\n");
+    fprintf(stderr, "  -X <spin_us>        Low-latency mode: busy polling, spin <spin_us> before sleeping\n");
+    fprintf(stderr, "  -c <cpu>            Pin the client to <cpu>\n");
+    fprintf(stderr, "  -A                  UDP: adapt the CONFIRM timeout to the measured RTT, -d is the cap\n");
+    fprintf(stderr, "  -I                  UDP: print socket statistics (kernel drops, loss, buffers) at exit\n");
+    fprintf(stderr, "  -K <window_ms>      Resume the session (re-AUTH, re-JOIN) after a lost connection,\n");
+    fprintf(stderr, "                      giving up <window_ms> after the loss (default: off)\n");
+    fprintf(stderr, "  -O <name>           Publish received messages to the shared-memory ring <name>\n");
+    fprintf(stderr, "                      (read it with ipk25ring.h) instead of printing MSGs\n");
+    fprintf(stderr, "  -U <username>       Authenticate at startup, without waiting for /auth on stdin\n");
+    fprintf(stderr, "  -W <secret>         Secret for -U (prefer -F, arguments are visible to other users)\n");
+    fprintf(stderr, "  -N <display_name>   Display name for -U (default: the username)\n");
+    fprintf(stderr, "  -j <channel>        Join <channel> after the startup AUTH; repeat it to list\n");
+    fprintf(stderr, "                      fallbacks, tried in order until one accepts\n");
+    fprintf(stderr, "  -F <file>           Read username, secret, display_name and channel lines\n");
+    fprintf(stderr, "                      (\"key = value\") from <file>; later options override it\n");
     fprintf(stderr, "  -h                  Print this help\n");
 }
 
@@ -28,6 +57,10 @@ int main(int argc, char *argv[])
     cfg.port = DEFAULT_PORT;
     cfg.udp_confirm_timeout_ms = DEFAULT_UDP_TIMEOUT;
     cfg.udp_max_retries = DEFAULT_UDP_RETRIES;
+    cfg.replay_speed = 1.0;
+    cfg.pace_burst = DEFAULT_PACE_BURST;
+    cfg.log_level = BINLOG_INFO;
+    cfg.cpu = -1;
 
     // Parse arguments
     for (int i = 1; i < argc; i++) {
@@ -44,6 +77,56 @@ int main(int argc, char *argv[])
             cfg.udp_confirm_timeout_ms = atoi(argv[++i]);
         } else if (strcmp(argv[i], "-r") == 0 && (i+1 < argc)) {
             cfg.udp_max_retries = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && (i+1 < argc)) {
+            strncpy(cfg.transcript, argv[++i], sizeof(cfg.transcript)-1);
+        } else if (strcmp(argv[i], "-C") == 0 && (i+1 < argc)) {
+            strncpy(cfg.capture, argv[++i], sizeof(cfg.capture)-1);
+        } else if (strcmp(argv[i], "-R") == 0 && (i+1 < argc)) {
+            strncpy(cfg.replay, argv[++i], sizeof(cfg.replay)-1);
+        } else if (strcmp(argv[i], "-S") == 0 && (i+1 < argc)) {
+            cfg.replay_speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-P") == 0 && (i+1 < argc)) {
+            cfg.pace_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-B") == 0 && (i+1 < argc)) {
+            cfg.pace_burst = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-T") == 0 && (i+1 < argc)) {
+            strncpy(cfg.trace, argv[++i], sizeof(cfg.trace)-1);
+        } else if (strcmp(argv[i], "-G") == 0 && (i+1 < argc)) {
+            strncpy(cfg.binlog, argv[++i], sizeof(cfg.binlog)-1);
+        } else if (strcmp(argv[i], "-X") == 0 && (i+1 < argc)) {
+            cfg.lowlat_spin_us = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && (i+1 < argc)) {
+            cfg.cpu = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-A") == 0) {
+            cfg.adaptive_rto = 1;
+        } else if (strcmp(argv[i], "-I") == 0) {
+            cfg.print_stats = 1;
+        } else if (strcmp(argv[i], "-K") == 0 && (i+1 < argc)) {
+            cfg.resume_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-O") == 0 && (i+1 < argc)) {
+            strncpy(cfg.ring, argv[++i], sizeof(cfg.ring)-1);
+        } else if (strcmp(argv[i], "-U") == 0 && (i+1 < argc)) {
+            if (client_set_field(cfg.username, sizeof(cfg.username), argv[++i], FIELD_USERNAME) != 0)
+                return 1;
+        } else if (strcmp(argv[i], "-W") == 0 && (i+1 < argc)) {
+            if (client_set_field(cfg.secret, sizeof(cfg.secret), argv[++i], FIELD_SECRET) != 0)
+                return 1;
+        } else if (strcmp(argv[i], "-N") == 0 && (i+1 < argc)) {
+            if (client_set_field(cfg.display_name, sizeof(cfg.display_name), argv[++i],
+                                 FIELD_DISPLAY_NAME) != 0)
+                return 1;
+        } else if (strcmp(argv[i], "-j") == 0 && (i+1 < argc)) {
+            if (client_add_channel(&cfg, argv[++i]) != 0)
+                return 1;
+        } else if (strcmp(argv[i], "-F") == 0 && (i+1 < argc)) {
+            if (client_load_config(&cfg, argv[++i]) != 0)
+                return 1;
+        } else if (strcmp(argv[i], "-v") == 0 && (i+1 < argc)) {
+            cfg.log_level = binlog_parse_level(argv[++i]);
+            if (cfg.log_level < 0) {
+                fprintf(stderr, "Unknown log level: %s\n", argv[i]);
+                return 1;
+            }
         } else {
             fprintf(stderr, "Unknown argument: %s\n", argv[i]);
             return 1;
@@ -55,6 +138,21 @@ int main(int argc, char *argv[])
         fprintf(stderr, "Error: -t and -s are required.\n");
         return 1;
     }
+    if (client_check_login(&cfg) != 0)
+        return 1;
+
+    if (cfg.trace[0] && trace_open(cfg.trace) != 0)
+        return 1;
+    if (cfg.binlog[0]) {
+        if (binlog_open(cfg.binlog, cfg.log_level, BINLOG_DEFAULT_SIZE) != 0)
+            return 1;
+        atexit(binlog_close);
+    }
+    if (cfg.ring[0]) {
+        if (shmring_open(cfg.ring, SHMRING_DEFAULT_SIZE) != 0)
+            return 1;
+        atexit(shmring_close);
+    }
 
     if (strcmp(cfg.transport, "tcp") == 0) {
         return tcp_run(&cfg);
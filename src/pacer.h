@@ -0,0 +1,40 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdbool.h>
+#include <time.h>
+
+// Token bucket limiting how fast outgoing messages are sent. The rate adapts
+// to observed retransmissions (multiplicative decrease, additive increase back
+// to the configured ceiling).
+typedef struct {
+    double ceiling;         // configured rate (messages/s); 0 = pacing off
+    double rate;            // current rate
+    double floor;           // never adapt below this
+    double burst;           // bucket depth (messages)
+    double tokens;
+    struct timespec last;   // last refill
+
+    unsigned long sent;
+    unsigned long retransmits;
+} pacer_t;
+
+// rate <= 0 disables pacing; burst < 1 is treated as 1
+void pacer_init(pacer_t *p, double rate, double burst);
+
+// True when pacing is configured
+bool pacer_enabled(const pacer_t *p);
+
+// Milliseconds until the next message may be sent (0 = now)
+long pacer_delay_ms(pacer_t *p);
+
+// Takes one token for a message that is being sent
+void pacer_consume(pacer_t *p);
+
+// A message was delivered without retransmission
+void pacer_on_delivered(pacer_t *p);
+
+// A message had to be retransmitted (or the kernel retransmitted TCP segments)
+void pacer_on_retransmit(pacer_t *p);
+
+#endif // PACER_H
@@ -0,0 +1,601 @@
+// ipk25chat-proxy: local network impairment proxy. Sits between the client and a
+// server and injects loss, latency, jitter, duplication and reordering so the
+// retransmission and duplicate handling can be measured without a real WAN.
+#define _DEFAULT_SOURCE  // drand48
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "client.h"
+
+#define PROXY_MAX_SESSIONS  64
+#define PROXY_MAX_ENDPOINTS 8
+#define PROXY_MAX_DGRAM     65535
+#define PROXY_MAX_FDS       (1 + PROXY_MAX_SESSIONS * (PROXY_MAX_ENDPOINTS + 1))
+#define PROXY_UDP_IDLE_S    60  // a UDP session without traffic for this long is dropped
+
+// Impairment settings, applied independently in both directions
+typedef struct {
+    double loss;        // probability a datagram is dropped
+    double dup;         // probability a datagram is delivered twice
+    double reorder;     // probability a datagram is held back so later ones overtake it
+    int    delay_ms;    // base one-way latency
+    int    jitter_ms;   // uniform +- variation of the latency
+    int    reorder_ms;  // extra hold time of a reordered datagram
+} impair_t;
+
+// A datagram or stream chunk waiting for its delivery time
+typedef struct {
+    uint64_t due_ns;
+    uint64_t seq;              // keeps FIFO order among equal due times
+    int      fd;               // socket to send from (UDP) or to write to (TCP); -1 = dropped
+    struct sockaddr_in dest;   // UDP destination
+    size_t   len;              // 0 on TCP = close marker
+    uint8_t *data;
+} pending_t;
+
+// Upstream server endpoint and the client-facing socket that represents it.
+// A REPLY from a new server port gets a new local socket, so the client sees
+// the same dynamic port switch it would see without the proxy.
+typedef struct {
+    struct sockaddr_in server;
+    int fd;
+} endpoint_t;
+
+typedef struct {
+    bool used;
+    struct sockaddr_in client;
+    int upstream_fd;                       // our socket towards the server
+    endpoint_t ep[PROXY_MAX_ENDPOINTS];    // ep[0].fd is the shared listening socket
+    int ep_count;
+    uint64_t last_ns;                      // last datagram in either direction
+} udp_session_t;
+
+typedef struct {
+    bool used;
+    int fd[2];             // 0 = client side, 1 = server side
+    uint64_t last_due[2];  // keeps each direction in order despite jitter
+    bool eof[2];           // the side is closed and its close is queued; no longer polled
+} tcp_pair_t;
+
+typedef struct {
+    unsigned long forwarded, dropped, duplicated, reordered;
+    unsigned long long bytes;
+} proxy_stats_t;
+
+static volatile sig_atomic_t terminate_proxy = 0;
+
+static impair_t impair;
+static uint64_t udp_idle_ns = PROXY_UDP_IDLE_S * 1000000000ull;
+static proxy_stats_t stats[2];   // [0] client->server, [1] server->client
+
+static pending_t *heap = NULL;
+static size_t heap_len = 0, heap_cap = 0;
+static uint64_t heap_seq = 0;
+
+static void handle_sigint_proxy(int signo) {
+    (void)signo;
+    terminate_proxy = 1;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool pending_before(const pending_t *a, const pending_t *b) {
+    return a->due_ns < b->due_ns || (a->due_ns == b->due_ns && a->seq < b->seq);
+}
+
+static void heap_push(pending_t item) {
+    if (heap_len == heap_cap) {
+        heap_cap = heap_cap ? heap_cap * 2 : 64;
+        heap = realloc(heap, heap_cap * sizeof(pending_t));
+        if (!heap) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    item.seq = heap_seq++;
+    size_t i = heap_len++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!pending_before(&item, &heap[parent])) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = item;
+}
+
+static pending_t heap_pop(void) {
+    pending_t top = heap[0];
+    pending_t last = heap[--heap_len];
+    size_t i = 0;
+    while (1) {
+        size_t child = 2 * i + 1;
+        if (child >= heap_len) break;
+        if (child + 1 < heap_len && pending_before(&heap[child + 1], &heap[child])) child++;
+        if (!pending_before(&heap[child], &last)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (heap_len > 0) heap[i] = last;
+    return top;
+}
+
+// Forgets everything still queued for a socket that is being closed
+static void heap_forget_fd(int fd) {
+    for (size_t i = 0; i < heap_len; i++) {
+        if (heap[i].fd == fd) heap[i].fd = -1;
+    }
+}
+
+// poll() timeout until 'due_ns', -1 when nothing is due
+static int timeout_until(uint64_t due_ns) {
+    if (due_ns == UINT64_MAX) return -1;
+    uint64_t now = now_ns();
+    return due_ns <= now ? 0 : (int)((due_ns - now) / 1000000) + 1;
+}
+
+static bool chance(double p) {
+    return p > 0 && drand48() < p;
+}
+
+// One-way latency of a datagram: delay +- jitter, never negative
+static uint64_t sample_delay_ns(void) {
+    double ms = impair.delay_ms;
+    if (impair.jitter_ms > 0) ms += (drand48() * 2.0 - 1.0) * impair.jitter_ms;
+    if (ms < 0) ms = 0;
+    return (uint64_t)(ms * 1e6);
+}
+
+static pending_t make_pending(uint64_t due, int fd, const struct sockaddr_in *dest,
+                              const uint8_t *data, size_t len) {
+    pending_t p = { .due_ns = due, .fd = fd, .len = len, .data = NULL };
+    if (dest) p.dest = *dest;
+    if (len) {
+        p.data = malloc(len);
+        if (!p.data) {
+            perror("malloc");
+            exit(1);
+        }
+        memcpy(p.data, data, len);
+    }
+    return p;
+}
+
+// Applies loss, delay, jitter, reordering and duplication to one datagram
+static void schedule_datagram(int dir, int fd, const struct sockaddr_in *dest,
+                              const uint8_t *data, size_t len) {
+    if (chance(impair.loss)) {
+        stats[dir].dropped++;
+        return;
+    }
+    uint64_t due = now_ns() + sample_delay_ns();
+    if (chance(impair.reorder)) {
+        due += (uint64_t)impair.reorder_ms * 1000000ull;
+        stats[dir].reordered++;
+    }
+    heap_push(make_pending(due, fd, dest, data, len));
+
+    if (chance(impair.dup)) {
+        stats[dir].duplicated++;
+        heap_push(make_pending(now_ns() + sample_delay_ns(), fd, dest, data, len));
+    }
+}
+
+// --- UDP ---------------------------------------------------------------
+
+static udp_session_t sessions[PROXY_MAX_SESSIONS];
+
+static int udp_socket_bound(uint32_t addr, uint16_t port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    struct sockaddr_in local = { .sin_family = AF_INET, .sin_port = htons(port) };
+    local.sin_addr.s_addr = addr;
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) != 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool same_addr(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+static udp_session_t *udp_session_for_client(const struct sockaddr_in *client, int listen_fd,
+                                             const struct sockaddr_in *server) {
+    udp_session_t *free_slot = NULL;
+    for (int i = 0; i < PROXY_MAX_SESSIONS; i++) {
+        if (sessions[i].used && same_addr(&sessions[i].client, client)) return &sessions[i];
+        if (!sessions[i].used && !free_slot) free_slot = &sessions[i];
+    }
+    if (!free_slot) return NULL;
+
+    int up = udp_socket_bound(htonl(INADDR_ANY), 0);
+    if (up < 0) return NULL;
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->used = true;
+    free_slot->client = *client;
+    free_slot->upstream_fd = up;
+    free_slot->ep[0].server = *server;
+    free_slot->ep[0].fd = listen_fd;
+    free_slot->ep_count = 1;
+    fprintf(stderr, "proxy: new UDP session from %s:%u\n",
+            inet_ntoa(client->sin_addr), ntohs(client->sin_port));
+    return free_slot;
+}
+
+// UDP has no close: a session is dropped once it has been quiet for udp_idle_ns,
+// so its slot and sockets are free for new clients
+static void udp_session_close(udp_session_t *s) {
+    heap_forget_fd(s->upstream_fd);
+    close(s->upstream_fd);
+    for (int e = 1; e < s->ep_count; e++) {
+        heap_forget_fd(s->ep[e].fd);
+        close(s->ep[e].fd);
+    }
+    s->used = false;
+}
+
+// Drops the idle sessions and returns when the next one falls idle (UINT64_MAX: none)
+static uint64_t udp_expire_sessions(void) {
+    uint64_t now = now_ns(), next = UINT64_MAX;
+    for (int i = 0; i < PROXY_MAX_SESSIONS; i++) {
+        udp_session_t *s = &sessions[i];
+        if (!s->used) continue;
+        uint64_t expires = s->last_ns + udp_idle_ns;
+        if (expires <= now) {
+            fprintf(stderr, "proxy: UDP session from %s:%u expired\n",
+                    inet_ntoa(s->client.sin_addr), ntohs(s->client.sin_port));
+            udp_session_close(s);
+        } else if (expires < next) {
+            next = expires;
+        }
+    }
+    return next;
+}
+
+// Client-facing endpoint for a server address; new server ports get a new local socket
+static endpoint_t *udp_endpoint_for_server(udp_session_t *s, const struct sockaddr_in *server,
+                                           uint32_t local_addr) {
+    for (int i = 0; i < s->ep_count; i++) {
+        if (same_addr(&s->ep[i].server, server)) return &s->ep[i];
+    }
+    if (s->ep_count == PROXY_MAX_ENDPOINTS) return NULL;
+
+    int fd = udp_socket_bound(local_addr, 0);
+    if (fd < 0) return NULL;
+    endpoint_t *ep = &s->ep[s->ep_count++];
+    ep->server = *server;
+    ep->fd = fd;
+
+    struct sockaddr_in bound;
+    socklen_t blen = sizeof(bound);
+    getsockname(fd, (struct sockaddr *)&bound, &blen);
+    fprintf(stderr, "proxy: server port %u mapped to local port %u\n",
+            ntohs(server->sin_port), ntohs(bound.sin_port));
+    return ep;
+}
+
+static int udp_proxy(int listen_port, const struct sockaddr_in *server) {
+    uint32_t local_addr = htonl(INADDR_LOOPBACK);
+    int listen_fd = udp_socket_bound(local_addr, listen_port);
+    if (listen_fd < 0) return 1;
+
+    static uint8_t buf[PROXY_MAX_DGRAM];
+    struct pollfd pfds[PROXY_MAX_FDS];
+    // For every polled fd: owning session (-1 = listening socket) and endpoint (-1 = upstream)
+    int owner[PROXY_MAX_FDS], endpoint[PROXY_MAX_FDS];
+
+    while (!terminate_proxy) {
+        uint64_t wake = udp_expire_sessions();
+        int n = 0;
+        pfds[n] = (struct pollfd){ .fd = listen_fd, .events = POLLIN };
+        owner[n] = -1;
+        endpoint[n++] = 0;
+        for (int i = 0; i < PROXY_MAX_SESSIONS; i++) {
+            if (!sessions[i].used) continue;
+            pfds[n] = (struct pollfd){ .fd = sessions[i].upstream_fd, .events = POLLIN };
+            owner[n] = i;
+            endpoint[n++] = -1;
+            for (int e = 1; e < sessions[i].ep_count; e++) {
+                pfds[n] = (struct pollfd){ .fd = sessions[i].ep[e].fd, .events = POLLIN };
+                owner[n] = i;
+                endpoint[n++] = e;
+            }
+        }
+
+        if (heap_len > 0 && heap[0].due_ns < wake) wake = heap[0].due_ns;
+        if (poll(pfds, n, timeout_until(wake)) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (!(pfds[i].revents & POLLIN)) continue;
+
+            struct sockaddr_in from;
+            socklen_t flen = sizeof(from);
+            ssize_t len = recvfrom(pfds[i].fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &flen);
+            if (len < 0) continue;
+
+            if (endpoint[i] >= 0) {
+                // Client -> server, through the endpoint the datagram arrived on
+                udp_session_t *s = owner[i] < 0
+                    ? udp_session_for_client(&from, listen_fd, server)
+                    : &sessions[owner[i]];
+                if (!s) continue;
+                s->last_ns = now_ns();
+                stats[0].forwarded++;
+                stats[0].bytes += len;
+                schedule_datagram(0, s->upstream_fd, &s->ep[endpoint[i]].server, buf, len);
+            } else {
+                // Server -> client, from the local socket standing in for the server port
+                udp_session_t *s = &sessions[owner[i]];
+                endpoint_t *ep = udp_endpoint_for_server(s, &from, local_addr);
+                if (!ep) continue;
+                s->last_ns = now_ns();
+                stats[1].forwarded++;
+                stats[1].bytes += len;
+                schedule_datagram(1, ep->fd, &s->client, buf, len);
+            }
+        }
+
+        uint64_t now = now_ns();
+        while (heap_len > 0 && heap[0].due_ns <= now) {
+            pending_t p = heap_pop();
+            if (p.fd >= 0)
+                sendto(p.fd, p.data, p.len, 0, (struct sockaddr *)&p.dest, sizeof(p.dest));
+            free(p.data);
+        }
+    }
+
+    for (int i = 0; i < PROXY_MAX_SESSIONS; i++) {
+        if (sessions[i].used) udp_session_close(&sessions[i]);
+    }
+    close(listen_fd);
+    return 0;
+}
+
+// --- TCP ---------------------------------------------------------------
+
+static tcp_pair_t pairs[PROXY_MAX_SESSIONS];
+
+static void tcp_pair_close(tcp_pair_t *p) {
+    for (int side = 0; side < 2; side++) {
+        heap_forget_fd(p->fd[side]);
+        close(p->fd[side]);
+    }
+    p->used = false;
+}
+
+// Streams are reliable: only latency and jitter apply, and order is kept per direction
+static void schedule_chunk(tcp_pair_t *p, int dir, const uint8_t *data, size_t len) {
+    uint64_t due = now_ns() + sample_delay_ns();
+    if (due < p->last_due[dir]) due = p->last_due[dir];
+    p->last_due[dir] = due;
+    heap_push(make_pending(due, p->fd[dir == 0 ? 1 : 0], NULL, data, len));
+    if (len) {
+        stats[dir].forwarded++;
+        stats[dir].bytes += len;
+    }
+}
+
+static int tcp_proxy(int listen_port, const struct sockaddr_in *server) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in local = { .sin_family = AF_INET, .sin_port = htons(listen_port) };
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (struct sockaddr *)&local, sizeof(local)) != 0 || listen(listen_fd, 16) != 0) {
+        perror("bind/listen");
+        close(listen_fd);
+        return 1;
+    }
+
+    static uint8_t buf[PROXY_MAX_DGRAM];
+    struct pollfd pfds[1 + 2 * PROXY_MAX_SESSIONS];
+    int pair_of[1 + 2 * PROXY_MAX_SESSIONS], side_of[1 + 2 * PROXY_MAX_SESSIONS];
+
+    while (!terminate_proxy) {
+        int n = 0;
+        pfds[n++] = (struct pollfd){ .fd = listen_fd, .events = POLLIN };
+        for (int i = 0; i < PROXY_MAX_SESSIONS; i++) {
+            if (!pairs[i].used) continue;
+            for (int side = 0; side < 2; side++) {
+                if (pairs[i].eof[side]) continue;  // would report POLLHUP forever
+                pfds[n] = (struct pollfd){ .fd = pairs[i].fd[side], .events = POLLIN };
+                pair_of[n] = i;
+                side_of[n++] = side;
+            }
+        }
+
+        if (poll(pfds, n, timeout_until(heap_len > 0 ? heap[0].due_ns : UINT64_MAX)) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int cfd = accept(listen_fd, NULL, NULL);
+            tcp_pair_t *p = NULL;
+            for (int i = 0; i < PROXY_MAX_SESSIONS && cfd >= 0; i++) {
+                if (!pairs[i].used) { p = &pairs[i]; break; }
+            }
+            int sfd = p ? socket(AF_INET, SOCK_STREAM, 0) : -1;
+            if (sfd >= 0 && connect(sfd, (const struct sockaddr *)server, sizeof(*server)) == 0) {
+                memset(p, 0, sizeof(*p));
+                p->used = true;
+                p->fd[0] = cfd;
+                p->fd[1] = sfd;
+                fprintf(stderr, "proxy: new TCP connection\n");
+            } else {
+                if (sfd >= 0) close(sfd);
+                if (cfd >= 0) close(cfd);
+            }
+        }
+
+        for (int i = 1; i < n; i++) {
+            if (!(pfds[i].revents & (POLLIN | POLLHUP))) continue;
+            tcp_pair_t *p = &pairs[pair_of[i]];
+            if (!p->used) continue;
+            int side = side_of[i];
+            ssize_t len = recv(p->fd[side], buf, sizeof(buf), 0);
+            if (len < 0 && errno == EINTR) continue;
+            // A close travels through the queue too, after the data sent before it
+            if (len <= 0) p->eof[side] = true;
+            schedule_chunk(p, side, buf, len > 0 ? (size_t)len : 0);
+        }
+
+        uint64_t now = now_ns();
+        while (heap_len > 0 && heap[0].due_ns <= now) {
+            pending_t item = heap_pop();
+            if (item.fd >= 0) {
+                if (item.len == 0) {
+                    for (int i = 0; i < PROXY_MAX_SESSIONS; i++) {
+                        if (pairs[i].used && (pairs[i].fd[0] == item.fd || pairs[i].fd[1] == item.fd)) {
+                            tcp_pair_close(&pairs[i]);
+                            break;
+                        }
+                    }
+                } else {
+                    send(item.fd, item.data, item.len, MSG_NOSIGNAL);
+                }
+            }
+            free(item.data);
+        }
+    }
+
+    for (int i = 0; i < PROXY_MAX_SESSIONS; i++) {
+        if (pairs[i].used) tcp_pair_close(&pairs[i]);
+    }
+    close(listen_fd);
+    return 0;
+}
+
+// -----------------------------------------------------------------------
+
+static void print_usage(void) {
+    fprintf(stderr, "Usage: ipk25chat-proxy [OPTIONS]\n");
+    fprintf(stderr, "  -t <tcp|udp>        Transport protocol (required)\n");
+    fprintf(stderr, "  -s <server>         Upstream server IP or hostname (required)\n");
+    fprintf(stderr, "  -p <port>           Upstream server port (default: 4567)\n");
+    fprintf(stderr, "  -l <port>           Local port the client connects to (default: 4568)\n");
+    fprintf(stderr, "  -L <percent>        UDP loss probability (default: 0)\n");
+    fprintf(stderr, "  -U <percent>        UDP duplication probability (default: 0)\n");
+    fprintf(stderr, "  -O <percent>        UDP reordering probability (default: 0)\n");
+    fprintf(stderr, "  -D <ms>             One-way delay (default: 0)\n");
+    fprintf(stderr, "  -J <ms>             Jitter, +- around the delay (default: 0)\n");
+    fprintf(stderr, "  -H <ms>             Extra hold time of reordered datagrams (default: 50)\n");
+    fprintf(stderr, "  -I <s>              Drop a UDP session idle for this long (default: %d)\n", PROXY_UDP_IDLE_S);
+    fprintf(stderr, "  -x <seed>           Random seed (default: time based)\n");
+    fprintf(stderr, "  -h                  Print this help\n");
+}
+
+static void print_stats(void) {
+    const char *names[2] = { "client->server", "server->client" };
+    for (int d = 0; d < 2; d++) {
+        fprintf(stderr, "proxy: %s: %lu forwarded (%llu bytes), %lu dropped, %lu duplicated, %lu reordered\n",
+                names[d], stats[d].forwarded, stats[d].bytes, stats[d].dropped,
+                stats[d].duplicated, stats[d].reordered);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    char transport[8] = "";
+    char server_host[256] = "";
+    int server_port = 4567, listen_port = 4568;
+    long seed = (long)time(NULL) ^ getpid();
+
+    impair.reorder_ms = 50;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0) {
+            print_usage();
+            return 0;
+        } else if (strcmp(argv[i], "-t") == 0 && (i+1 < argc)) {
+            strncpy(transport, argv[++i], sizeof(transport)-1);
+        } else if (strcmp(argv[i], "-s") == 0 && (i+1 < argc)) {
+            strncpy(server_host, argv[++i], sizeof(server_host)-1);
+        } else if (strcmp(argv[i], "-p") == 0 && (i+1 < argc)) {
+            server_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && (i+1 < argc)) {
+            listen_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-L") == 0 && (i+1 < argc)) {
+            impair.loss = atof(argv[++i]) / 100.0;
+        } else if (strcmp(argv[i], "-U") == 0 && (i+1 < argc)) {
+            impair.dup = atof(argv[++i]) / 100.0;
+        } else if (strcmp(argv[i], "-O") == 0 && (i+1 < argc)) {
+            impair.reorder = atof(argv[++i]) / 100.0;
+        } else if (strcmp(argv[i], "-D") == 0 && (i+1 < argc)) {
+            impair.delay_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-J") == 0 && (i+1 < argc)) {
+            impair.jitter_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-H") == 0 && (i+1 < argc)) {
+            impair.reorder_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-I") == 0 && (i+1 < argc)) {
+            long idle = atol(argv[++i]);
+            if (idle <= 0) {
+                fprintf(stderr, "Error: -I needs a positive number of seconds.\n");
+                return 1;
+            }
+            udp_idle_ns = (uint64_t)idle * 1000000000ull;
+        } else if (strcmp(argv[i], "-x") == 0 && (i+1 < argc)) {
+            seed = atol(argv[++i]);
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (strlen(transport) == 0 || strlen(server_host) == 0) {
+        fprintf(stderr, "Error: -t and -s are required.\n");
+        return 1;
+    }
+
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    if (resolve_server_address(server_host, server_port, &server) != 0) return 1;
+
+    srand48(seed);
+    signal(SIGINT, handle_sigint_proxy);
+    signal(SIGTERM, handle_sigint_proxy);
+
+    int rc;
+    if (strcmp(transport, "udp") == 0) {
+        rc = udp_proxy(listen_port, &server);
+    } else if (strcmp(transport, "tcp") == 0) {
+        rc = tcp_proxy(listen_port, &server);
+    } else {
+        fprintf(stderr, "Unsupported transport: %s\n", transport);
+        return 1;
+    }
+
+    print_stats();
+    while (heap_len > 0) free(heap_pop().data);
+    free(heap);
+    return rc;
+}
@@ -0,0 +1,80 @@
+#include "resume.h"
+#include "binlog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int64_t resume_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// xorshift32; the jitter only has to differ between clients
+static uint32_t resume_random(resume_t *r) {
+    uint32_t x = r->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return r->rng = x;
+}
+
+void resume_init(resume_t *r, int window_ms) {
+    memset(r, 0, sizeof(*r));
+    r->window_ms = window_ms > 0 ? window_ms : 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    r->rng = (uint32_t)ts.tv_nsec ^ ((uint32_t)getpid() << 16) ^ 0x9E3779B9u;
+    if (r->rng == 0) r->rng = 1;
+}
+
+bool resume_lost(resume_t *r) {
+    if (r->window_ms == 0) return false;
+    int64_t now = resume_now_ms();
+    if (r->phase == RESUME_IDLE) {
+        r->lost_at = now;
+        r->attempts = 0;
+        fprintf(stderr, "Connection lost, resuming the session...\n");
+    } else {
+        r->attempts++;
+    }
+    if (now - r->lost_at >= r->window_ms) {
+        BLOG(LOG_RESUME_GAVE_UP, r->attempts, now - r->lost_at);
+        r->phase = RESUME_IDLE;
+        return false;
+    }
+
+    // Full jitter over the upper half of an exponential step
+    int64_t delay = 0;
+    if (r->attempts > 0) {
+        int shift = r->attempts - 1 < 10 ? r->attempts - 1 : 10;
+        int64_t step = (int64_t)RESUME_BACKOFF_MS << shift;
+        if (step > RESUME_BACKOFF_MAX_MS) step = RESUME_BACKOFF_MAX_MS;
+        delay = step / 2 + resume_random(r) % (step / 2 + 1);
+    }
+    r->retry_at = now + delay;
+    r->phase = RESUME_WAIT;
+    BLOG(LOG_RESUME_SCHEDULED, r->attempts + 1, delay);
+    return true;
+}
+
+int resume_timeout(const resume_t *r) {
+    if (r->phase != RESUME_WAIT) return -1;
+    int64_t left = r->retry_at - resume_now_ms();
+    return left > 0 ? (int)left : 0;
+}
+
+bool resume_due(resume_t *r) {
+    if (r->phase != RESUME_WAIT || resume_now_ms() < r->retry_at) return false;
+    r->phase = RESUME_AUTH;
+    return true;
+}
+
+void resume_done(resume_t *r) {
+    int64_t ms = resume_now_ms() - r->lost_at;
+    BLOG(LOG_RESUME_DONE, ms, r->attempts + 1);
+    fprintf(stderr, "Session resumed after %lld ms.\n", (long long)ms);
+    r->phase = RESUME_IDLE;
+}
@@ -0,0 +1,53 @@
+#ifndef RESUME_H
+#define RESUME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Session resume (-K). When the connection is lost after AUTH, the client
+// keeps its identity, reconnects and replays AUTH and the JOIN of its channel
+// instead of ending. User messages wait meanwhile and go out once the session
+// is back. The first attempt is made at once, so a restarted server costs one
+// round trip; failed attempts back off exponentially with jitter, so clients
+// that lost the same server do not come back in lockstep. The transports own
+// the connection; this tracks the phases and the timing.
+
+#define RESUME_BACKOFF_MS     25    // delay before the second attempt
+#define RESUME_BACKOFF_MAX_MS 2000
+
+typedef enum {
+    RESUME_IDLE,            // connected, or resuming is off
+    RESUME_WAIT,            // lost, next attempt at retry_at
+    RESUME_AUTH,            // AUTH replayed, waiting for its REPLY
+    RESUME_JOIN             // JOIN replayed, waiting for its REPLY
+} resume_phase_e;
+
+typedef struct {
+    int window_ms;          // give up this long after the loss, 0 = off
+    resume_phase_e phase;
+    int attempts;           // failed attempts since the loss
+    int64_t lost_at;        // monotonic ms
+    int64_t retry_at;
+    uint32_t rng;           // jitter
+} resume_t;
+
+void resume_init(resume_t *r, int window_ms);
+
+// The connection was lost or an attempt failed. Schedules the next attempt;
+// false when resuming is off or the window has run out.
+bool resume_lost(resume_t *r);
+
+// Milliseconds until the next attempt, -1 when none is scheduled
+int resume_timeout(const resume_t *r);
+
+// True when an attempt is due; the caller reconnects and replays AUTH
+bool resume_due(resume_t *r);
+
+// The session is back (AUTH and JOIN answered)
+void resume_done(resume_t *r);
+
+static inline bool resume_active(const resume_t *r) {
+    return r->phase != RESUME_IDLE;
+}
+
+#endif // RESUME_H
@@ -0,0 +1,75 @@
+// ipk25chat-ringdump: follows a message ring published with -O
+//
+// Usage: ipk25chat-ringdump [-a] <name>
+//   -a  start with the oldest record still in the ring instead of the next one
+
+#include "ipk25ring.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *type_name(uint8_t type) {
+    switch (type) {
+        case IPK_RING_REPLY: return "REPLY";
+        case IPK_RING_MSG:   return "MSG";
+        case IPK_RING_ERR:   return "ERR";
+        case IPK_RING_BYE:   return "BYE";
+        default:             return "UNKNOWN";
+    }
+}
+
+static void print_record(const ipk_ring_msg_t *m) {
+    time_t sec = m->ts_ns / 1000000000;
+    struct tm tm;
+    char when[16];
+    strftime(when, sizeof(when), "%H:%M:%S", localtime_r(&sec, &tm));
+    printf("%s.%06ld #%" PRIu64 " %s %s", when, (long)(m->ts_ns % 1000000000 / 1000),
+           m->seq, m->transport == IPK_RING_UDP ? "udp" : "tcp", type_name(m->type));
+    if (m->type == IPK_RING_REPLY) printf(" %s", m->flags & IPK_RING_F_OK ? "OK" : "NOK");
+    if (m->channel_len) printf(" [%.*s]", (int)m->channel_len, m->channel);
+    if (m->sender_len) printf(" %.*s:", (int)m->sender_len, m->sender);
+    printf(" %.*s\n", (int)m->content_len, m->content);
+}
+
+int main(int argc, char **argv) {
+    bool from_oldest = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "a")) != -1) {
+        if (opt != 'a') {
+            fprintf(stderr, "Usage: %s [-a] <name>\n", argv[0]);
+            return 1;
+        }
+        from_oldest = true;
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-a] <name>\n", argv[0]);
+        return 1;
+    }
+
+    ipk_ring_t *r = ipk_ring_open(argv[optind], from_oldest);
+    if (!r) {
+        fprintf(stderr, "Cannot open ring %s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    ipk_ring_msg_t m;
+    int rc;
+    while ((rc = ipk_ring_next(r, &m)) >= 0) {
+        if (rc == 0) {
+            fflush(stdout);
+            ipk_ring_wait(r, -1);
+            continue;
+        }
+        print_record(&m);
+        // Printing is slow next to the writer; a lapped record is not trusted
+        if (!ipk_ring_valid(r, &m)) printf("(record #%" PRIu64 " overwritten while printing)\n", m.seq);
+    }
+    fprintf(stderr, "Writer finished, %" PRIu64 " records lost\n", ipk_ring_lost(r));
+    ipk_ring_close(r);
+    return 0;
+}
@@ -0,0 +1,250 @@
+#include "schema.h"
+
+#include <arpa/inet.h>
+
+// Each message's codecs are its field list unrolled: field offsets within a
+// datagram are constants and no per-field switch runs. Only the entry points
+// dispatch, once per message.
+
+// --- UDP ---
+
+static inline bool udp_get_flag(const uint8_t *buf, size_t len, size_t *off, uint8_t *v) {
+    if (*off >= len || buf[*off] > 1) return false;
+    *v = buf[(*off)++];
+    return true;
+}
+
+static inline bool udp_get_id(const uint8_t *buf, size_t len, size_t *off, uint16_t *v) {
+    if (len - *off < sizeof(uint16_t)) return false;
+    uint16_t n;
+    memcpy(&n, &buf[*off], sizeof(uint16_t));
+    *v = ntohs(n);
+    *off += sizeof(uint16_t);
+    return true;
+}
+
+// A NUL-terminated field of the given character class
+static inline bool udp_get_str(const uint8_t *buf, size_t len, size_t *off, ipk_text_t *v,
+                               field_class_e cls) {
+    const char *s = (const char *)&buf[*off];
+    size_t n = strnlen(s, len - *off);
+    if (*off + n == len || !validate_field(cls, s, n)) return false;
+    *v = (ipk_text_t){ s, n };
+    *off += n + 1;
+    return true;
+}
+
+static inline size_t udp_put_flag(uint8_t *out, size_t off, uint8_t v) {
+    out[off] = v;
+    return off + 1;
+}
+
+static inline size_t udp_put_id(uint8_t *out, size_t off, uint16_t v) {
+    uint16_t n = htons(v);
+    memcpy(&out[off], &n, sizeof(uint16_t));
+    return off + sizeof(uint16_t);
+}
+
+static inline size_t udp_put_str(uint8_t *out, size_t off, ipk_text_t v) {
+    if (v.len) memcpy(&out[off], v.ptr, v.len);
+    out[off + v.len] = '\0';
+    return off + v.len + 1;
+}
+
+#define UDP_GET_flag(f) ok = ok && udp_get_flag(buf, len, &off, &m->f);
+#define UDP_GET_id(f)   ok = ok && udp_get_id(buf, len, &off, &m->f);
+#define UDP_GET_word(f) ok = ok && udp_get_str(buf, len, &off, &m->f, IPK_CLASS_##f);
+#define UDP_GET_text(f) UDP_GET_word(f)
+#define UDP_GET(f, keyword) IPK_PASTE(UDP_GET_, IPK_KIND_##f)(f)
+
+#define UDP_PUT_flag(f) off = udp_put_flag(out, off, m->f);
+#define UDP_PUT_id(f)   off = udp_put_id(out, off, m->f);
+#define UDP_PUT_word(f) off = udp_put_str(out, off, m->f);
+#define UDP_PUT_text(f) UDP_PUT_word(f)
+#define UDP_PUT(f, keyword) IPK_PASTE(UDP_PUT_, IPK_KIND_##f)(f)
+
+#define UDP_SIZE_flag(f) + 1
+#define UDP_SIZE_id(f)   + sizeof(uint16_t)
+#define UDP_SIZE_word(f) + m->f.len + 1
+#define UDP_SIZE_text(f) UDP_SIZE_word(f)
+#define UDP_SIZE(f, keyword) IPK_PASTE(UDP_SIZE_, IPK_KIND_##f)(f)
+
+#define UDP_DEFINE(name, code, keyword) \
+    size_t ipk_udp_size_##name(const ipk_msg_t *m) { \
+        (void)m; \
+        return IPK_UDP_HEADER IPK_FIELDS_##name(UDP_SIZE); \
+    } \
+    size_t ipk_udp_encode_##name(const ipk_msg_t *m, uint8_t *out) { \
+        out[0] = code; \
+        size_t off = udp_put_id(out, 1, m->id); \
+        IPK_FIELDS_##name(UDP_PUT) \
+        return off; \
+    } \
+    bool ipk_udp_decode_##name(const uint8_t *buf, size_t len, ipk_msg_t *m) { \
+        *m = (ipk_msg_t){ .type = code }; \
+        size_t off = 1; \
+        bool ok = len >= IPK_UDP_HEADER && buf[0] == code && udp_get_id(buf, len, &off, &m->id); \
+        IPK_FIELDS_##name(UDP_GET) \
+        return ok && off == len; \
+    }
+IPK_MESSAGES(UDP_DEFINE)
+
+size_t ipk_udp_size(const ipk_msg_t *m) {
+    switch (m->type) {
+#define UDP_SIZE_CASE(name, code, keyword) case code: return ipk_udp_size_##name(m);
+        IPK_MESSAGES(UDP_SIZE_CASE)
+    }
+    return 0;
+}
+
+size_t ipk_udp_encode(const ipk_msg_t *m, uint8_t *out) {
+    switch (m->type) {
+#define UDP_ENCODE_CASE(name, code, keyword) case code: return ipk_udp_encode_##name(m, out);
+        IPK_MESSAGES(UDP_ENCODE_CASE)
+    }
+    return 0;
+}
+
+bool ipk_udp_decode(const uint8_t *buf, size_t len, ipk_msg_t *m) {
+    if (len < IPK_UDP_HEADER) return false;
+    switch (buf[0]) {
+#define UDP_DECODE_CASE(name, code, keyword) case code: return ipk_udp_decode_##name(buf, len, m);
+        IPK_MESSAGES(UDP_DECODE_CASE)
+    }
+    return false;
+}
+
+// --- TCP ---
+
+// Case-insensitive match of a token against an upper-case protocol keyword
+static bool tcp_keyword_eq(const char *tok, size_t len, const char *kw) {
+    if (!kw) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (kw[i] == '\0' || (tok[i] & ~0x20) != kw[i]) return false;
+    }
+    return kw[len] == '\0';
+}
+
+// Takes the next word starting at *p and leaves *p on the delimiter (' ' or '\0')
+static const char *tcp_take_word(const char **p, size_t *len) {
+    const char *start = *p;
+    const char *s = start;
+    while (*s && *s != ' ') s++;
+    *len = s - start;
+    *p = s;
+    return start;
+}
+
+// Consumes exactly one separating space
+static bool tcp_take_sp(const char **p) {
+    if (**p != ' ') return false;
+    (*p)++;
+    return true;
+}
+
+// Consumes the separator in front of a field: " " or " <KEYWORD> "
+static inline bool tcp_get_sep(const char **p, const char *keyword) {
+    if (!keyword[0]) return tcp_take_sp(p);
+    size_t len;
+    if (!tcp_take_sp(p)) return false;
+    const char *w = tcp_take_word(p, &len);
+    return tcp_keyword_eq(w, len, keyword) && tcp_take_sp(p);
+}
+
+static inline bool tcp_get_flag(const char **p, uint8_t *v) {
+    size_t len;
+    const char *w = tcp_take_word(p, &len);
+    if (tcp_keyword_eq(w, len, "OK")) *v = 1;
+    else if (tcp_keyword_eq(w, len, "NOK")) *v = 0;
+    else return false;
+    return true;
+}
+
+// A word checked against the character class and length of its field
+static inline bool tcp_get_word(const char **p, ipk_text_t *v, field_class_e cls) {
+    size_t len;
+    const char *w = tcp_take_word(p, &len);
+    if (!validate_field(cls, w, len)) return false;
+    *v = (ipk_text_t){ w, len };
+    return true;
+}
+
+// The rest of the line (0x20-0x7E and LF)
+static inline bool tcp_get_text(const char **p, ipk_text_t *v) {
+    const char *s = *p;
+    size_t len = 0;
+    for (; s[len]; len++) {
+        if (!validate_char(FIELD_CONTENT, s[len]) || len >= IPK_MAX_CONTENT_LEN) return false;
+    }
+    if (len == 0) return false;
+    *v = (ipk_text_t){ s, len };
+    *p = s + len;
+    return true;
+}
+
+static inline bool tcp_put_sep(buffer_t *out, const char *keyword) {
+    if (!keyword[0]) return buffer_append(out, " ", 1);
+    return buffer_append(out, " ", 1) && buffer_append_str(out, keyword) &&
+           buffer_append(out, " ", 1);
+}
+
+#define TCP_GET_flag(f, keyword) ok = ok && tcp_get_sep(&p, keyword) && tcp_get_flag(&p, &m->f);
+#define TCP_GET_id(f, keyword)
+#define TCP_GET_word(f, keyword) \
+    ok = ok && tcp_get_sep(&p, keyword) && tcp_get_word(&p, &m->f, IPK_CLASS_##f);
+#define TCP_GET_text(f, keyword) ok = ok && tcp_get_sep(&p, keyword) && tcp_get_text(&p, &m->f);
+#define TCP_GET(f, keyword) IPK_PASTE(TCP_GET_, IPK_KIND_##f)(f, keyword)
+
+#define TCP_PUT_flag(f, keyword) \
+    ok = ok && tcp_put_sep(out, keyword) && buffer_append_str(out, m->f ? "OK" : "NOK");
+#define TCP_PUT_id(f, keyword)
+#define TCP_PUT_word(f, keyword) \
+    ok = ok && tcp_put_sep(out, keyword) && buffer_append(out, m->f.ptr, m->f.len);
+#define TCP_PUT_text(f, keyword) TCP_PUT_word(f, keyword)
+#define TCP_PUT(f, keyword) IPK_PASTE(TCP_PUT_, IPK_KIND_##f)(f, keyword)
+
+// UDP-only messages get codecs that always fail; nothing dispatches to them
+#define TCP_DEFINE(name, code, keyword) \
+    bool ipk_tcp_encode_##name(const ipk_msg_t *m, buffer_t *out) { \
+        (void)m; \
+        const char *kw = keyword; \
+        bool ok = kw && buffer_append_str(out, kw); \
+        IPK_FIELDS_##name(TCP_PUT) \
+        return ok && buffer_append(out, "\r\n", 2); \
+    } \
+    bool ipk_tcp_decode_##name(const char *p, ipk_msg_t *m) { \
+        *m = (ipk_msg_t){ .type = code }; \
+        const char *kw = keyword; \
+        bool ok = kw != NULL; \
+        IPK_FIELDS_##name(TCP_GET) \
+        return ok && *p == '\0'; \
+    }
+IPK_MESSAGES(TCP_DEFINE)
+
+bool ipk_tcp_encode(const ipk_msg_t *m, buffer_t *out) {
+    switch (m->type) {
+#define TCP_ENCODE_CASE(name, code, keyword) case code: return ipk_tcp_encode_##name(m, out);
+        IPK_MESSAGES(TCP_ENCODE_CASE)
+    }
+    return false;
+}
+
+// Dispatch key of a keyword: its upper-case first letter and its length.
+// Messages without a keyword get keys above any a word can produce.
+#define TCP_KEY(lead, len) ((unsigned)(lead) << 8 | (unsigned)(len))
+#define TCP_DECODE_KEY(name, code, keyword) \
+    (IPK_LEAD_##name ? TCP_KEY(IPK_LEAD_##name, sizeof(keyword) - 1) : 0x10000u | code)
+
+bool ipk_tcp_decode(const char *line, ipk_msg_t *m) {
+    const char *p = line;
+    size_t len;
+    const char *w = tcp_take_word(&p, &len);
+    if (len == 0 || len > 0xFF) return false;
+    switch (TCP_KEY((unsigned char)(w[0] & ~0x20), len)) {
+#define TCP_DECODE_CASE(name, code, keyword) \
+        case TCP_DECODE_KEY(name, code, keyword): \
+            return tcp_keyword_eq(w, len, keyword) && ipk_tcp_decode_##name(p, m);
+        IPK_MESSAGES(TCP_DECODE_CASE)
+    }
+    return false;
+}
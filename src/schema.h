@@ -0,0 +1,124 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "validate.h"
+
+// The IPK25-CHAT messages, described once. schema.c expands these tables into
+// an encoder and a validating, non-copying decoder per message and wire
+// format, so both variants agree on every field by construction.
+//
+// X(name, UDP type byte, TCP keyword); UDP-only messages have no keyword
+#define IPK_MESSAGES(X)      \
+    X(CNFRM, 0x00, NULL)     \
+    X(REPLY, 0x01, "REPLY")  \
+    X(AUTH,  0x02, "AUTH")   \
+    X(JOIN,  0x03, "JOIN")   \
+    X(MSG,   0x04, "MSG")    \
+    X(PING,  0xFD, NULL)     \
+    X(ERR,   0xFE, "ERR")    \
+    X(BYE,   0xFF, "BYE")
+
+// First letter of each TCP keyword, 0 for UDP-only messages. With the
+// keyword's length it selects the message in one switch when decoding.
+#define IPK_LEAD_CNFRM 0
+#define IPK_LEAD_REPLY 'R'
+#define IPK_LEAD_AUTH  'A'
+#define IPK_LEAD_JOIN  'J'
+#define IPK_LEAD_MSG   'M'
+#define IPK_LEAD_PING  0
+#define IPK_LEAD_ERR   'E'
+#define IPK_LEAD_BYE   'B'
+
+// Fields of each message in wire order: F(field, TCP keyword in front of it).
+// "" is a bare space; MessageIDs exist only in the UDP variant.
+#define IPK_FIELDS_CNFRM(F)
+#define IPK_FIELDS_REPLY(F) F(result, "") F(ref, NULL) F(content, "IS")
+#define IPK_FIELDS_AUTH(F)  F(username, "") F(display, "AS") F(secret, "USING")
+#define IPK_FIELDS_JOIN(F)  F(channel, "") F(display, "AS")
+#define IPK_FIELDS_MSG(F)   F(display, "FROM") F(content, "IS")
+#define IPK_FIELDS_PING(F)
+#define IPK_FIELDS_ERR(F)   F(display, "FROM") F(content, "IS")
+#define IPK_FIELDS_BYE(F)   F(display, "FROM")
+
+// Wire representation of each field. 'flag' is a 0/1 byte (OK/NOK over TCP),
+// 'id' a MessageID, 'word' a token of the field's character class and 'text'
+// the message content, which takes the rest of a TCP line. Strings are
+// NUL-terminated in a datagram.
+#define IPK_KIND_result   flag
+#define IPK_KIND_ref      id
+#define IPK_KIND_username word
+#define IPK_KIND_display  word
+#define IPK_KIND_secret   word
+#define IPK_KIND_channel  word
+#define IPK_KIND_content  text
+
+#define IPK_CLASS_username FIELD_USERNAME
+#define IPK_CLASS_display  FIELD_DISPLAY_NAME
+#define IPK_CLASS_secret   FIELD_SECRET
+#define IPK_CLASS_channel  FIELD_CHANNEL
+#define IPK_CLASS_content  FIELD_CONTENT
+
+#define IPK_PASTE(a, b)  IPK_PASTE_(a, b)
+#define IPK_PASTE_(a, b) a##b
+
+// UDP header: type byte and MessageID
+#define IPK_UDP_HEADER 3
+
+// Message types, numbered by their UDP type byte
+typedef enum {
+#define IPK_MSG_TYPE(name, code, keyword) MSG_##name = code,
+    IPK_MESSAGES(IPK_MSG_TYPE)
+#undef IPK_MSG_TYPE
+} UdpMessageType;
+
+// A string field. Decoded fields point into the decoded buffer: in a
+// datagram each is followed by its NUL, in a TCP line they are not.
+typedef struct {
+    const char *ptr;
+    size_t len;
+} ipk_text_t;
+
+// Any message of either variant; fields a message does not have stay empty
+typedef struct {
+    uint8_t type;                  // UdpMessageType
+    uint16_t id;                   // UDP MessageID
+    uint8_t result;                // REPLY: 1 = OK
+    uint16_t ref;                  // REPLY: MessageID of the request (UDP)
+    ipk_text_t username, display, secret, channel, content;
+} ipk_msg_t;
+
+static inline ipk_text_t ipk_text(const char *s) {
+    return (ipk_text_t){ s, s ? strlen(s) : 0 };
+}
+
+// Per message, for callers that know what they send or expect:
+//   ipk_udp_size_MSG    encoded length of the datagram
+//   ipk_udp_encode_MSG  writes the datagram, returns its length
+//   ipk_udp_decode_MSG  checks and splits a datagram of that type
+//   ipk_tcp_encode_MSG  appends the line with its CRLF
+//   ipk_tcp_decode_MSG  parses the rest of a line after the keyword
+#define IPK_SCHEMA_DECLARE(name, code, keyword) \
+    size_t ipk_udp_size_##name(const ipk_msg_t *m); \
+    size_t ipk_udp_encode_##name(const ipk_msg_t *m, uint8_t *out); \
+    bool ipk_udp_decode_##name(const uint8_t *buf, size_t len, ipk_msg_t *m); \
+    bool ipk_tcp_encode_##name(const ipk_msg_t *m, buffer_t *out); \
+    bool ipk_tcp_decode_##name(const char *p, ipk_msg_t *m);
+IPK_MESSAGES(IPK_SCHEMA_DECLARE)
+#undef IPK_SCHEMA_DECLARE
+
+// The same, dispatched on m->type, the type byte or the keyword. Sizes and
+// lengths are 0 and results false for an unknown type, a malformed message
+// or (TCP) a UDP-only message.
+size_t ipk_udp_size(const ipk_msg_t *m);
+size_t ipk_udp_encode(const ipk_msg_t *m, uint8_t *out);
+bool ipk_udp_decode(const uint8_t *buf, size_t len, ipk_msg_t *m);
+bool ipk_tcp_encode(const ipk_msg_t *m, buffer_t *out);
+bool ipk_tcp_decode(const char *line, ipk_msg_t *m);
+
+#endif // SCHEMA_H
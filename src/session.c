@@ -0,0 +1,632 @@
+#include "ipk25chat.h"
+#include "tcp.h"
+#include "udp.h"
+#include "buffer.h"
+#include "validate.h"
+#include "utils.h"
+#include "client.h"
+#include "fsm.h"
+#include "session_io.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define IPK_DEFAULT_PORT     4567
+#define IPK_REPLY_TIMEOUT_MS 5000
+
+// The public states are the shared state machine's, in the same order
+_Static_assert((int)IPK_STATE_START == FSM_START && (int)IPK_STATE_AUTH == FSM_AUTH &&
+               (int)IPK_STATE_OPEN == FSM_OPEN && (int)IPK_STATE_JOIN == FSM_JOIN &&
+               (int)IPK_STATE_END == FSM_END, "ipk_state_e must mirror fsm_state_e");
+
+struct ipk_session {
+    ipk_transport_e transport;
+    ipk_callbacks_t cb;
+    void *user;
+    int fd;
+    ipk_io_t io;                  // clock and datagram I/O (the socket unless simulated)
+    ipk_state_e state;
+    ipk_status_e status;          // final status once the state is END
+
+    // Set once the closing BYE (and ERR) is queued; the session ends with
+    // close_status when it has been delivered
+    bool closing;
+    ipk_status_e close_status;
+
+    char username[IPK_MAX_USERNAME_LEN + 1];
+    char display_name[IPK_MAX_DNAME_LEN + 1];
+    int64_t reply_deadline;       // -1 when no REPLY is awaited
+
+    // TCP
+    bool connecting;
+    buffer_t tx;
+    line_reader_t rx;
+
+    // UDP
+    struct sockaddr_in peer;      // server address, switched to the dynamic port by REPLY
+    uint16_t next_id;
+    uint16_t timeout_ms;
+    uint8_t retries;
+    msgid_buffer_t seen;
+    udp_ring_t queue;             // reliable datagrams, the head is in flight
+    bool inflight;
+    uint16_t inflight_id;
+    int attempts;
+    int64_t resend_at;
+    uint16_t reply_ref;           // MessageID of the AUTH/JOIN awaiting its REPLY
+    buffer_t dgram;               // last received datagram
+};
+
+static int64_t ipk_clock_ms(void *ctx) {
+    (void)ctx;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static ssize_t ipk_socket_send_to(void *ctx, const void *buf, size_t len,
+                                  const struct sockaddr_in *to) {
+    const ipk_session_t *s = ctx;
+    return sendto(s->fd, buf, len, MSG_DONTWAIT, (const struct sockaddr *)to, sizeof(*to));
+}
+
+static ssize_t ipk_socket_recv_from(void *ctx, void *buf, size_t cap, int flags,
+                                    struct sockaddr_in *from) {
+    const ipk_session_t *s = ctx;
+    socklen_t addr_len = sizeof(*from);
+    return recvfrom(s->fd, buf, cap, flags | MSG_DONTWAIT, (struct sockaddr *)from,
+                    from ? &addr_len : NULL);
+}
+
+static int64_t ipk_now_ms(const ipk_session_t *s) {
+    return s->io.now_ms(s->io.ctx);
+}
+
+// Ends the session once; the descriptor stays open until ipk_session_close
+static void ipk_finish(ipk_session_t *s, ipk_status_e status) {
+    if (s->state == IPK_STATE_END) return;
+    s->state = IPK_STATE_END;
+    s->status = status;
+    s->reply_deadline = -1;
+    s->inflight = false;
+    if (s->cb.on_closed) s->cb.on_closed(s->user, status);
+}
+
+// --- TCP ---
+
+// Appends a message line to the transmit buffer
+static int ipk_tcp_queue(ipk_session_t *s, const ipk_msg_t *m) {
+    return ipk_tcp_encode(m, &s->tx) ? IPK_OK : IPK_ENOMEM;
+}
+
+static void ipk_tcp_flush(ipk_session_t *s) {
+    while (s->tx.len > 0) {
+        ssize_t n = send(s->fd, s->tx.data, s->tx.len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;  // POLLOUT resumes it
+            ipk_finish(s, IPK_EIO);
+            return;
+        }
+        buffer_consume(&s->tx, n);
+    }
+    if (s->closing) ipk_finish(s, s->close_status);
+}
+
+static void ipk_tcp_connected(ipk_session_t *s) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(s->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+        ipk_finish(s, IPK_EIO);
+        return;
+    }
+    s->connecting = false;
+}
+
+// --- UDP ---
+
+// Encodes a reliable datagram at the tail of the send queue
+static int ipk_udp_queue(ipk_session_t *s, UdpMessageType type, const char *payload) {
+    if (s->queue.count == UDP_RING_SIZE) return IPK_EBUSY;
+
+    packetContent_t pkt = {
+        .type = type,
+        .messageID = s->next_id,
+        .payload = (uint8_t *)payload,
+        .length = payload ? strlen(payload) + 1 : 0
+    };
+    if (UDP_ENCODED_MAX(pkt.length) > MAX_MESSAGE_SIZE) return IPK_EINVAL;
+
+    size_t cap;
+    uint8_t *packet = pool_alloc(UDP_ENCODED_MAX(pkt.length), &cap);
+    if (!packet) return IPK_ENOMEM;
+    size_t len = udp_encode(&pkt, s->username, s->display_name, packet);
+    bool ok = len > 0 && udp_ring_push(&s->queue, packet, len);
+    pool_free(packet, cap);
+    if (!ok) return IPK_ENOMEM;
+
+    if (type == MSG_AUTH || type == MSG_JOIN) s->reply_ref = s->next_id;
+    s->next_id++;
+    return IPK_OK;
+}
+
+// A lost datagram is recovered by retransmission, so only hard errors count
+static int ipk_udp_sendto(ipk_session_t *s, const void *buf, size_t len,
+                          const struct sockaddr_in *to) {
+    ssize_t n = s->io.send_to(s->io.ctx, buf, len, to);
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        return IPK_EIO;
+    return IPK_OK;
+}
+
+// (Re)transmits the head of the queue; the first transmission of AUTH/JOIN
+// also starts the REPLY timer, so time spent queued does not count against it
+static void ipk_udp_send_head(ipk_session_t *s, int64_t now) {
+    buffer_t *b = &s->queue.items[s->queue.head];
+    if (ipk_udp_sendto(s, b->data, b->len, &s->peer) != IPK_OK) {
+        ipk_finish(s, IPK_EIO);
+        return;
+    }
+    uint16_t id;
+    memcpy(&id, &b->data[1], sizeof(uint16_t));
+    s->inflight_id = ntohs(id);
+    s->inflight = true;
+    s->attempts++;
+    s->resend_at = now + s->timeout_ms;
+    if (s->attempts == 1 && !s->closing && (b->data[0] == MSG_AUTH || b->data[0] == MSG_JOIN))
+        s->reply_deadline = now + IPK_REPLY_TIMEOUT_MS;
+}
+
+static void ipk_udp_delivered(ipk_session_t *s) {
+    udp_ring_pop(&s->queue);
+    s->inflight = false;
+}
+
+static void ipk_event(ipk_session_t *s, fsm_event_e event, const char *err, const ipk_msg_t *msg);
+
+// Retransmits an unconfirmed datagram or starts the next one
+static void ipk_udp_service(ipk_session_t *s, int64_t now) {
+    if (s->inflight && now >= s->resend_at) {
+        if (s->attempts > s->retries) {
+            ipk_udp_delivered(s);  // given up
+            ipk_event(s, FSM_EV_TIMEOUT, "Confirm not received", NULL);
+            if (s->state == IPK_STATE_END) return;
+        } else {
+            ipk_udp_send_head(s, now);
+        }
+    }
+    if (!s->inflight && s->queue.count > 0) {
+        s->attempts = 0;
+        ipk_udp_send_head(s, now);
+    }
+    if (s->closing && !s->inflight && s->queue.count == 0)
+        ipk_finish(s, s->close_status);
+}
+
+// --- Shared protocol handling ---
+
+// Queues the final ERR (when 'err' is set) and BYE; the session ends with
+// 'status' once they are delivered
+static void ipk_shutdown(ipk_session_t *s, ipk_status_e status, const char *err) {
+    if (s->closing || s->state == IPK_STATE_END) return;
+    s->closing = true;
+    s->close_status = status;
+    s->reply_deadline = -1;
+
+    int rc = IPK_OK;
+    if (s->transport == IPK_TCP) {
+        ipk_msg_t m = { .type = MSG_ERR, .display = ipk_text(s->display_name),
+                        .content = ipk_text(err) };
+        if (err) rc = ipk_tcp_queue(s, &m);
+        m.type = MSG_BYE;
+        if (rc == IPK_OK) rc = ipk_tcp_queue(s, &m);
+    } else {
+        if (err) rc = ipk_udp_queue(s, MSG_ERR, err);
+        if (rc == IPK_OK) rc = ipk_udp_queue(s, MSG_BYE, NULL);
+    }
+    if (rc != IPK_OK) ipk_finish(s, status);
+}
+
+// Feeds an event through the shared state machine and performs the resulting
+// action, as tcp_event and udp_event do for the CLI. 'msg' is the server
+// message behind an RX event; 'err' is the ERR content sent if the event turns
+// out to be a protocol error. A closing session is in END for the state
+// machine, but the public state only becomes END in ipk_finish, once the
+// closing messages are out.
+static void ipk_event(ipk_session_t *s, fsm_event_e event, const char *err, const ipk_msg_t *msg) {
+    fsm_state_e state = s->closing ? FSM_END : (fsm_state_e)s->state;
+    fsm_action_e action = fsm_step(&state, event);
+    if (state != FSM_END) s->state = (ipk_state_e)state;
+
+    switch (action) {
+        case FSM_ACT_REPLY:
+            s->reply_deadline = -1;
+            if (s->cb.on_reply) s->cb.on_reply(s->user, msg->result == 1, msg->content.ptr);
+            break;
+        case FSM_ACT_DELIVER:
+            if (s->cb.on_msg) s->cb.on_msg(s->user, msg->display.ptr, msg->content.ptr);
+            break;
+        case FSM_ACT_REMOTE_ERR:
+            if (s->cb.on_err) s->cb.on_err(s->user, msg->display.ptr, msg->content.ptr);
+            ipk_shutdown(s, IPK_EREMOTE, NULL);
+            break;
+        case FSM_ACT_ERR_BYE:
+            ipk_shutdown(s, event == FSM_EV_TIMEOUT ? IPK_ETIMEOUT : IPK_EPROTO, err);
+            break;
+        case FSM_ACT_BYE:
+            ipk_shutdown(s, IPK_OK, NULL);
+            break;
+        case FSM_ACT_FINISH:
+            if (event == FSM_EV_RX_BYE)
+                ipk_finish(s, IPK_OK);
+            else
+                ipk_finish(s, s->closing ? s->close_status : IPK_EIO);
+            break;
+        default:
+            break;
+    }
+}
+
+// Server message event of a decoded type; PING and CNFRM are not events
+static fsm_event_e ipk_rx_event(const ipk_msg_t *msg) {
+    switch (msg->type) {
+        case MSG_REPLY: return msg->result == 1 ? FSM_EV_RX_REPLY_OK : FSM_EV_RX_REPLY_NOK;
+        case MSG_MSG:   return FSM_EV_RX_MSG;
+        case MSG_ERR:   return FSM_EV_RX_ERR;
+        case MSG_BYE:   return FSM_EV_RX_BYE;
+        default:        return FSM_EV_RX_INVALID;
+    }
+}
+
+static void ipk_tcp_handle(ipk_session_t *s, const char *line) {
+    tcp_message_t parsed;  // NUL-terminated fields for the callbacks
+    if (!tcp_parse_line(line, &parsed)) {
+        ipk_event(s, FSM_EV_RX_INVALID, "Malformed message", NULL);
+        return;
+    }
+    ipk_msg_t msg = { .type = parsed.type, .result = parsed.replyOk,
+                      .display = ipk_text(parsed.displayName),
+                      .content = { parsed.content, parsed.contentLen } };
+    ipk_event(s, ipk_rx_event(&msg), "Unexpected message", &msg);
+}
+
+// Reads until the socket would block
+static void ipk_tcp_read(ipk_session_t *s) {
+    for (;;) {
+        ssize_t n = line_reader_fill(&s->rx, s->fd);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            ipk_finish(s, IPK_EIO);
+            return;
+        }
+
+        char *line;
+        size_t len;
+        while ((line = line_reader_next(&s->rx, &len)) != NULL) {
+            ipk_tcp_handle(s, line);
+            if (s->state == IPK_STATE_END) return;
+        }
+        if (s->rx.overflow) {
+            s->rx.overflow = false;
+            ipk_event(s, FSM_EV_RX_INVALID, "Line too long", NULL);
+        }
+        if (n == 0) {
+            ipk_event(s, FSM_EV_CLOSED, NULL, NULL);
+            return;
+        }
+    }
+}
+
+static void ipk_udp_handle(ipk_session_t *s, const uint8_t *buf, size_t len,
+                           const struct sockaddr_in *src) {
+    ipk_msg_t msg;
+    if (!ipk_udp_decode(buf, len, &msg)) {
+        ipk_event(s, FSM_EV_RX_INVALID, "Malformed packet", NULL);
+        return;
+    }
+
+    uint16_t id = msg.id;
+    if (msg.type == MSG_CNFRM) {
+        if (s->inflight && id == s->inflight_id) ipk_udp_delivered(s);
+        return;
+    }
+
+    // Confirmed before anything else, retransmissions only get the CNFRM
+    uint8_t confirm[3] = { MSG_CNFRM };
+    memcpy(&confirm[1], &buf[1], sizeof(uint16_t));
+    if (ipk_udp_sendto(s, confirm, sizeof(confirm), src) != IPK_OK) {
+        ipk_finish(s, IPK_EIO);
+        return;
+    }
+    if (msgid_buffer_contains(&s->seen, id)) return;
+    msgid_buffer_add(&s->seen, id);
+
+    if (msg.type == MSG_PING) return;
+
+    if (msg.type == MSG_REPLY && !s->closing && fsm_awaiting_reply((fsm_state_e)s->state)) {
+        uint16_t ref = msg.ref;
+        if (ref != s->reply_ref) return;  // not the request we wait for
+        s->peer = *src;  // the server continues from its dynamic port
+        // Pinned to that endpoint the kernel drops other senders and an
+        // unreachable server fails the next send or recv with ECONNREFUSED
+        if (s->state == IPK_STATE_AUTH && s->fd >= 0)
+            connect(s->fd, (const struct sockaddr *)&s->peer, sizeof(s->peer));
+        if (s->inflight && s->inflight_id == ref) ipk_udp_delivered(s);  // REPLY implies CNFRM
+    }
+    ipk_event(s, ipk_rx_event(&msg), "Unexpected message", &msg);
+}
+
+// Reads until the socket would block; each datagram is sized before it is read
+static void ipk_udp_read(ipk_session_t *s) {
+    for (;;) {
+        ssize_t size = s->io.recv_from(s->io.ctx, NULL, 0, MSG_PEEK | MSG_TRUNC, NULL);
+        if (size < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) ipk_finish(s, IPK_EIO);
+            return;
+        }
+        buffer_clear(&s->dgram);
+        if (!buffer_reserve(&s->dgram, size)) {
+            ipk_finish(s, IPK_ENOMEM);
+            return;
+        }
+
+        struct sockaddr_in src;
+        ssize_t n = s->io.recv_from(s->io.ctx, s->dgram.data, size > 0 ? size : 1, 0, &src);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) ipk_finish(s, IPK_EIO);
+            return;
+        }
+        ipk_udp_handle(s, (const uint8_t *)s->dgram.data, n, &src);
+        if (s->state == IPK_STATE_END) return;
+    }
+}
+
+// Sends what is queued and fires due timers
+static void ipk_service(ipk_session_t *s) {
+    if (s->state == IPK_STATE_END) return;
+    int64_t now = ipk_now_ms(s);
+
+    if (s->reply_deadline >= 0 && now >= s->reply_deadline) {
+        s->reply_deadline = -1;
+        ipk_event(s, FSM_EV_TIMEOUT, "No REPLY received", NULL);
+    }
+
+    if (s->transport == IPK_TCP) {
+        if (!s->connecting) ipk_tcp_flush(s);
+    } else {
+        ipk_udp_service(s, now);
+    }
+}
+
+// --- Public API ---
+
+void ipk_config_defaults(ipk_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->transport = IPK_TCP;
+    cfg->port = IPK_DEFAULT_PORT;
+    cfg->udp_timeout_ms = DEFAULT_TIMEOUT_MS;
+    cfg->udp_retries = MAX_RETRIES;
+}
+
+// Allocates a session in START for the server at 'addr'
+static ipk_session_t *ipk_session_new(const ipk_config_t *cfg, const struct sockaddr_in *addr) {
+    ipk_session_t *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->fd = -1;
+    s->transport = cfg->transport;
+    s->cb = cfg->callbacks;
+    s->user = cfg->user;
+    s->state = IPK_STATE_START;
+    s->reply_deadline = -1;
+    s->timeout_ms = cfg->udp_timeout_ms;
+    s->retries = cfg->udp_retries;
+    s->peer = *addr;
+    strcpy(s->display_name, "anonymous");
+    buffer_init(&s->tx);
+    buffer_init(&s->dgram);
+    line_reader_init(&s->rx, "\r\n", TCP_MAX_LINE_LEN);
+    msgid_buffer_init(&s->seen);
+    s->io = (ipk_io_t){ s, ipk_clock_ms, ipk_socket_send_to, ipk_socket_recv_from };
+    return s;
+}
+
+ipk_session_t *ipk_session_open(const ipk_config_t *cfg) {
+    if (!cfg || !cfg->host) return NULL;
+
+    struct sockaddr_in addr;
+    if (resolve_server_address(cfg->host, cfg->port, &addr) != 0) return NULL;
+
+    ipk_session_t *s = ipk_session_new(cfg, &addr);
+    if (!s) return NULL;
+
+    s->fd = socket(AF_INET, s->transport == IPK_TCP ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (s->fd < 0 || fcntl(s->fd, F_SETFL, O_NONBLOCK) != 0) {
+        ipk_session_close(s);
+        return NULL;
+    }
+
+    if (s->transport == IPK_TCP) {
+        if (connect(s->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            if (errno != EINPROGRESS) {
+                ipk_session_close(s);
+                return NULL;
+            }
+            s->connecting = true;
+        }
+    }
+    return s;
+}
+
+void ipk_session_close(ipk_session_t *s) {
+    if (!s) return;
+    if (s->fd >= 0) close(s->fd);
+    buffer_free(&s->tx);
+    buffer_free(&s->dgram);
+    line_reader_free(&s->rx);
+    udp_ring_free(&s->queue);
+    free(s);
+}
+
+int ipk_session_fd(const ipk_session_t *s) {
+    return s->fd;
+}
+
+short ipk_session_events(const ipk_session_t *s) {
+    if (s->state == IPK_STATE_END) return 0;
+    if (s->transport == IPK_TCP) {
+        if (s->connecting) return POLLOUT;
+        return POLLIN | (s->tx.len > 0 ? POLLOUT : 0);
+    }
+    return POLLIN;
+}
+
+int64_t ipk_session_deadline(const ipk_session_t *s) {
+    if (s->state == IPK_STATE_END) return -1;
+    int64_t deadline = s->reply_deadline;
+    if (s->inflight && (deadline < 0 || s->resend_at < deadline))
+        deadline = s->resend_at;
+    return deadline;
+}
+
+int ipk_session_timeout(const ipk_session_t *s) {
+    int64_t deadline = ipk_session_deadline(s);
+    if (deadline < 0) return -1;
+    int64_t left = deadline - ipk_now_ms(s);
+    return left > 0 ? (int)left : 0;
+}
+
+int ipk_session_step(ipk_session_t *s, short revents) {
+    if (s->state != IPK_STATE_END) {
+        if (s->transport == IPK_TCP) {
+            if (s->connecting && (revents & (POLLOUT | POLLERR | POLLHUP)))
+                ipk_tcp_connected(s);
+            if (s->state != IPK_STATE_END && !s->connecting &&
+                (revents & (POLLIN | POLLERR | POLLHUP)))
+                ipk_tcp_read(s);
+        } else if (revents & (POLLIN | POLLERR)) {
+            ipk_udp_read(s);
+        }
+        ipk_service(s);
+    }
+    return s->state == IPK_STATE_END ? s->status : IPK_OK;
+}
+
+ipk_state_e ipk_session_state(const ipk_session_t *s) {
+    return s->state;
+}
+
+// Common admission check against the state machine: one REPLY at a time,
+// nothing after BYE. 't' is the transition to take once the request is queued.
+static int ipk_admit(const ipk_session_t *s, fsm_event_e event, fsm_transition_t *t) {
+    if (s->closing) return IPK_ESTATE;
+    *t = fsm_lookup((fsm_state_e)s->state, event);
+    if (t->action == FSM_ACT_BUSY) return IPK_EBUSY;
+    return t->action == FSM_ACT_DENY ? IPK_ESTATE : IPK_OK;
+}
+
+// The REPLY timer of a TCP request starts now; a UDP request's starts with its
+// first transmission (ipk_udp_send_head)
+static void ipk_await_reply(ipk_session_t *s, const fsm_transition_t *t) {
+    s->state = (ipk_state_e)t->next;
+    if (s->transport == IPK_TCP) s->reply_deadline = ipk_now_ms(s) + IPK_REPLY_TIMEOUT_MS;
+}
+
+int ipk_auth(ipk_session_t *s, const char *username, const char *secret,
+             const char *display_name) {
+    fsm_transition_t t;
+    int rc = ipk_admit(s, FSM_EV_CMD_AUTH, &t);
+    if (rc != IPK_OK) return rc;
+    if (!validate_field_str(FIELD_USERNAME, username) ||
+        !validate_field_str(FIELD_SECRET, secret) ||
+        !validate_field_str(FIELD_DISPLAY_NAME, display_name))
+        return IPK_EINVAL;
+
+    strcpy(s->username, username);
+    strcpy(s->display_name, display_name);
+    if (s->transport == IPK_TCP) {
+        ipk_msg_t m = { .type = MSG_AUTH, .username = ipk_text(username),
+                        .display = ipk_text(display_name), .secret = ipk_text(secret) };
+        rc = ipk_tcp_queue(s, &m);
+    } else
+        rc = ipk_udp_queue(s, MSG_AUTH, secret);
+    if (rc != IPK_OK) return rc;
+
+    ipk_await_reply(s, &t);
+    ipk_service(s);
+    return IPK_OK;
+}
+
+int ipk_join(ipk_session_t *s, const char *channel) {
+    fsm_transition_t t;
+    int rc = ipk_admit(s, FSM_EV_CMD_JOIN, &t);
+    if (rc != IPK_OK) return rc;
+    if (!validate_field_str(FIELD_CHANNEL, channel)) return IPK_EINVAL;
+
+    if (s->transport == IPK_TCP) {
+        ipk_msg_t m = { .type = MSG_JOIN, .channel = ipk_text(channel),
+                        .display = ipk_text(s->display_name) };
+        rc = ipk_tcp_queue(s, &m);
+    } else
+        rc = ipk_udp_queue(s, MSG_JOIN, channel);
+    if (rc != IPK_OK) return rc;
+
+    ipk_await_reply(s, &t);
+    ipk_service(s);
+    return IPK_OK;
+}
+
+int ipk_send(ipk_session_t *s, const char *content) {
+    fsm_transition_t t;
+    int rc = ipk_admit(s, FSM_EV_CMD_MSG, &t);
+    if (rc != IPK_OK) return rc;
+    if (!validate_field_str(FIELD_CONTENT, content)) return IPK_EINVAL;
+
+    if (s->transport == IPK_TCP) {
+        ipk_msg_t m = { .type = MSG_MSG, .display = ipk_text(s->display_name),
+                        .content = ipk_text(content) };
+        rc = ipk_tcp_queue(s, &m);
+    } else
+        rc = ipk_udp_queue(s, MSG_MSG, content);
+    if (rc != IPK_OK) return rc;
+
+    ipk_service(s);
+    return IPK_OK;
+}
+
+int ipk_rename(ipk_session_t *s, const char *display_name) {
+    if (s->state == IPK_STATE_END || s->closing) return IPK_ESTATE;
+    if (!validate_field_str(FIELD_DISPLAY_NAME, display_name)) return IPK_EINVAL;
+    strcpy(s->display_name, display_name);
+    return IPK_OK;
+}
+
+int ipk_bye(ipk_session_t *s) {
+    if (s->state == IPK_STATE_END || s->closing) return IPK_ESTATE;
+    ipk_event(s, FSM_EV_CMD_BYE, NULL, NULL);
+    ipk_service(s);
+    return IPK_OK;
+}
+
+const char *ipk_strerror(int status) {
+    switch (status) {
+        case IPK_OK:       return "success";
+        case IPK_EINVAL:   return "invalid field";
+        case IPK_ESTATE:   return "not allowed in this state";
+        case IPK_EBUSY:    return "request pending";
+        case IPK_ENOMEM:   return "out of memory";
+        case IPK_EIO:      return "connection error";
+        case IPK_ETIMEOUT: return "no response from server";
+        case IPK_EPROTO:   return "protocol error";
+        case IPK_EREMOTE:  return "error reported by server";
+        default:           return "unknown status";
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef SESSION_IO_H
+#define SESSION_IO_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+// Clock and datagram I/O of a UDP client. A library session reads the
+// monotonic clock and uses its own socket through it; the CLI's UdpClient
+// (udp_client_init_io) takes one in place of its socket, so a simulation can
+// substitute a virtual clock and an in-memory network and run its timeouts
+// and retransmissions without waiting for real time (see sim.c). Internal to
+// the library, not exported.
+typedef struct {
+    void *ctx;
+    // Current time in milliseconds
+    int64_t (*now_ms)(void *ctx);
+    // sendto()/recvfrom() semantics on a non-blocking socket: -1 with errno
+    // EAGAIN when nothing is pending, MSG_PEEK | MSG_TRUNC sizes a datagram
+    ssize_t (*send_to)(void *ctx, const void *buf, size_t len, const struct sockaddr_in *to);
+    ssize_t (*recv_from)(void *ctx, void *buf, size_t cap, int flags, struct sockaddr_in *from);
+} ipk_io_t;
+
+#endif // SESSION_IO_H
@@ -0,0 +1,323 @@
+#define _DEFAULT_SOURCE  // syscall
+
+#include "shmring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// Publishing a record: the tail moves past whatever the record will
+// overwrite, then the record is written and the head moves past it. A reader
+// checks the tail again after it has looked at a record (seqlock style), so
+// it notices when the writer lapped it meanwhile.
+
+static ipk_ring_header_t *shmring_map;
+static size_t shmring_map_len;
+static uint64_t shmring_seq;
+
+// POSIX shared-memory names start with a single '/'
+static void shmring_path(char *out, size_t size, const char *name) {
+    snprintf(out, size, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+static long shmring_futex(uint32_t *word, int op, uint32_t val, const struct timespec *timeout) {
+    return syscall(SYS_futex, word, op, val, timeout, NULL, 0);
+}
+
+// Wakes the readers sleeping in ipk_ring_wait
+static void shmring_notify(ipk_ring_header_t *h) {
+    __atomic_add_fetch(&h->notify, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&h->waiters, __ATOMIC_SEQ_CST))
+        shmring_futex(&h->notify, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+static void shmring_finish(ipk_ring_header_t *h) {
+    __atomic_store_n(&h->closed, 1, __ATOMIC_RELEASE);
+    shmring_notify(h);
+}
+
+// Maps an existing ring; NULL with errno set when there is none or it is not one
+static ipk_ring_header_t *shmring_attach(const char *path, size_t *map_len) {
+    int fd = shm_open(path, O_RDWR, 0);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ipk_ring_header_t)) {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+
+    ipk_ring_header_t *h = p;
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != IPK_RING_MAGIC ||
+        h->version != IPK_RING_VERSION || h->record_size != sizeof(ipk_ring_record_t) ||
+        h->size > (size_t)st.st_size - sizeof(ipk_ring_header_t)) {
+        munmap(p, st.st_size);
+        errno = EPROTO;
+        return NULL;
+    }
+    *map_len = st.st_size;
+    return h;
+}
+
+// --- Writer ---
+
+int shmring_open(const char *name, size_t size) {
+    size &= ~(size_t)7;
+    if (size < SHMRING_MIN_SIZE) size = SHMRING_MIN_SIZE;
+    char path[NAME_MAX + 2];
+    shmring_path(path, sizeof(path), name);
+
+    // Readers still attached to a previous ring keep their mapping and see it end
+    size_t old_len;
+    ipk_ring_header_t *old = shmring_attach(path, &old_len);
+    if (old) {
+        shmring_finish(old);
+        munmap(old, old_len);
+    }
+    shm_unlink(path);
+
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    shmring_map_len = sizeof(ipk_ring_header_t) + size;
+    if (ftruncate(fd, shmring_map_len) != 0) {
+        perror("ftruncate");
+        close(fd);
+        shm_unlink(path);
+        return -1;
+    }
+    void *p = mmap(NULL, shmring_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(path);
+        return -1;
+    }
+
+    ipk_ring_header_t *h = p;
+    h->version = IPK_RING_VERSION;
+    h->record_size = sizeof(ipk_ring_record_t);
+    h->size = size;
+    h->writer_pid = getpid();
+    // The magic goes last: a reader attaching meanwhile finds a complete header or none
+    __atomic_store_n(&h->magic, IPK_RING_MAGIC, __ATOMIC_RELEASE);
+    shmring_map = h;
+    shmring_seq = 0;
+    return 0;
+}
+
+void shmring_close(void) {
+    if (!shmring_map) return;
+    shmring_finish(shmring_map);
+    munmap(shmring_map, shmring_map_len);
+    shmring_map = NULL;
+}
+
+bool shmring_enabled(void) {
+    return shmring_map != NULL;
+}
+
+// Length of the record (or the filler remainder) starting at ring position 'at'
+static uint64_t shmring_record_len(const ipk_ring_header_t *h, uint64_t at) {
+    uint64_t off = at % h->size;
+    if (h->size - off < sizeof(ipk_ring_record_t)) return h->size - off;
+    return ((const ipk_ring_record_t *)((const uint8_t *)(h + 1) + off))->size;
+}
+
+// Copies a string behind the record header and NUL-terminates it
+static uint32_t shmring_put(uint8_t *rec, uint32_t off, const char *s, size_t len) {
+    if (len) memcpy(rec + off, s, len);
+    rec[off + len] = '\0';
+    return off + len + 1;
+}
+
+void shmring_publish(uint8_t type, uint8_t flags, uint8_t transport,
+                     const char *sender, size_t sender_len,
+                     const char *channel, size_t channel_len,
+                     const char *content, size_t content_len) {
+    ipk_ring_header_t *h = shmring_map;
+    if (!h) return;
+    if (sender_len > UINT8_MAX) sender_len = UINT8_MAX;
+    if (channel_len > UINT8_MAX) channel_len = UINT8_MAX;
+
+    uint64_t ring = h->size;
+    uint64_t size = (sizeof(ipk_ring_record_t) + sender_len + channel_len + content_len + 3 + 7) & ~7ull;
+    if (size > ring / 2) return;  // cannot happen with protocol-sized content
+    uint8_t *data = (uint8_t *)(h + 1);
+
+    // A record never straddles the end of the ring
+    uint64_t head = h->head;
+    uint64_t pos = head % ring;
+    uint64_t pad = pos + size > ring ? ring - pos : 0;
+    uint64_t end = head + pad + size;
+
+    // What the record overwrites leaves the readable window first
+    uint64_t tail = h->tail;
+    if (end - tail > ring) {
+        while (end - tail > ring) tail += shmring_record_len(h, tail);
+        __atomic_store_n(&h->tail, tail, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    if (pad >= sizeof(ipk_ring_record_t)) {
+        ipk_ring_record_t *filler = (ipk_ring_record_t *)(data + pos);
+        memset(filler, 0, sizeof(*filler));
+        filler->size = pad;
+        filler->type = IPK_RING_PAD;
+    }
+
+    uint8_t *rec = data + (head + pad) % ring;
+    ipk_ring_record_t *r = (ipk_ring_record_t *)rec;
+    r->size = size;
+    r->type = type;
+    r->flags = flags;
+    r->transport = transport;
+    r->reserved = 0;
+    r->seq = shmring_seq++;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    r->ts_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+    uint32_t off = sizeof(ipk_ring_record_t);
+    r->sender_off = off;
+    r->sender_len = sender_len;
+    off = shmring_put(rec, off, sender, sender_len);
+    r->channel_off = off;
+    r->channel_len = channel_len;
+    off = shmring_put(rec, off, channel, channel_len);
+    r->content_off = off;
+    r->content_len = content_len;
+    shmring_put(rec, off, content, content_len);
+
+    __atomic_store_n(&h->head, end, __ATOMIC_RELEASE);
+    shmring_notify(h);
+}
+
+// --- Reader (libipk25chat) ---
+
+struct ipk_ring {
+    ipk_ring_header_t *h;
+    size_t map_len;
+    uint64_t pos;           // ring position of the next record to look at
+    uint64_t next_seq;      // sequence number expected there
+    bool have_seq;
+    uint64_t lost;
+};
+
+ipk_ring_t *ipk_ring_open(const char *name, bool from_oldest) {
+    char path[NAME_MAX + 2];
+    shmring_path(path, sizeof(path), name);
+    ipk_ring_t *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->h = shmring_attach(path, &r->map_len);
+    if (!r->h) {
+        free(r);
+        return NULL;
+    }
+    r->pos = __atomic_load_n(from_oldest ? &r->h->tail : &r->h->head, __ATOMIC_ACQUIRE);
+    return r;
+}
+
+void ipk_ring_close(ipk_ring_t *r) {
+    if (!r) return;
+    munmap(r->h, r->map_len);
+    free(r);
+}
+
+int ipk_ring_next(ipk_ring_t *r, ipk_ring_msg_t *m) {
+    const ipk_ring_header_t *h = r->h;
+    const uint8_t *data = (const uint8_t *)(h + 1);
+    uint64_t ring = h->size;
+
+    for (;;) {
+        uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+        if (r->pos >= head) {
+            // 'closed' is set after the last record, so the head read after it is final
+            if (!__atomic_load_n(&h->closed, __ATOMIC_ACQUIRE)) return 0;
+            return r->pos >= __atomic_load_n(&h->head, __ATOMIC_ACQUIRE) ? -1 : 0;
+        }
+        uint64_t tail = __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE);
+        if (r->pos < tail) r->pos = tail;  // lapped: what was in between is gone
+
+        uint64_t off = r->pos % ring;
+        if (ring - off < sizeof(ipk_ring_record_t)) {
+            r->pos += ring - off;
+            continue;
+        }
+        ipk_ring_record_t rec;
+        memcpy(&rec, data + off, sizeof(rec));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (r->pos < __atomic_load_n(&h->tail, __ATOMIC_RELAXED)) continue;  // overwritten meanwhile
+
+        if (rec.size < sizeof(rec) || rec.size > ring - off || (rec.size & 7) ||
+            (rec.type != IPK_RING_PAD &&
+             ((size_t)rec.sender_off + rec.sender_len >= rec.size ||
+              (size_t)rec.channel_off + rec.channel_len >= rec.size ||
+              (size_t)rec.content_off + rec.content_len >= rec.size))) {
+            r->pos = head;  // not a record: start over with the next one written
+            continue;
+        }
+        uint64_t pos = r->pos;
+        r->pos += rec.size;
+        if (rec.type == IPK_RING_PAD) continue;
+
+        if (r->have_seq && rec.seq > r->next_seq) r->lost += rec.seq - r->next_seq;
+        r->have_seq = true;
+        r->next_seq = rec.seq + 1;
+
+        const char *base = (const char *)(data + off);
+        *m = (ipk_ring_msg_t){
+            .type = rec.type,
+            .flags = rec.flags,
+            .transport = rec.transport,
+            .seq = rec.seq,
+            .ts_ns = rec.ts_ns,
+            .sender = base + rec.sender_off,
+            .sender_len = rec.sender_len,
+            .channel = base + rec.channel_off,
+            .channel_len = rec.channel_len,
+            .content = base + rec.content_off,
+            .content_len = rec.content_len,
+            .pos = pos
+        };
+        return 1;
+    }
+}
+
+bool ipk_ring_valid(const ipk_ring_t *r, const ipk_ring_msg_t *m) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return m->pos >= __atomic_load_n(&r->h->tail, __ATOMIC_RELAXED);
+}
+
+int ipk_ring_wait(ipk_ring_t *r, int timeout_ms) {
+    ipk_ring_header_t *h = r->h;
+    uint32_t seen = __atomic_load_n(&h->notify, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&h->waiters, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&h->head, __ATOMIC_SEQ_CST) == r->pos &&
+        !__atomic_load_n(&h->closed, __ATOMIC_SEQ_CST)) {
+        struct timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+        // Returns at once when a record was published after 'seen' was read
+        shmring_futex(&h->notify, FUTEX_WAIT, seen, timeout_ms >= 0 ? &ts : NULL);
+    }
+    __atomic_sub_fetch(&h->waiters, 1, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&h->head, __ATOMIC_ACQUIRE) != r->pos ||
+           __atomic_load_n(&h->closed, __ATOMIC_ACQUIRE);
+}
+
+uint64_t ipk_ring_lost(const ipk_ring_t *r) {
+    return r->lost;
+}
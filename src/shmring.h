@@ -0,0 +1,32 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ipk25ring.h"
+
+// Writer side of the shared-memory message ring (-O), layout in ipk25ring.h.
+// One ring per process, like the binary log.
+
+#define SHMRING_DEFAULT_SIZE (4u << 20)  // ring bytes
+#define SHMRING_MIN_SIZE     (256u << 10) // room for several maximum-size messages
+
+// Replaces any ring of the same name (readers of the old one see it closed)
+// and creates it with 'size' ring bytes. Returns -1 after reporting why.
+int shmring_open(const char *name, size_t size);
+
+// Marks the ring finished for its readers and unmaps it; the name stays so
+// they can drain what is left
+void shmring_close(void);
+
+bool shmring_enabled(void);
+
+// Publishes a received message; the strings need not be NUL-terminated
+void shmring_publish(uint8_t type, uint8_t flags, uint8_t transport,
+                     const char *sender, size_t sender_len,
+                     const char *channel, size_t channel_len,
+                     const char *content, size_t content_len);
+
+#endif // SHMRING_H
@@ -0,0 +1,698 @@
+// ipk25chat-soak: soak and stress test of the client binary. The client runs
+// as a child process against a stand-in server inside this process, once per
+// transport. Its stdin is fed a steady stream of MSGs with a /rename every so
+// often; the server echoes every MSG back under the sender's display name, and
+// the echo read from the client's stdout closes the round trip. Millions of
+// messages wrap both sides' MessageIDs past 65535 and cycle the client's
+// seen_ids ring many times over. Every interval the client's CPU time, RSS and
+// the latency percentiles are sampled and compared with the first sample
+// after warm-up, so a leak or a slowdown shows up as drift long before it
+// would in production.
+#define _GNU_SOURCE  // posix_openpt, cfmakeraw
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <termios.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+#include "buffer.h"
+#include "tcp.h"
+#include "udp.h"
+#include "utils.h"
+
+#define SOAK_MAX_WINDOW   48       // stays below the client's UDP send queue
+#define SOAK_MAX_ARGS     32
+#define SOAK_MAX_DGRAM    2048
+#define SOAK_STALL_MS     10000    // no echo for this long: the client hangs
+#define SOAK_RESEND_MS    250      // the stand-in server's UDP retransmission
+#define SOAK_LAT_SLACK_US 50       // latency drift below this is noise
+#define SOAK_CLOSE_MS     5000     // wait for BYE and the client's exit
+
+typedef struct {
+    bool udp;
+    uint64_t messages;             // per transport, 0 = until the time limit
+    int seconds;                   // 0 = until the message count
+    int interval;                  // seconds between samples
+    int window;                    // MSGs written but not echoed yet
+    uint64_t rename_every;         // 0 = never
+    double tolerance;              // drift threshold, fraction of the baseline
+    const char *client;
+    char *extra[SOAK_MAX_ARGS];    // more client arguments
+    int n_extra;
+} soak_params_t;
+
+// --- Stand-in server: REPLY OK to AUTH/JOIN, echo to MSG ---
+
+typedef struct {
+    bool udp;
+    int fd;                        // TCP listener or the UDP socket
+    int conn;                      // accepted TCP connection, -1 before
+    line_reader_t rx;
+    struct sockaddr_in peer;       // UDP: the client
+    msgid_buffer_t seen;
+    udp_ring_t queue;              // UDP: our datagrams, sent one at a time
+    bool inflight;
+    uint16_t inflight_id;
+    int64_t resend_at;
+    uint16_t next_id;
+    bool have_rx_id;
+    uint16_t last_rx_id;
+    uint64_t client_wraps, server_wraps;  // MessageID wrap-arounds seen / made
+    uint64_t retransmits;
+    uint64_t msgs;
+    bool bye, closed;
+} soak_server_t;
+
+static int64_t soak_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int soak_server_open(soak_server_t *srv, bool udp, uint16_t *port) {
+    memset(srv, 0, sizeof(*srv));
+    srv->udp = udp;
+    srv->conn = -1;
+    line_reader_init(&srv->rx, "\r\n", TCP_MAX_LINE_LEN);
+    msgid_buffer_init(&srv->seen);
+
+    srv->fd = socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (srv->fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(srv->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        (!udp && listen(srv->fd, 1) != 0) ||
+        getsockname(srv->fd, (struct sockaddr *)&addr, &len) != 0) {
+        perror("bind");
+        return -1;
+    }
+    if (udp) fcntl(srv->fd, F_SETFL, O_NONBLOCK);
+    *port = ntohs(addr.sin_port);
+    return 0;
+}
+
+static void soak_server_close(soak_server_t *srv) {
+    if (srv->conn >= 0) close(srv->conn);
+    if (srv->fd >= 0) close(srv->fd);
+    line_reader_free(&srv->rx);
+    udp_ring_free(&srv->queue);
+}
+
+static void soak_udp_send_head(soak_server_t *srv) {
+    buffer_t *b = &srv->queue.items[srv->queue.head];
+    uint16_t id;
+    memcpy(&id, &b->data[1], sizeof(uint16_t));
+    srv->inflight_id = ntohs(id);
+    srv->inflight = true;
+    srv->resend_at = soak_now_ns() / 1000000 + SOAK_RESEND_MS;
+    sendto(srv->fd, b->data, b->len, 0, (struct sockaddr *)&srv->peer, sizeof(srv->peer));
+}
+
+static void soak_udp_service(soak_server_t *srv) {
+    if (srv->inflight && soak_now_ns() / 1000000 >= srv->resend_at) {
+        srv->retransmits++;
+        soak_udp_send_head(srv);
+    }
+    if (!srv->inflight && srv->queue.count > 0) soak_udp_send_head(srv);
+}
+
+static void soak_udp_queue(soak_server_t *srv, UdpMessageType type, uint16_t ref,
+                           const char *display, const char *content) {
+    packetContent_t pkt = {
+        .type = type,
+        .messageID = srv->next_id++,
+        .ref_messageID = ref,
+        .result = 1,
+        .payload = (uint8_t *)content,
+        .length = strlen(content) + 1
+    };
+    if (srv->next_id == 0) srv->server_wraps++;
+    uint8_t packet[SOAK_MAX_DGRAM];
+    size_t len = udp_encode(&pkt, "", display, packet);
+    if (len == 0 || !udp_ring_push(&srv->queue, packet, len))
+        fprintf(stderr, "soak: server queue full, datagram dropped\n");
+    soak_udp_service(srv);
+}
+
+static void soak_udp_receive(soak_server_t *srv) {
+    uint8_t buf[SOAK_MAX_DGRAM];
+    struct sockaddr_in from;
+    socklen_t len = sizeof(from);
+    ssize_t n;
+    while ((n = recvfrom(srv->fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len)) > 0) {
+        ipk_msg_t m;
+        if (!ipk_udp_decode(buf, n, &m)) continue;
+        uint16_t id = m.id;
+
+        if (m.type == MSG_CNFRM) {
+            if (srv->inflight && id == srv->inflight_id) {
+                udp_ring_pop(&srv->queue);
+                srv->inflight = false;
+                soak_udp_service(srv);
+            }
+            continue;
+        }
+        srv->peer = from;
+        uint8_t confirm[3] = { MSG_CNFRM, buf[1], buf[2] };
+        sendto(srv->fd, confirm, sizeof(confirm), 0, (struct sockaddr *)&from, sizeof(from));
+        if (msgid_buffer_contains(&srv->seen, id)) continue;
+        msgid_buffer_add(&srv->seen, id);
+        if (srv->have_rx_id && id < srv->last_rx_id) srv->client_wraps++;
+        srv->have_rx_id = true;
+        srv->last_rx_id = id;
+
+        switch (m.type) {
+            case MSG_AUTH:
+            case MSG_JOIN:
+                soak_udp_queue(srv, MSG_REPLY, id, "", "ok");
+                break;
+            case MSG_MSG:
+                srv->msgs++;
+                soak_udp_queue(srv, MSG_MSG, 0, m.display.ptr, m.content.ptr);
+                break;
+            case MSG_BYE:
+                srv->bye = true;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static void soak_tcp_receive(soak_server_t *srv) {
+    if (srv->conn < 0) {
+        srv->conn = accept(srv->fd, NULL, NULL);
+        return;
+    }
+    if (line_reader_fill(&srv->rx, srv->conn) <= 0) {
+        srv->closed = true;
+        return;
+    }
+    char *line;
+    size_t len;
+    tcp_message_t msg;
+    buffer_t out;
+    buffer_init(&out);
+    while ((line = line_reader_next(&srv->rx, &len)) != NULL) {
+        if (!tcp_parse_line(line, &msg)) continue;
+        switch (msg.type) {
+            case TCP_MSG_AUTH:
+            case TCP_MSG_JOIN:
+                ipk_tcp_encode_REPLY(&(ipk_msg_t){ .result = 1, .content = ipk_text("ok") }, &out);
+                break;
+            case TCP_MSG_MSG:
+                srv->msgs++;
+                ipk_tcp_encode_MSG(&(ipk_msg_t){ .display = ipk_text(msg.displayName),
+                                                 .content = { msg.content, msg.contentLen } }, &out);
+                break;
+            case TCP_MSG_BYE:
+                srv->bye = true;
+                break;
+            default:
+                break;
+        }
+    }
+    if (out.len > 0) send_all(srv->conn, out.data, out.len);
+    buffer_free(&out);
+}
+
+// --- The client under test ---
+
+typedef struct {
+    pid_t pid;
+    int in;                        // its stdin
+    int out;                       // pty master behind its stdout, so it is line buffered
+    line_reader_t lines;
+    buffer_t tx;                   // input not written yet
+    bool closing;                  // stdin closed once tx is written
+} soak_child_t;
+
+static int soak_spawn(soak_child_t *child, const soak_params_t *p, uint16_t port) {
+    memset(child, 0, sizeof(*child));
+    child->in = child->out = -1;
+    line_reader_init(&child->lines, "\n", TCP_MAX_LINE_LEN);
+    buffer_init(&child->tx);
+
+    int pipefd[2];
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("posix_openpt");
+        return -1;
+    }
+    int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if (slave < 0 || tcgetattr(slave, &tio) != 0) {
+        perror("pty");
+        return -1;
+    }
+    cfmakeraw(&tio);  // no echo, no \n -> \r\n
+    tcsetattr(slave, TCSANOW, &tio);
+    if (pipe(pipefd) != 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    char port_arg[8];
+    snprintf(port_arg, sizeof(port_arg), "%u", port);
+    char *argv[SOAK_MAX_ARGS + 8];
+    int argc = 0;
+    argv[argc++] = (char *)p->client;
+    argv[argc++] = "-t";
+    argv[argc++] = p->udp ? "udp" : "tcp";
+    argv[argc++] = "-s";
+    argv[argc++] = "127.0.0.1";
+    argv[argc++] = "-p";
+    argv[argc++] = port_arg;
+    for (int i = 0; i < p->n_extra; i++) argv[argc++] = p->extra[i];
+    argv[argc] = NULL;
+
+    child->pid = fork();
+    if (child->pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (child->pid == 0) {
+        dup2(pipefd[0], STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        close(pipefd[0]);
+        close(pipefd[1]);
+        close(slave);
+        close(master);
+        execv(p->client, argv);
+        perror(p->client);
+        _exit(127);
+    }
+    close(pipefd[0]);
+    close(slave);
+    child->in = pipefd[1];
+    child->out = master;
+    fcntl(child->in, F_SETFL, O_NONBLOCK);
+    return 0;
+}
+
+// Writes what stdin takes without blocking
+static void soak_child_write(soak_child_t *child) {
+    if (child->in < 0) return;
+    if (child->tx.len > 0) {
+        ssize_t n = write(child->in, child->tx.data, child->tx.len);
+        if (n > 0) buffer_consume(&child->tx, n);
+    }
+    if (child->closing && child->tx.len == 0) {
+        close(child->in);  // EOF: the client says BYE and exits
+        child->in = -1;
+    }
+}
+
+// Kills the client if it is still running and returns its exit status
+static int soak_reap(soak_child_t *child, bool kill_it) {
+    int status = 0;
+    if (kill_it) kill(child->pid, SIGKILL);
+    waitpid(child->pid, &status, 0);
+    if (child->in >= 0) close(child->in);
+    if (child->out >= 0) close(child->out);
+    line_reader_free(&child->lines);
+    buffer_free(&child->tx);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// CPU time (clock ticks) and RSS (KiB) of a process from /proc
+static bool soak_proc_sample(pid_t pid, uint64_t *ticks, long *rss_kb) {
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return false;
+    buf[n] = '\0';
+    // The command name may contain spaces; the fields after it do not
+    char *p = strrchr(buf, ')');
+    unsigned long utime, stime;
+    long rss;
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu "
+                            "%*d %*d %*d %*d %*d %*d %*u %*u %ld",
+                     &utime, &stime, &rss) != 3)
+        return false;
+    *ticks = utime + stime;
+    *rss_kb = rss * (sysconf(_SC_PAGESIZE) / 1024);
+    return true;
+}
+
+// --- Sampling ---
+
+typedef struct {
+    double rate;                   // messages per second
+    double cpu_pct, cpu_us;        // of the interval, and per message
+    long rss_kb;
+    uint32_t p50, p99, max;        // microseconds
+} soak_sample_t;
+
+typedef struct {
+    uint32_t *lat;                 // round trips of the interval (us)
+    size_t count, cap;
+    bool have_base;
+    soak_sample_t base;            // first sample after warm-up
+    int samples;
+    int drifting;                  // samples flagged
+    char last_drift[64];
+} soak_stats_t;
+
+static void soak_record(soak_stats_t *st, int64_t ns) {
+    if (st->count == st->cap) {
+        size_t cap = st->cap ? st->cap * 2 : 4096;
+        uint32_t *lat = realloc(st->lat, cap * sizeof(uint32_t));
+        if (!lat) return;
+        st->lat = lat;
+        st->cap = cap;
+    }
+    st->lat[st->count++] = (uint32_t)(ns / 1000);
+}
+
+static int soak_cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Flags what drifted past the tolerance relative to the baseline
+static void soak_drift(const soak_sample_t *s, const soak_sample_t *base, double tol,
+                       char *out, size_t cap) {
+    out[0] = '\0';
+    if (s->rss_kb > base->rss_kb * (1.0 + tol)) strncat(out, "rss ", cap - strlen(out) - 1);
+    if (s->rate < base->rate * (1.0 - tol)) strncat(out, "rate ", cap - strlen(out) - 1);
+    if (s->cpu_us > base->cpu_us * (1.0 + tol)) strncat(out, "cpu ", cap - strlen(out) - 1);
+    if (s->p50 > base->p50 * (1.0 + tol) + SOAK_LAT_SLACK_US)
+        strncat(out, "latency ", cap - strlen(out) - 1);
+    size_t len = strlen(out);
+    if (len > 0) out[len - 1] = '\0';
+}
+
+static void soak_sample(soak_stats_t *st, const soak_params_t *p, double elapsed, double span,
+                        uint64_t total, uint64_t msgs, uint64_t ticks, long rss_kb) {
+    soak_sample_t s = { 0 };
+    s.rate = msgs / span;
+    s.cpu_pct = 100.0 * ticks / sysconf(_SC_CLK_TCK) / span;
+    s.cpu_us = msgs ? 1e6 * ticks / sysconf(_SC_CLK_TCK) / msgs : 0;
+    s.rss_kb = rss_kb;
+    if (st->count > 0) {
+        qsort(st->lat, st->count, sizeof(uint32_t), soak_cmp_u32);
+        s.p50 = st->lat[st->count / 2];
+        s.p99 = st->lat[st->count * 99 / 100];
+        s.max = st->lat[st->count - 1];
+    }
+    st->count = 0;
+
+    // The first interval includes start-up and warm-up
+    char drift[64] = "";
+    if (st->samples++ == 1) {
+        st->base = s;
+        st->have_base = true;
+        strcpy(drift, "baseline");
+    } else if (st->have_base) {
+        soak_drift(&s, &st->base, p->tolerance, drift, sizeof(drift));
+        if (drift[0]) st->drifting++;
+        strcpy(st->last_drift, drift);
+    }
+    printf("%8.0f %10llu %9.0f %6.1f %8.2f %8ld %8u %8u %8u  %s\n", elapsed,
+           (unsigned long long)total, s.rate, s.cpu_pct, s.cpu_us, s.rss_kb,
+           s.p50, s.p99, s.max, drift);
+    fflush(stdout);
+}
+
+// --- Runs ---
+
+enum { SOAK_AUTH, SOAK_JOIN, SOAK_MSGS, SOAK_CLOSING };
+
+// Stdout of the client: REPLY results during the handshake, then the echoes,
+// which must come back in order and under the name the MSG was sent with
+typedef struct {
+    int phase;
+    uint64_t sent, echoed, renames, errors;
+    int gen;                       // display name generation, "Soak<gen>"
+    int64_t sent_ns[SOAK_MAX_WINDOW];
+    int sent_gen[SOAK_MAX_WINDOW];
+    int64_t progress_ns;           // last echo or handshake step
+} soak_run_t;
+
+static void soak_error(soak_run_t *run, const char *what, const char *line) {
+    if (run->errors++ < 10) fprintf(stderr, "soak: %s: %s\n", what, line);
+}
+
+static void soak_output(soak_run_t *run, soak_child_t *child, soak_stats_t *st,
+                        const soak_params_t *p, char *line) {
+    int64_t now = soak_now_ns();
+    if (strncmp(line, "Action Success: ", 16) == 0) {
+        if (run->phase == SOAK_AUTH) {
+            buffer_append_str(&child->tx, "/join soak\n");
+            run->phase = SOAK_JOIN;
+        } else if (run->phase == SOAK_JOIN) {
+            run->phase = SOAK_MSGS;
+        }
+        run->progress_ns = now;
+        return;
+    }
+    if (strncmp(line, "Authorized as ", 14) == 0) return;
+
+    char *sep = strstr(line, ": ");
+    char *end;
+    unsigned long long seq = sep ? strtoull(sep + 2, &end, 10) : 0;
+    if (!sep || *end != '\0' || run->phase < SOAK_MSGS) {
+        soak_error(run, "unexpected output", line);
+        return;
+    }
+    if (seq != run->echoed || run->echoed == run->sent) {
+        soak_error(run, "echo out of order", line);
+        return;
+    }
+    int slot = seq % p->window;
+    char name[32];
+    snprintf(name, sizeof(name), "Soak%d", run->sent_gen[slot]);
+    *sep = '\0';
+    if (strcmp(line, name) != 0) soak_error(run, "echo under a stale name", line);
+    soak_record(st, now - run->sent_ns[slot]);
+    run->echoed++;
+    run->progress_ns = now;
+}
+
+// Tops stdin up to the window, renaming every p->rename_every messages
+static void soak_feed(soak_run_t *run, soak_child_t *child, const soak_params_t *p, bool stop) {
+    if (run->phase != SOAK_MSGS) return;
+    char line[64];
+    while (!stop && run->sent - run->echoed < (uint64_t)p->window &&
+           (p->messages == 0 || run->sent < p->messages)) {
+        if (p->rename_every && run->sent > 0 && run->sent % p->rename_every == 0) {
+            snprintf(line, sizeof(line), "/rename Soak%d\n", ++run->gen);
+            buffer_append_str(&child->tx, line);
+            run->renames++;
+        }
+        int slot = run->sent % p->window;
+        run->sent_ns[slot] = soak_now_ns();
+        run->sent_gen[slot] = run->gen;
+        snprintf(line, sizeof(line), "%llu\n", (unsigned long long)run->sent++);
+        buffer_append_str(&child->tx, line);
+    }
+    bool done = stop || (p->messages > 0 && run->sent == p->messages);
+    if (done && run->echoed == run->sent) {
+        child->closing = true;
+        run->phase = SOAK_CLOSING;
+    }
+}
+
+// One transport: returns 0 when every echo came back, the client exited
+// cleanly and nothing was still drifting at the end
+static int soak_run(const soak_params_t *p) {
+    const char *name = p->udp ? "udp" : "tcp";
+    soak_server_t srv;
+    soak_child_t child;
+    uint16_t port;
+    if (soak_server_open(&srv, p->udp, &port) != 0 || soak_spawn(&child, p, port) != 0)
+        return 1;
+
+    soak_stats_t st = { 0 };
+    soak_run_t run = { .phase = SOAK_AUTH };
+    buffer_append_str(&child.tx, "/auth soak secret Soak0\n");
+
+    printf("%s: client pid %d, stand-in server on 127.0.0.1:%u\n", name, (int)child.pid, port);
+    printf("%8s %10s %9s %6s %8s %8s %8s %8s %8s  %s\n", "time_s", "messages", "msg/s",
+           "cpu%", "us/msg", "rss_kb", "p50_us", "p99_us", "max_us", "drift");
+
+    int64_t start = soak_now_ns(), last = start, closing_at = 0;
+    int64_t interval = (int64_t)p->interval * 1000000000;
+    uint64_t last_echoed = 0, last_ticks = 0;
+    long rss_kb = 0;
+    soak_proc_sample(child.pid, &last_ticks, &rss_kb);
+    run.progress_ns = start;
+    bool exited = false, stalled = false;
+
+    while (!exited) {
+        int64_t now = soak_now_ns();
+        bool stop = p->seconds > 0 && now - start >= (int64_t)p->seconds * 1000000000;
+        soak_feed(&run, &child, p, stop);
+        soak_child_write(&child);
+        if (run.phase == SOAK_CLOSING && closing_at == 0) closing_at = now;
+        if (closing_at && now - closing_at > (int64_t)SOAK_CLOSE_MS * 1000000) break;
+        if (run.phase != SOAK_CLOSING && now - run.progress_ns > (int64_t)SOAK_STALL_MS * 1000000) {
+            fprintf(stderr, "soak: %s: no progress for %d ms, %llu of %llu echoed\n", name,
+                    SOAK_STALL_MS, (unsigned long long)run.echoed, (unsigned long long)run.sent);
+            stalled = true;
+            break;
+        }
+
+        if (now - last >= interval) {
+            uint64_t ticks;
+            if (soak_proc_sample(child.pid, &ticks, &rss_kb)) {
+                soak_sample(&st, p, (now - start) / 1e9, (now - last) / 1e9, run.echoed,
+                            run.echoed - last_echoed, ticks - last_ticks, rss_kb);
+                last_ticks = ticks;
+            }
+            last_echoed = run.echoed;
+            last = now;
+        }
+
+        struct pollfd pfds[3] = {
+            { .fd = srv.conn >= 0 ? srv.conn : srv.fd, .events = POLLIN },
+            { .fd = child.out, .events = POLLIN },
+            { .fd = child.in, .events = child.tx.len > 0 ? POLLOUT : 0 },
+        };
+        int timeout = (int)((last + interval - now) / 1000000) + 1;
+        if (srv.inflight) {
+            int64_t due = srv.resend_at - now / 1000000;
+            if (due < timeout) timeout = due > 0 ? (int)due : 0;
+        }
+        if (poll(pfds, 3, timeout) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+
+        if (pfds[0].revents & (POLLIN | POLLHUP)) {
+            if (srv.udp) soak_udp_receive(&srv);
+            else if (!srv.closed) soak_tcp_receive(&srv);
+        }
+        if (srv.udp) soak_udp_service(&srv);
+        if (pfds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            // EIO once the client is gone and the pty has no writer left
+            if (line_reader_fill(&child.lines, child.out) <= 0) child.lines.eof = exited = true;
+            char *line;
+            size_t len;
+            while ((line = line_reader_next(&child.lines, &len)) != NULL)
+                soak_output(&run, &child, &st, p, line);
+        }
+    }
+
+    // A TCP BYE may still sit in the socket when the pty reports the exit
+    if (!srv.udp && srv.conn >= 0 && !srv.closed) {
+        struct pollfd pfd = { .fd = srv.conn, .events = POLLIN };
+        while (!srv.bye && !srv.closed && poll(&pfd, 1, 100) > 0) soak_tcp_receive(&srv);
+    }
+    int status = soak_reap(&child, !exited);
+
+    double secs = (soak_now_ns() - start) / 1e9;
+    printf("%s: %llu messages in %.1f s (%.0f msg/s), %llu renames, %llu errors, "
+           "client exit %d%s\n", name, (unsigned long long)run.echoed, secs, run.echoed / secs,
+           (unsigned long long)run.renames, (unsigned long long)run.errors, status,
+           srv.bye ? "" : ", no BYE");
+    if (srv.udp)
+        printf("%s: MessageIDs wrapped %llu x (client) / %llu x (server), seen_ids cycled "
+               "%llu x, %llu server retransmissions\n", name,
+               (unsigned long long)srv.client_wraps, (unsigned long long)srv.server_wraps,
+               (unsigned long long)((run.echoed + 2) / MSGID_BUFFER_SIZE),
+               (unsigned long long)srv.retransmits);
+    // A transient spike is reported above; drift still present at the end fails the run
+    if (st.drifting)
+        printf("%s: %d of %d samples drifted, %s\n", name, st.drifting, st.samples,
+               st.last_drift[0] ? st.last_drift : "recovered by the end");
+    else
+        printf("%s: no drift\n", name);
+    printf("\n");
+
+    bool ok = !stalled && status == 0 && srv.bye && run.errors == 0 &&
+              run.echoed == run.sent && srv.msgs == run.sent && !st.last_drift[0];
+    free(st.lat);
+    soak_server_close(&srv);
+    return ok ? 0 : 1;
+}
+
+static void print_usage(void) {
+    fprintf(stderr, "Usage: ipk25chat-soak [OPTIONS] [-- CLIENT_OPTIONS]\n");
+    fprintf(stderr, "  -t <tcp|udp|both>  Transports to soak (default: both)\n");
+    fprintf(stderr, "  -n <count>         MSGs per transport, 0 = until -s (default: 1000000)\n");
+    fprintf(stderr, "  -s <seconds>       Stop each transport after this long (default: off)\n");
+    fprintf(stderr, "  -i <seconds>       Sample interval (default: 5)\n");
+    fprintf(stderr, "  -w <window>        MSGs in flight, at most %d (default: 32)\n", SOAK_MAX_WINDOW);
+    fprintf(stderr, "  -R <count>         Rename every <count> MSGs, 0 = never (default: 1000)\n");
+    fprintf(stderr, "  -x <pct>           Drift tolerance against the baseline (default: 25)\n");
+    fprintf(stderr, "  -c <path>          Client binary (default: ./ipk25chat-client)\n");
+    fprintf(stderr, "  -h                 Print this help\n");
+    fprintf(stderr, "Options after -- are passed to the client.\n");
+}
+
+int main(int argc, char *argv[]) {
+    soak_params_t p = {
+        .messages = 1000000, .interval = 5, .window = 32, .rename_every = 1000,
+        .tolerance = 0.25, .client = "./ipk25chat-client"
+    };
+    const char *transport = "both";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0) {
+            print_usage();
+            return 0;
+        } else if (strcmp(argv[i], "-t") == 0 && (i+1 < argc)) {
+            transport = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && (i+1 < argc)) {
+            p.messages = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && (i+1 < argc)) {
+            p.seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0 && (i+1 < argc)) {
+            p.interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && (i+1 < argc)) {
+            p.window = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-R") == 0 && (i+1 < argc)) {
+            p.rename_every = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-x") == 0 && (i+1 < argc)) {
+            p.tolerance = atoi(argv[++i]) / 100.0;
+        } else if (strcmp(argv[i], "-c") == 0 && (i+1 < argc)) {
+            p.client = argv[++i];
+        } else if (strcmp(argv[i], "--") == 0) {
+            while (++i < argc && p.n_extra < SOAK_MAX_ARGS) p.extra[p.n_extra++] = argv[i];
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    bool tcp = strcmp(transport, "tcp") == 0 || strcmp(transport, "both") == 0;
+    bool udp = strcmp(transport, "udp") == 0 || strcmp(transport, "both") == 0;
+    if (!tcp && !udp) {
+        fprintf(stderr, "Unsupported transport: %s\n", transport);
+        return 1;
+    }
+    if (p.window <= 0 || p.window > SOAK_MAX_WINDOW || p.interval <= 0 ||
+        (p.messages == 0 && p.seconds <= 0)) {
+        fprintf(stderr, "Error: invalid window, interval or limit.\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int rc = 0;
+    if (tcp) rc |= soak_run(&p);
+    if (udp) {
+        p.udp = true;
+        rc |= soak_run(&p);
+    }
+    return rc;
+}
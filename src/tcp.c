@@ -1,27 +1,25 @@
+#define _DEFAULT_SOURCE  // struct tcp_info
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <errno.h>
 #include <poll.h>
 #include <signal.h>
-#include <stdarg.h>
+#include <fcntl.h>
 
 #include "tcp.h"
 #include "utils.h"
 #include "client.h"
-
-// Debug print function, only enabled when DEBUG_PRINT is defined
-static void debug(const char *fmt, ...) {
-#ifdef DEBUG_PRINT
-    va_list args;
-    va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
-    va_end(args);
-#endif
-}
+#include "validate.h"
+#include "buffer.h"
+#include "transcript.h"
+#include "pacer.h"
+#include "shmring.h"
 
 // Global flag for graceful TCP shutdown on SIGINT
 volatile sig_atomic_t terminate_tcp = 0;
@@ -32,126 +30,454 @@ void handle_sigint_tcp(int signo) {
     terminate_tcp = 1;
 }
 
-// Parses a line received from the server and fills a tcp_message_t struct
+// Copies a decoded field into a fixed-size member (sized for the field's maximum)
+static void tcp_copy_field(char *dst, ipk_text_t field)
+{
+    if (field.len) memcpy(dst, field.ptr, field.len);
+    dst[field.len] = '\0';
+}
+
+// Parses a line received from the server and fills a tcp_message_t struct.
+// The grammar and the field checks come from the message schema (schema.h).
 bool tcp_parse_line(const char *line, tcp_message_t *msg)
 {
-    memset(msg, 0, sizeof(*msg));
+    ipk_msg_t m;
     msg->type = TCP_MSG_UNKNOWN;
+    if (!ipk_tcp_decode(line, &m)) return false;
 
-    if (strncmp(line, "ERR FROM ", 9) == 0) {
-        msg->type = TCP_MSG_ERR;
-        const char *p = line + 9;
-        const char *isPtr = strstr(p, " IS ");
-        if (!isPtr) return false;
-        size_t dlen = isPtr - p;
-        if (dlen >= sizeof(msg->displayName)) dlen = sizeof(msg->displayName) - 1;
-        memcpy(msg->displayName, p, dlen);
-        const char *cPtr = isPtr + 4;
-        if (strlen(cPtr) >= sizeof(msg->content)) return false;
-        strcpy(msg->content, cPtr);
-        return true;
-    } else if (strncmp(line, "BYE FROM ", 9) == 0) {
-        msg->type = TCP_MSG_BYE;
-        const char *p = line + 9;
-        if (strlen(p) >= sizeof(msg->displayName)) return false;
-        strcpy(msg->displayName, p);
-        return true;
-    } else if (strncmp(line, "REPLY ", 6) == 0) {
-        msg->type = TCP_MSG_REPLY;
-        const char *p = line + 6;
-        if (strncmp(p, "OK IS ", 6) == 0) {
-            msg->replyOk = 1;
-            const char *cPtr = p + 6;
-            if (strlen(cPtr) >= sizeof(msg->content)) return false;
-            strcpy(msg->content, cPtr);
-            return true;
-        } else if (strncmp(p, "NOK IS ", 7) == 0) {
-            msg->replyOk = 0;
-            const char *cPtr = p + 7;
-            if (strlen(cPtr) >= sizeof(msg->content)) return false;
-            strcpy(msg->content, cPtr);
-            return true;
-        } else {
-            return false;
+    msg->type = (tcp_msg_type_e)m.type;
+    msg->replyOk = m.result;
+    // The content runs to the end of the line, so it stays NUL-terminated in place
+    msg->content = m.content.ptr ? m.content.ptr : "";
+    msg->contentLen = m.content.len;
+    tcp_copy_field(msg->displayName, m.display);
+    tcp_copy_field(msg->username, m.username);
+    tcp_copy_field(msg->secret, m.secret);
+    tcp_copy_field(msg->channel, m.channel);
+    return true;
+}
+
+// Takes a pacer token for a line just sent and feeds the kernel's
+// retransmission counter back into the pacing rate
+static void tcp_pace_sent(tcp_client_t *client)
+{
+    pacer_consume(&client->pacer);
+    if (!pacer_enabled(&client->pacer)) return;
+
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(client->sock, IPPROTO_TCP, TCP_INFO, &info, &len) != 0) return;
+    if (info.tcpi_total_retrans > client->retransSeen) {
+        client->retransSeen = info.tcpi_total_retrans;
+        pacer_on_retransmit(&client->pacer);
+    } else {
+        pacer_on_delivered(&client->pacer);
+    }
+}
+
+// Appends a record to the transcript, if one is open
+static void tcp_log(tcp_client_t *client, uint8_t direction, uint8_t type, uint8_t flags,
+                    const char *channel, const char *displayName,
+                    const char *content, size_t len)
+{
+    if (!client->transcript) return;
+    transcript_entry_t e = {
+        .transport    = TRANSCRIPT_TCP,
+        .direction    = direction,
+        .type         = type,
+        .flags        = flags,
+        .channel      = channel ? channel : client->channel,
+        .display_name = displayName,
+        .content      = content,
+        .content_len  = len
+    };
+    transcript_log(client->transcript, &e);
+}
+
+// --- /sendfile ---
+// File chunks go out as fast as the socket takes them: each is encoded once
+// and written without blocking, POLLOUT resumes a partial write and the
+// kernel's send buffer is the window. A line only partly written is completed
+// before anything else is sent, so no other message lands inside it.
+
+// Writes what the socket takes of the chunk being sent. Returns false while part of it is left.
+static bool tcp_stream_write(tcp_client_t *client)
+{
+    buffer_t *s = &client->stream;
+    while (client->streamOff < s->len) {
+        ssize_t n = send(client->sock, s->data + client->streamOff, s->len - client->streamOff,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;  // full, or an error the receiving side notices
         }
-    } else if (strncmp(line, "MSG FROM ", 9) == 0) {
-        msg->type = TCP_MSG_MSG;
-        const char *p = line + 9;
-        const char *isPtr = strstr(p, " IS ");
-        if (!isPtr) return false;
-        size_t dlen = isPtr - p;
-        if (dlen >= sizeof(msg->displayName)) dlen = sizeof(msg->displayName) - 1;
-        memcpy(msg->displayName, p, dlen);
-        const char *cPtr = isPtr + 4;
-        if (strlen(cPtr) >= sizeof(msg->content)) return false;
-        strcpy(msg->content, cPtr);
-        return true;
-    } else if (strncmp(line, "AUTH ", 5) == 0) {
-        msg->type = TCP_MSG_AUTH;
-        return true;
-    } else if (strncmp(line, "JOIN ", 5) == 0) {
-        msg->type = TCP_MSG_JOIN;
-        return true;
+        client->streamOff += n;
     }
+    buffer_clear(s);
+    client->streamOff = 0;
+    return true;
+}
 
-    return false;
+// Finishes a partly written chunk, waiting for the socket if need be
+static void tcp_stream_complete(tcp_client_t *client)
+{
+    buffer_t *s = &client->stream;
+    if (s->len > client->streamOff && client->sock >= 0)
+        send_all(client->sock, s->data + client->streamOff, s->len - client->streamOff);
+    buffer_clear(s);
+    client->streamOff = 0;
 }
 
-// Handles a parsed message from the server and updates client state accordingly
-static void process_server_line(tcp_client_t *client, const char *line)
+// Stops a transfer the session can no longer carry
+static void tcp_stream_abort(tcp_client_t *client, const char *reason)
 {
-    tcp_message_t msg;
-    memset(&msg, 0, sizeof(msg));
-    if (!tcp_parse_line(line, &msg)) {
-        fprintf(stderr, "Protocol error. Received malformed line: %s\n", line);
-        char errBuf[256];
-        snprintf(errBuf, sizeof(errBuf), "ERR FROM %s IS Protocol parse error\r\n", client->displayName);
-        send(client->sock, errBuf, strlen(errBuf), 0);
-        client->state = CLIENT_END;
+    if (!filesend_active(&client->file)) return;
+    filesend_abort(&client->file, reason);
+    buffer_clear(&client->stream);
+    client->streamOff = 0;
+}
+
+// Builds "{MSG|ERR} FROM <displayName> IS <content>\r\n" in the client's send buffer and sends it
+static void tcp_send_from(tcp_client_t *client, uint8_t type, const char *content, size_t len)
+{
+    tcp_stream_complete(client);
+    ipk_msg_t m = { .display = ipk_text(client->displayName), .content = { content, len } };
+    buffer_t *tx = &client->tx;
+    buffer_clear(tx);
+    bool ok = type == TRANSCRIPT_MSG ? ipk_tcp_encode_MSG(&m, tx) : ipk_tcp_encode_ERR(&m, tx);
+    if (!ok) {
+        fprintf(stderr, "ERROR: out of memory\n");
         return;
     }
+    uint64_t t_send = trace_now();
+    send_all(client->sock, tx->data, tx->len);
+    trace_span("tcp.send", t_send, TRACE_NO_ID);
+    tcp_pace_sent(client);
+    tcp_log(client, TRANSCRIPT_TX, type, 0, NULL, client->displayName, content, len);
+}
 
-    switch (msg.type) {
-        case TCP_MSG_ERR:
-            fprintf(stdout, "ERROR FROM %s: %s\n", msg.displayName, msg.content);
-            client->state = CLIENT_END;
-            client->waitingForReply = 0;
-            break;
-        case TCP_MSG_BYE:
-            fprintf(stderr, "Received BYE from %s\n", msg.displayName);
-            client->state = CLIENT_END;
-            client->waitingForReply = 0;
-            break;
-        case TCP_MSG_REPLY:
-            if (msg.replyOk) {
-                fprintf(stdout, "Action Success: %s\n", msg.content);
-                if (client->state == CLIENT_CLOSED || client->state == CLIENT_AUTH)
-                    client->state = CLIENT_OPEN;
+// Sends a chat message of any size up to the protocol limit
+static void tcp_send_msg(tcp_client_t *client, const char *content, size_t len)
+{
+    tcp_send_from(client, TRANSCRIPT_MSG, content, len);
+}
+
+// Sends an ERR message to the server
+static void tcp_send_err(tcp_client_t *client, const char *content)
+{
+    tcp_send_from(client, TRANSCRIPT_ERR, content, strlen(content));
+}
+
+// Sends BYE to the server
+static void tcp_send_bye(tcp_client_t *client)
+{
+    ipk_msg_t m = { .display = ipk_text(client->displayName) };
+    tcp_stream_complete(client);
+    buffer_clear(&client->tx);
+    ipk_tcp_encode_BYE(&m, &client->tx);
+    send_all(client->sock, client->tx.data, client->tx.len);
+    tcp_log(client, TRANSCRIPT_TX, TRANSCRIPT_BYE, 0, NULL, client->displayName, NULL, 0);
+}
+
+// Publishes a server message to the shared-memory ring (-O)
+static void tcp_publish(const tcp_client_t *client, uint8_t type, const tcp_message_t *msg)
+{
+    if (!shmring_enabled() || !msg) return;
+    uint8_t flags = type == IPK_RING_REPLY && msg->replyOk ? IPK_RING_F_OK : 0;
+    shmring_publish(type, flags, IPK_RING_TCP, msg->displayName, strlen(msg->displayName),
+                    client->channel, strlen(client->channel), msg->content, msg->contentLen);
+}
+
+static void tcp_resume_reply(tcp_client_t *client, fsm_state_e prev, const tcp_message_t *msg);
+static void tcp_login_reply(tcp_client_t *client, fsm_state_e prev, bool ok);
+static void tcp_join(tcp_client_t *client, const char *channel);
+
+// Feeds an event through the shared state machine and performs the resulting
+// action. 'msg' is the server message behind an RX event; 'err' is the ERR
+// content sent if the event turns out to be a protocol error.
+static void tcp_event(tcp_client_t *client, fsm_event_e event, const tcp_message_t *msg,
+                      const char *err)
+{
+    fsm_state_e prev = client->state;
+    fsm_action_e action = fsm_step(&client->state, event);
+    uint64_t t_out = trace_now();
+
+    switch (action) {
+        case FSM_ACT_REPLY:
+            trace_span("tcp.await_reply", client->replyWaitStart, TRACE_NO_ID);
+            if (resume_active(&client->resume)) {
+                tcp_resume_reply(client, prev, msg);
+                break;
+            }
+            if (msg->replyOk) {
+                fprintf(stdout, "Action Success: %s\n", msg->content);
+                if (prev == FSM_JOIN)
+                    strcpy(client->channel, client->joining);
             } else {
-                fprintf(stdout, "Action Failure: %s\n", msg.content);
+                fprintf(stdout, "Action Failure: %s\n", msg->content);
             }
-            client->waitingForReply = 0;
+            client->joining[0] = '\0';
+            tcp_publish(client, IPK_RING_REPLY, msg);
+            if (client->loginPending) tcp_login_reply(client, prev, msg->replyOk);
+            trace_span("output", t_out, TRACE_NO_ID);
+            break;
+        case FSM_ACT_DELIVER:
+            if (shmring_enabled())
+                tcp_publish(client, IPK_RING_MSG, msg);
+            else
+                fprintf(stdout, "%s: %s\n", msg->displayName, msg->content);
+            trace_span("output", t_out, TRACE_NO_ID);
+            break;
+        case FSM_ACT_REMOTE_ERR:
+            fprintf(stdout, "ERROR FROM %s: %s\n", msg->displayName, msg->content);
+            tcp_publish(client, IPK_RING_ERR, msg);
+            tcp_send_bye(client);
             break;
-        case TCP_MSG_MSG:
-            fprintf(stdout, "%s: %s\n", msg.displayName, msg.content);
+        case FSM_ACT_ERR_BYE:
+            tcp_send_err(client, err);
+            tcp_send_bye(client);
+            break;
+        case FSM_ACT_BYE:
+            tcp_send_bye(client);
+            break;
+        case FSM_ACT_FINISH:
+            if (msg) fprintf(stderr, "Received BYE from %s\n", msg->displayName);
+            tcp_publish(client, IPK_RING_BYE, msg);
             break;
         default:
             break;
     }
 }
 
-// Sends a line to the server and optionally sets waitingForReply flag
-static void send_line(tcp_client_t *client, const char *line)
+// --- Session resume (-K) ---
+
+// Options every connection to the server gets
+static void tcp_socket_options(tcp_client_t *client)
+{
+    // Kernel RX times of the segments read, for the latency report
+    int on = 1;
+    setsockopt(client->sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+    lowlat_socket(&client->lowlat, client->sock, true);
+}
+
+// The connection is gone. Schedules a resume and returns true, or returns
+// false when the session ends as usual.
+static bool tcp_resume_lost(tcp_client_t *client)
+{
+    bool resuming = resume_active(&client->resume);
+    if (!resuming && client->state != FSM_OPEN && client->state != FSM_JOIN) return false;
+    if (!resume_lost(&client->resume)) return false;
+    if (!resuming && client->state == FSM_JOIN)
+        fprintf(stdout, "ERROR: JOIN interrupted by the lost connection.\n");
+    tcp_stream_abort(client, "connection lost");
+    client->loginPending = false;
+    if (client->sock >= 0) close(client->sock);
+    client->sock = -1;
+    client->connecting = false;
+    client->joining[0] = '\0';
+    fsm_step(&client->state, FSM_EV_RESUME);
+    return true;
+}
+
+// Ends the session after an attempt failed and the resume window ran out
+static void tcp_resume_failed(tcp_client_t *client)
+{
+    if (tcp_resume_lost(client)) return;
+    fprintf(stdout, "ERROR: Could not resume the session.\n");
+    tcp_event(client, FSM_EV_CLOSED, NULL, NULL);
+}
+
+// The new connection is up: replays the AUTH. The state machine already
+// waits for its REPLY; the channel is re-joined once the REPLY accepts it.
+static void tcp_resume_auth(tcp_client_t *client)
+{
+    client->connecting = false;
+    int flags = fcntl(client->sock, F_GETFL);
+    fcntl(client->sock, F_SETFL, flags & ~O_NONBLOCK);
+    tcp_socket_options(client);
+    line_reader_free(&client->rx);
+    line_reader_init(&client->rx, "\r\n", TCP_MAX_LINE_LEN);
+
+    ipk_msg_t auth = {
+        .username = ipk_text(client->username),
+        .display = ipk_text(client->displayName),
+        .secret = ipk_text(client->secret)
+    };
+    buffer_t *tx = &client->tx;
+    buffer_clear(tx);
+    ipk_tcp_encode_AUTH(&auth, tx);
+    if (send_all(client->sock, tx->data, tx->len) != 0) {
+        tcp_resume_failed(client);
+        return;
+    }
+    client->replyWaitStart = trace_now();
+}
+
+// A resume attempt is due: connects in the background, the poll loop sees it through
+static void tcp_resume_connect(tcp_client_t *client)
+{
+    client->sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (client->sock < 0 || fcntl(client->sock, F_SETFL, O_NONBLOCK) != 0) {
+        tcp_resume_failed(client);
+        return;
+    }
+    if (connect(client->sock, (struct sockaddr *)&client->server, sizeof(client->server)) == 0) {
+        tcp_resume_auth(client);
+    } else if (errno == EINPROGRESS) {
+        client->connecting = true;
+    } else {
+        tcp_resume_failed(client);
+    }
+}
+
+// The background connect finished, one way or the other
+static void tcp_resume_connected(tcp_client_t *client)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(client->sock, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0)
+        tcp_resume_failed(client);
+    else
+        tcp_resume_auth(client);
+}
+
+// REPLY to a replayed AUTH or JOIN
+static void tcp_resume_reply(tcp_client_t *client, fsm_state_e prev, const tcp_message_t *msg)
+{
+    if (prev == FSM_AUTH && !msg->replyOk) {
+        // The identity is no longer accepted: nothing to resume
+        fprintf(stdout, "Action Failure: %s\n", msg->content);
+        client->resume.phase = RESUME_IDLE;
+        tcp_event(client, FSM_EV_CMD_BYE, NULL, NULL);
+        return;
+    }
+    if (prev == FSM_AUTH && client->channel[0]) {
+        tcp_join(client, client->channel);
+        client->resume.phase = RESUME_JOIN;
+        return;
+    }
+    if (prev == FSM_JOIN && !msg->replyOk) {
+        fprintf(stdout, "Action Failure: %s\n", msg->content);
+        client->channel[0] = '\0';
+    }
+    client->joining[0] = '\0';
+    resume_done(&client->resume);
+}
+
+// Translates a line from the server into a state machine event
+static void process_server_line(tcp_client_t *client, const char *line)
 {
-    if (client->waitingForReply) {
-        fprintf(stderr, "ERROR: still waiting for previous request to complete.\n");
+    tcp_message_t msg;
+    uint64_t t_parse = trace_now();
+    bool parsed = tcp_parse_line(line, &msg);
+    trace_span("tcp.parse", t_parse, TRACE_NO_ID);
+    if (!parsed) {
+        fprintf(stderr, "Protocol error. Received malformed line: %s\n", line);
+        tcp_event(client, FSM_EV_RX_INVALID, NULL, "Protocol parse error");
         return;
     }
-    send(client->sock, line, strlen(line), 0);
-    if (strncmp(line, "AUTH ", 5) == 0 ||
-        strncmp(line, "JOIN ", 5) == 0) {
-        client->waitingForReply = 1;
+
+    tcp_log(client, TRANSCRIPT_RX, msg.type,
+            msg.replyOk ? TRANSCRIPT_F_REPLY_OK : 0, NULL,
+            msg.displayName, msg.content, msg.contentLen);
+
+    fsm_event_e event;
+    switch (msg.type) {
+        case TCP_MSG_ERR:   event = FSM_EV_RX_ERR; break;
+        case TCP_MSG_BYE:   event = FSM_EV_RX_BYE; break;
+        case TCP_MSG_MSG:   event = FSM_EV_RX_MSG; break;
+        case TCP_MSG_REPLY: event = msg.replyOk ? FSM_EV_RX_REPLY_OK : FSM_EV_RX_REPLY_NOK; break;
+        default:            event = FSM_EV_RX_INVALID; break;
+    }
+    tcp_event(client, event, &msg, "Unexpected message");
+}
+
+// Checks a user command against the state machine. Fills in the transition to
+// take once the command is sent, or prints why it is refused and returns false.
+static bool tcp_admit(tcp_client_t *client, fsm_event_e event, fsm_transition_t *t)
+{
+    *t = fsm_lookup(client->state, event);
+    if (t->action == FSM_ACT_BUSY) {
+        fprintf(stdout, "ERROR: waiting for previous request.\n");
+        return false;
     }
+    if (t->action == FSM_ACT_DENY) {
+        fprintf(stdout, event == FSM_EV_CMD_AUTH ? "ERROR: already authenticated.\n"
+                                                 : "ERROR: not in OPEN state.\n");
+        return false;
+    }
+    return true;
+}
+
+// Sends the AUTH or JOIN line in the send buffer and starts waiting for its REPLY
+static void send_line(tcp_client_t *client)
+{
+    tcp_stream_complete(client);
+    uint64_t t_send = trace_now();
+    send_all(client->sock, client->tx.data, client->tx.len);
+    trace_span("tcp.send", t_send, TRACE_NO_ID);
+    tcp_pace_sent(client);
+    client->replyWaitStart = t_send;
+}
+
+// Sends a JOIN of the channel and waits for its REPLY
+static void tcp_join(tcp_client_t *client, const char *channel)
+{
+    ipk_msg_t m = { .channel = ipk_text(channel), .display = ipk_text(client->displayName) };
+    buffer_clear(&client->tx);
+    ipk_tcp_encode_JOIN(&m, &client->tx);
+    send_line(client);
+    strcpy(client->joining, channel);
+    tcp_log(client, TRANSCRIPT_TX, TRANSCRIPT_JOIN, 0, channel, client->displayName, NULL, 0);
+    fsm_step(&client->state, FSM_EV_CMD_JOIN);
+}
+
+// --- Non-interactive start (-U) ---
+
+// Sends the JOIN of the next channel on the startup list
+static void tcp_login_join(tcp_client_t *client)
+{
+    tcp_join(client, client->login->channels[client->loginNext++]);
+}
+
+// Authenticates as soon as the connection is up. The first channel is joined
+// once the AUTH REPLY accepts the client; stdin waits until both are answered.
+static void tcp_login_start(tcp_client_t *client, const client_config_t *cfg)
+{
+    client->login = cfg;
+    client->loginPending = true;
+    strcpy(client->username, cfg->username);
+    strcpy(client->secret, cfg->secret);
+    strcpy(client->displayName, cfg->display_name);
+
+    ipk_msg_t auth = {
+        .username = ipk_text(client->username),
+        .display = ipk_text(client->displayName),
+        .secret = ipk_text(client->secret)
+    };
+    buffer_clear(&client->tx);
+    ipk_tcp_encode_AUTH(&auth, &client->tx);
+    send_line(client);
+    tcp_log(client, TRANSCRIPT_TX, TRANSCRIPT_AUTH, 0, NULL, client->displayName,
+            client->username, strlen(client->username));
+    fsm_step(&client->state, FSM_EV_CMD_AUTH);
+}
+
+// REPLY during the non-interactive start. A refused AUTH ends the session;
+// an accepted AUTH or a refused channel is followed by the next channel.
+static void tcp_login_reply(tcp_client_t *client, fsm_state_e prev, bool ok)
+{
+    const client_config_t *cfg = client->login;
+    if (prev == FSM_AUTH && !ok) {
+        client->loginPending = false;
+        tcp_event(client, FSM_EV_CMD_BYE, NULL, NULL);
+        return;
+    }
+    if (!(prev == FSM_JOIN && ok) && client->loginNext < cfg->channel_count) {
+        tcp_login_join(client);
+        return;
+    }
+    client->loginPending = false;
 }
 
 // Handles user input that begins with '/'
@@ -175,49 +501,128 @@ static void process_local_command(tcp_client_t *client, const char *cmdLine)
         fprintf(stdout, "  /auth <user> <secret> <display>\n");
         fprintf(stdout, "  /join <channel>\n");
         fprintf(stdout, "  /rename <newDisplayName>\n");
+        fprintf(stdout, "  /sendfile <path>\n");
         fprintf(stdout, "  /help\n");
     } else if (strcmp(tokens[0], "/auth") == 0) {
         if (count < 4) {
             fprintf(stdout, "ERROR: Usage: /auth user secret displayName\n");
             return;
         }
+        fsm_transition_t t;
+        if (!tcp_admit(client, FSM_EV_CMD_AUTH, &t)) return;
+        if (!validate_outgoing(FIELD_USERNAME, tokens[1]) ||
+            !validate_outgoing(FIELD_SECRET, tokens[2]) ||
+            !validate_outgoing(FIELD_DISPLAY_NAME, tokens[3]))
+            return;
         strcpy(client->username, tokens[1]);
         strcpy(client->secret, tokens[2]);
         strcpy(client->displayName, tokens[3]);
-        char line[512];
-        snprintf(line, sizeof(line), "AUTH %s AS %s USING %s\r\n",
-                 client->username, client->displayName, client->secret);
-        send_line(client, line);
-        client->state = CLIENT_AUTH;
+        ipk_msg_t m = {
+            .username = ipk_text(client->username),
+            .display = ipk_text(client->displayName),
+            .secret = ipk_text(client->secret)
+        };
+        buffer_clear(&client->tx);
+        ipk_tcp_encode_AUTH(&m, &client->tx);
+        send_line(client);
+        tcp_log(client, TRANSCRIPT_TX, TRANSCRIPT_AUTH, 0, NULL, client->displayName,
+                client->username, strlen(client->username));
+        client->state = t.next;
     } else if (strcmp(tokens[0], "/join") == 0) {
         if (count < 2) {
             fprintf(stdout, "ERROR: Usage: /join channel\n");
             return;
         }
-        if (client->state != CLIENT_OPEN) {
-            fprintf(stdout, "ERROR: not in OPEN state.\n");
-            return;
-        }
-        char line[512];
-        snprintf(line, sizeof(line), "JOIN %s AS %s\r\n",
-                 tokens[1], client->displayName);
-        send_line(client, line);
+        fsm_transition_t t;
+        if (!tcp_admit(client, FSM_EV_CMD_JOIN, &t)) return;
+        if (!validate_outgoing(FIELD_CHANNEL, tokens[1])) return;
+        tcp_join(client, tokens[1]);
     } else if (strcmp(tokens[0], "/rename") == 0) {
         if (count < 2) {
             fprintf(stdout, "ERROR: Usage: /rename newName\n");
             return;
         }
+        if (!validate_outgoing(FIELD_DISPLAY_NAME, tokens[1])) return;
         strcpy(client->displayName, tokens[1]);
-        debug("Renamed locally to: %s\n", client->displayName);
+        BLOG_BLOB(LOG_RENAMED, client->displayName, strlen(client->displayName));
+    } else if (strcmp(tokens[0], "/sendfile") == 0) {
+        if (count < 2) {
+            fprintf(stdout, "ERROR: Usage: /sendfile path\n");
+            return;
+        }
+        if (filesend_active(&client->file)) {
+            fprintf(stdout, "ERROR: A file is already being sent.\n");
+            return;
+        }
+        fsm_transition_t t;
+        if (!tcp_admit(client, FSM_EV_CMD_MSG, &t)) return;
+        // The path is the rest of the line, spaces inside it included
+        const char *path = cmdLine + strlen("/sendfile");
+        filesend_open(&client->file, path + strspn(path, " "));
     } else {
         fprintf(stdout, "ERROR: Unknown command: %s\n", tokens[0]);
     }
 }
 
+// Handles buffered user input lines for as long as the pacer allows; they wait
+// while the startup AUTH and JOIN are answered
+static void tcp_drain_input(tcp_client_t *client)
+{
+    char *inputBuf;
+    size_t len;
+    fsm_transition_t t;
+    while (client->state != FSM_END && !client->loginPending &&
+           pacer_delay_ms(&client->pacer) == 0 &&
+           (inputBuf = line_reader_next(&client->input, &len)) != NULL) {
+        if (inputBuf[0] == '/') {
+            process_local_command(client, inputBuf);
+        } else if (tcp_admit(client, FSM_EV_CMD_MSG, &t) &&
+                   validate_outgoing(FIELD_CONTENT, inputBuf)) {
+            tcp_send_msg(client, inputBuf, len);
+        }
+    }
+    if (client->input.overflow) {
+        fprintf(stdout, "ERROR: Message longer than %d characters.\n", IPK_MAX_CONTENT_LEN);
+        client->input.overflow = false;
+    }
+}
+
+// Sends file chunks while the socket takes them, the state machine allows MSG
+// and the pacer has tokens. Chunks wait while a REPLY is outstanding.
+static void tcp_stream_pump(tcp_client_t *client)
+{
+    static char chunk[IPK_MAX_CONTENT_LEN];
+    filesend_t *file = &client->file;
+    while (filesend_active(file) && tcp_stream_write(client)) {
+        if (filesend_eof(file)) {
+            filesend_finish(file);
+            return;
+        }
+        fsm_action_e action = fsm_lookup(client->state, FSM_EV_CMD_MSG).action;
+        if (action == FSM_ACT_DENY) {
+            tcp_stream_abort(client, "session not open");
+            return;
+        }
+        if (action == FSM_ACT_BUSY || pacer_delay_ms(&client->pacer) > 0) break;
+
+        size_t len = filesend_next(file, chunk);
+        if (len == 0) continue;
+        ipk_msg_t m = { .display = ipk_text(client->displayName), .content = { chunk, len } };
+        if (!ipk_tcp_encode_MSG(&m, &client->stream)) {
+            tcp_stream_abort(client, "out of memory");
+            return;
+        }
+        tcp_pace_sent(client);
+        tcp_log(client, TRANSCRIPT_TX, TRANSCRIPT_MSG, 0, NULL, client->displayName, chunk, len);
+    }
+    if (filesend_active(file)) filesend_progress(file);
+}
+
 // Main TCP client routine that connects to the server, handles user input and server responses.
 int tcp_run(const client_config_t *cfg)
 {
     tcp_client_t client;
+    transcript_t transcript;
 
     client.sock = socket(AF_INET, SOCK_STREAM, 0);
     if (client.sock < 0) {
@@ -244,12 +649,42 @@ int tcp_run(const client_config_t *cfg)
         return 1;
     }
 
-    debug("TCP connected to %s:%d\n", cfg->server, cfg->port);
+    BLOG_BLOB(LOG_TCP_CONNECTED, cfg->server, strlen(cfg->server), cfg->port);
+
+    if (lowlat_init(&client.lowlat, cfg->lowlat_spin_us, cfg->cpu) != 0) {
+        close(client.sock);
+        return 1;
+    }
+    tcp_socket_options(&client);
+    client.server = srv;
+    client.connecting = false;
+    resume_init(&client.resume, cfg->resume_ms);
+
+    client.transcript = NULL;
+    if (cfg->transcript[0]) {
+        if (transcript_open(&transcript, cfg->transcript) != 0) {
+            close(client.sock);
+            return 1;
+        }
+        client.transcript = &transcript;
+    }
 
-    client.state = CLIENT_CLOSED;
+    client.state = FSM_START;
     strcpy(client.displayName, "UserTCP");
-    client.waitingForReply = 0;
-    client.lineLen = 0;
+    client.channel[0] = '\0';
+    client.joining[0] = '\0';
+    client.retransSeen = 0;
+    pacer_init(&client.pacer, cfg->pace_rate, cfg->pace_burst);
+    line_reader_init(&client.rx, "\r\n", TCP_MAX_LINE_LEN);
+    line_reader_init(&client.input, "\n", IPK_MAX_CONTENT_LEN);
+    buffer_init(&client.tx);
+    filesend_init(&client.file);
+    buffer_init(&client.stream);
+    client.streamOff = 0;
+    client.login = NULL;
+    client.loginNext = 0;
+    client.loginPending = false;
+    if (cfg->username[0]) tcp_login_start(&client, cfg);
 
     struct pollfd fds[2];
     fds[0].fd = client.sock;
@@ -257,80 +692,96 @@ int tcp_run(const client_config_t *cfg)
     fds[1].fd = STDIN_FILENO;
     fds[1].events = POLLIN;
 
-    while (client.state != CLIENT_END) {
+    while (client.state != FSM_END) {
         if (terminate_tcp) {
             fprintf(stderr, "Received SIGINT. Exiting...\n");
+            tcp_event(&client, FSM_EV_CMD_BYE, NULL, NULL);
             break;
         }
 
-        int ret = poll(fds, 2, -1);
+        if (client.state != FSM_END && resume_due(&client.resume))
+            tcp_resume_connect(&client);
+        if (client.state == FSM_END) break;
+        fds[0].fd = client.sock;
+        fds[0].events = client.connecting ? POLLOUT : POLLIN;
+        // A chunk the socket did not take at once goes on when there is room
+        if (!client.connecting && client.stream.len > 0) fds[0].events |= POLLOUT;
+
+        // Lines held back by the pacer, or while the session resumes, stay in
+        // the input buffer; stdin is not read further until they are sent,
+        // which pushes back on the producer
+        bool resuming = resume_active(&client.resume);
+        bool backlog = line_reader_pending(&client.input);
+        fds[1].fd = (backlog || client.input.eof) ? -1 : STDIN_FILENO;  // -1: poll() skips it
+        bool streaming = filesend_active(&client.file) && client.stream.len == 0 &&
+                         fsm_lookup(client.state, FSM_EV_CMD_MSG).action == FSM_ACT_SEND;
+        bool paced = ((backlog && !client.loginPending) || streaming) && !resuming;
+        int timeout = paced ? (int)pacer_delay_ms(&client.pacer) : -1;
+        int resume_in = resume_timeout(&client.resume);
+        if (resume_in >= 0 && (timeout < 0 || resume_in < timeout)) timeout = resume_in;
+
+        int ret = lowlat_poll(&client.lowlat, fds, 2, timeout);
         if (ret < 0) {
             if (errno == EINTR) continue;
             perror("poll");
             break;
         }
 
-        // Handle incoming data from server
-        if (fds[0].revents & POLLIN) {
-            int n = recv(client.sock, client.lineBuf + client.lineLen,
-                         sizeof(client.lineBuf) - client.lineLen - 1, 0);
+        if (client.connecting) {
+            if (fds[0].revents & (POLLOUT | POLLERR | POLLHUP)) tcp_resume_connected(&client);
+        } else if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            // Handle incoming data from server
+            int64_t stamp;
+            ssize_t n = line_reader_recv(&client.rx, client.sock, &stamp);
+            lowlat_sample(&client.lowlat, stamp);
+            lowlat_rearm(&client.lowlat, client.sock);
             if (n <= 0) {
-                debug("Server closed or error.\n");
+                BLOG(LOG_TCP_SERVER_CLOSED);
+                if (tcp_resume_lost(&client)) continue;
+                tcp_event(&client, FSM_EV_CLOSED, NULL, NULL);
                 break;
             }
-            client.lineLen += n;
-            client.lineBuf[client.lineLen] = 0;
-
-            char *start = client.lineBuf;
-            while (1) {
-                char *crlf = strstr(start, "\r\n");
-                if (!crlf) break;
-                *crlf = 0;
-                process_server_line(&client, start);
-                crlf += 2;
-                start = crlf;
-            }
 
-            int leftover = client.lineBuf + client.lineLen - start;
-            memmove(client.lineBuf, start, leftover);
-            client.lineLen = leftover;
+            char *line;
+            size_t len;
+            while (client.state != FSM_END &&
+                   (line = line_reader_next(&client.rx, &len)) != NULL) {
+                process_server_line(&client, line);
+            }
+            if (client.rx.overflow) {
+                fprintf(stderr, "Protocol error. Received line longer than %d bytes\n", TCP_MAX_LINE_LEN);
+                tcp_event(&client, FSM_EV_RX_INVALID, NULL, "Protocol parse error");
+            }
         }
 
         // Handle user input from stdin
-        if (fds[1].revents & POLLIN) {
-            char inputBuf[1024];
-            if (!fgets(inputBuf, sizeof(inputBuf), stdin)) {
-                debug("EOF on stdin.\n");
+        if (fds[1].revents & (POLLIN | POLLHUP)) {
+            if (line_reader_fill(&client.input, STDIN_FILENO) < 0) {
+                perror("read");
                 break;
             }
-            int l = strlen(inputBuf);
-            if (l > 0 && inputBuf[l - 1] == '\n') inputBuf[l - 1] = 0;
-
-            if (inputBuf[0] == '/') {
-                process_local_command(&client, inputBuf);
-            } else {
-                if (client.state != CLIENT_OPEN) {
-                    fprintf(stdout, "ERROR: not in OPEN state.\n");
-                } else if (client.waitingForReply) {
-                    fprintf(stdout, "ERROR: waiting for previous request.\n");
-                } else {
-                    char sendbuf[2048];
-                    snprintf(sendbuf, sizeof(sendbuf),
-                             "MSG FROM %s IS %s\r\n",
-                             client.displayName, inputBuf);
-                    send(client.sock, sendbuf, strlen(sendbuf), 0);
-                }
-            }
+        }
+        if (resume_active(&client.resume)) continue;
+        tcp_drain_input(&client);
+        tcp_stream_pump(&client);
+        if (client.input.eof && !line_reader_pending(&client.input) &&
+            !filesend_active(&client.file) && !client.loginPending) {
+            BLOG(LOG_STDIN_EOF);
+            tcp_event(&client, FSM_EV_CMD_BYE, NULL, NULL);
         }
     }
 
-    // Send BYE message before closing connection
-    if (client.state != CLIENT_END) {
-        char byeLine[128];
-        snprintf(byeLine, sizeof(byeLine), "BYE FROM %s\r\n", client.displayName);
-        send(client.sock, byeLine, strlen(byeLine), 0);
-    }
+    // Still running after a local error: BYE before closing the connection
+    tcp_event(&client, FSM_EV_CMD_BYE, NULL, NULL);
+    tcp_stream_abort(&client, "session ended");
+
+    if (client.transcript) transcript_close(client.transcript);
+    lowlat_report(&client.lowlat, "tcp", cfg->print_stats || client.lowlat.enabled);
 
-    close(client.sock);
+    line_reader_free(&client.rx);
+    line_reader_free(&client.input);
+    buffer_free(&client.tx);
+    buffer_free(&client.stream);
+    if (client.sock >= 0) close(client.sock);
     return 0;
 }
@@ -2,48 +2,90 @@
 #define TCP_H
 
 #include "client.h"
+#include "validate.h"
+#include "buffer.h"
+#include "transcript.h"
+#include "pacer.h"
+#include "trace.h"
+#include "binlog.h"
+#include "fsm.h"
+#include "lowlat.h"
+#include "resume.h"
+#include "schema.h"
+#include "filesend.h"
 #include <stdbool.h>
 
-// Message type enum for TCP parsing
+// Longest server line: "MSG FROM " + display name + " IS " + content
+#define TCP_MAX_LINE_LEN (IPK_MAX_CONTENT_LEN + 64)
+
+// Message types of the TCP variant, numbered by their UDP type byte (schema.h)
 typedef enum {
-    TCP_MSG_AUTH,
-    TCP_MSG_JOIN,
-    TCP_MSG_MSG,
-    TCP_MSG_ERR,
-    TCP_MSG_BYE,
-    TCP_MSG_REPLY,
-    TCP_MSG_UNKNOWN
+    TCP_MSG_AUTH    = MSG_AUTH,
+    TCP_MSG_JOIN    = MSG_JOIN,
+    TCP_MSG_MSG     = MSG_MSG,
+    TCP_MSG_ERR     = MSG_ERR,
+    TCP_MSG_BYE     = MSG_BYE,
+    TCP_MSG_REPLY   = MSG_REPLY,
+    TCP_MSG_UNKNOWN = 0xFC
 } tcp_msg_type_e;
 
 // Structure for a parsed TCP message
 typedef struct {
     tcp_msg_type_e type;
     char displayName[32];
-    char content[60000];
+    const char *content;  // Points into the parsed line, valid as long as the line
+    size_t contentLen;
     int replyOk;  // 1 if REPLY OK, 0 if REPLY NOK
+    // Fields of the client messages (AUTH, JOIN), for relaying them
+    char username[IPK_MAX_USERNAME_LEN + 1];
+    char secret[IPK_MAX_SECRET_LEN + 1];
+    char channel[IPK_MAX_CHANNEL_LEN + 1];
 } tcp_message_t;
 
-// Simple client states
-typedef enum {
-    CLIENT_CLOSED,
-    CLIENT_AUTH,
-    CLIENT_OPEN,
-    CLIENT_END
-} client_state_t_tcp;
-
 // Holds the TCP client's runtime info
 typedef struct {
     int sock;
-    client_state_t_tcp state;
+    fsm_state_e state;
     char displayName[32];
     char username[32];
-    char secret[128];
+    char secret[IPK_MAX_SECRET_LEN + 1];
+
+    uint64_t replyWaitStart;  // trace timestamp of the pending AUTH/JOIN
+    // Server stream split into CRLF-terminated lines
+    line_reader_t rx;
+    // User input split into lines
+    line_reader_t input;
+    // Outgoing line being assembled
+    buffer_t tx;
+
+    // Channel joined last and the one a pending JOIN asks for
+    char channel[IPK_MAX_CHANNEL_LEN + 1];
+    char joining[IPK_MAX_CHANNEL_LEN + 1];
+    // Optional audit transcript
+    transcript_t *transcript;
+
+    // Outgoing message pacing and the kernel retransmission count it last saw
+    pacer_t pacer;
+    unsigned int retransSeen;
+
+    // Low-latency mode and socket-to-handler latency
+    lowlat_t lowlat;
+
+    // Session resume: server address to reconnect to, connect() in progress
+    struct sockaddr_in server;
+    bool connecting;
+    resume_t resume;
+
+    // /sendfile: the file, the encoded chunk being written and how much of it is out
+    filesend_t file;
+    buffer_t stream;
+    size_t streamOff;
 
-    // If set, we are waiting for a REPLY or ERR before next command
-    int waitingForReply;
-    // Buffer for partial lines
-    char lineBuf[8192];
-    int  lineLen;
+    // Non-interactive start (-U): the channels to try, the next of them, and
+    // whether stdin still waits for the AUTH and JOIN to be answered
+    const client_config_t *login;
+    int loginNext;
+    bool loginPending;
 } tcp_client_t;
 
 // Parses a single line from the server. Returns true if successful
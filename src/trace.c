@@ -0,0 +1,119 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    uint64_t ts;          // ns
+    uint64_t dur;         // ns, complete events only
+    const char *name;
+    int64_t id;
+    char ph;              // 'X' complete, 'i' instant
+} trace_event_t;
+
+typedef struct trace_ring {
+    struct trace_ring *next;   // registry of all threads' rings
+    unsigned tid;
+    uint64_t count;            // events ever recorded; the ring keeps the last TRACE_RING_EVENTS
+    trace_event_t ev[TRACE_RING_EVENTS];
+} trace_ring_t;
+
+bool trace_enabled = false;
+
+static char trace_path[256];
+static uint64_t trace_t0;
+static trace_ring_t *trace_rings;      // pushed lock-free by each thread on first use
+static unsigned trace_next_tid = 1;
+static _Thread_local trace_ring_t *trace_ring;
+
+uint64_t trace_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static trace_ring_t *trace_thread_ring(void) {
+    if (trace_ring) return trace_ring;
+    trace_ring_t *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->tid = __atomic_fetch_add(&trace_next_tid, 1, __ATOMIC_RELAXED);
+    r->next = __atomic_load_n(&trace_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&trace_rings, &r->next, r, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    trace_ring = r;
+    return r;
+}
+
+void trace_record(char ph, const char *name, uint64_t start, uint64_t end, int64_t id) {
+    trace_ring_t *r = trace_thread_ring();
+    if (!r) return;
+    trace_event_t *e = &r->ev[r->count % TRACE_RING_EVENTS];
+    e->ts = start;
+    e->dur = end - start;
+    e->name = name;
+    e->id = id;
+    e->ph = ph;
+    r->count++;
+}
+
+int trace_open(const char *path) {
+    if (strlen(path) >= sizeof(trace_path)) {
+        fprintf(stderr, "Trace path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(trace_path, path);
+    trace_t0 = trace_clock();
+    trace_enabled = true;
+    if (atexit(trace_write) != 0) {
+        trace_enabled = false;
+        return -1;
+    }
+    return 0;
+}
+
+// Microseconds since trace_open, as trace-event "ts"/"dur" expect
+static double trace_us(uint64_t ns) {
+    return ns / 1000.0;
+}
+
+void trace_write(void) {
+    if (!trace_enabled) return;
+    trace_enabled = false;
+
+    FILE *f = fopen(trace_path, "w");
+    if (!f) {
+        perror(trace_path);
+        return;
+    }
+
+    int pid = (int)getpid();
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"ipk25chat-client\"}}", pid);
+
+    trace_ring_t *r = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE);
+    for (; r; r = r->next) {
+        uint64_t first = r->count > TRACE_RING_EVENTS ? r->count - TRACE_RING_EVENTS : 0;
+        for (uint64_t i = first; i < r->count; i++) {
+            const trace_event_t *e = &r->ev[i % TRACE_RING_EVENTS];
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,", e->name, e->ph,
+                    trace_us(e->ts - trace_t0));
+            if (e->ph == 'X')
+                fprintf(f, "\"dur\":%.3f,", trace_us(e->dur));
+            else
+                fprintf(f, "\"s\":\"t\",");
+            fprintf(f, "\"pid\":%d,\"tid\":%u", pid, r->tid);
+            if (e->id != TRACE_NO_ID)
+                fprintf(f, ",\"args\":{\"id\":%lld}", (long long)e->id);
+            fputc('}', f);
+        }
+        if (first > 0)
+            fprintf(stderr, "Trace: %llu oldest events of thread %u were overwritten\n",
+                    (unsigned long long)first, r->tid);
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+}
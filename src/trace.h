@@ -0,0 +1,45 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Opt-in latency tracing. Spans and instants are recorded into a per-thread
+// ring with monotonic timestamps and written as Chrome trace-event JSON
+// (opens in Perfetto / chrome://tracing) when the process exits.
+
+#define TRACE_RING_EVENTS 32768  // per thread, the oldest events are overwritten
+#define TRACE_NO_ID       (-1)
+
+extern bool trace_enabled;
+
+// Enables tracing and registers the writer with atexit(). Returns 0 on success.
+int trace_open(const char *path);
+
+// Monotonic nanoseconds
+uint64_t trace_clock(void);
+
+// Event names must be string literals (only the pointer is stored)
+void trace_record(char ph, const char *name, uint64_t start, uint64_t end, int64_t id);
+
+// Start timestamp of a span, 0 while tracing is off
+static inline uint64_t trace_now(void) {
+    return trace_enabled ? trace_clock() : 0;
+}
+
+// Complete event from 'start' (trace_now) until now; 'id' is a MessageID or TRACE_NO_ID
+static inline void trace_span(const char *name, uint64_t start, int64_t id) {
+    if (trace_enabled) trace_record('X', name, start, trace_clock(), id);
+}
+
+static inline void trace_instant(const char *name, int64_t id) {
+    if (trace_enabled) {
+        uint64_t now = trace_clock();
+        trace_record('i', name, now, now, id);
+    }
+}
+
+// Writes the JSON file; runs at exit, later calls do nothing
+void trace_write(void);
+
+#endif // TRACE_H
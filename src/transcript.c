@@ -0,0 +1,184 @@
+#include "transcript.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Worst case: every record is a bare header, so the index needs one entry per 24 bytes
+#define TRANSCRIPT_INDEX_SIZE \
+    (TRANSCRIPT_SEGMENT_SIZE / sizeof(transcript_record_t) * sizeof(transcript_index_t))
+
+uint32_t transcript_hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+const char *transcript_type_name(uint8_t type) {
+    switch (type) {
+        case TRANSCRIPT_CONFIRM: return "CONFIRM";
+        case TRANSCRIPT_REPLY:   return "REPLY";
+        case TRANSCRIPT_AUTH:    return "AUTH";
+        case TRANSCRIPT_JOIN:    return "JOIN";
+        case TRANSCRIPT_MSG:     return "MSG";
+        case TRANSCRIPT_PING:    return "PING";
+        case TRANSCRIPT_ERR:     return "ERR";
+        case TRANSCRIPT_BYE:     return "BYE";
+        default:                 return "UNKNOWN";
+    }
+}
+
+void transcript_segment_path(char *out, size_t out_len, const char *prefix,
+                             uint32_t segment, const char *ext) {
+    snprintf(out, out_len, "%s.%06u.%s", prefix, segment, ext);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Creates, sizes and maps one file of a segment
+static uint8_t *map_new_file(const char *path, size_t size, int *fd_out) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+    if (ftruncate(fd, size) != 0) {
+        perror("ftruncate");
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return NULL;
+    }
+    *fd_out = fd;
+    return p;
+}
+
+// Shrinks the files of the current segment to what was written and unmaps them
+static void finish_segment(transcript_t *t) {
+    if (t->seg) {
+        munmap(t->seg, TRANSCRIPT_SEGMENT_SIZE);
+        if (ftruncate(t->seg_fd, t->seg_used) != 0) perror("ftruncate");
+        close(t->seg_fd);
+        t->seg = NULL;
+    }
+    if (t->idx) {
+        munmap(t->idx, t->idx_size);
+        if (ftruncate(t->idx_fd, t->idx_used) != 0) perror("ftruncate");
+        close(t->idx_fd);
+        t->idx = NULL;
+    }
+}
+
+static int start_segment(transcript_t *t) {
+    char path[300];
+
+    transcript_segment_path(path, sizeof(path), t->prefix, t->segment, "seg");
+    t->seg = map_new_file(path, TRANSCRIPT_SEGMENT_SIZE, &t->seg_fd);
+    if (!t->seg) return -1;
+
+    t->idx_size = TRANSCRIPT_INDEX_SIZE;
+    transcript_segment_path(path, sizeof(path), t->prefix, t->segment, "idx");
+    t->idx = map_new_file(path, t->idx_size, &t->idx_fd);
+    if (!t->idx) {
+        finish_segment(t);
+        return -1;
+    }
+
+    transcript_segment_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = TRANSCRIPT_MAGIC;
+    hdr.version = TRANSCRIPT_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.segment = t->segment;
+    hdr.created_ns = now_ns();
+    memcpy(t->seg, &hdr, sizeof(hdr));
+
+    t->seg_used = sizeof(hdr);
+    t->idx_used = 0;
+    return 0;
+}
+
+int transcript_open(transcript_t *t, const char *prefix) {
+    memset(t, 0, sizeof(*t));
+    t->seg_fd = t->idx_fd = -1;
+    snprintf(t->prefix, sizeof(t->prefix), "%s", prefix);
+
+    // Continue after the last existing segment instead of overwriting it
+    char path[300];
+    struct stat st;
+    for (;;) {
+        transcript_segment_path(path, sizeof(path), t->prefix, t->segment, "seg");
+        if (stat(path, &st) != 0) break;
+        t->segment++;
+    }
+    return start_segment(t);
+}
+
+void transcript_log(transcript_t *t, const transcript_entry_t *e) {
+    if (!t || !t->seg) return;
+
+    size_t clen = e->channel ? strnlen(e->channel, 255) : 0;
+    size_t dlen = e->display_name ? strnlen(e->display_name, 255) : 0;
+    size_t body = sizeof(transcript_record_t) + clen + dlen + e->content_len;
+    size_t total = (body + TRANSCRIPT_ALIGN - 1) & ~(size_t)(TRANSCRIPT_ALIGN - 1);
+
+    if (total > TRANSCRIPT_SEGMENT_SIZE - sizeof(transcript_segment_header_t)) return;
+    if (t->seg_used + total > TRANSCRIPT_SEGMENT_SIZE) {
+        finish_segment(t);
+        t->segment++;
+        if (start_segment(t) != 0) return;
+    }
+
+    uint8_t *dst = t->seg + t->seg_used;
+    transcript_record_t rec = {
+        .timestamp_ns = now_ns(),
+        .length       = 0,
+        .content_len  = e->content_len,
+        .message_id   = e->message_id,
+        .transport    = e->transport,
+        .direction    = e->direction,
+        .type         = e->type,
+        .channel_len  = clen,
+        .dname_len    = dlen,
+        .flags        = e->flags
+    };
+    memcpy(dst, &rec, sizeof(rec));
+    size_t off = sizeof(rec);
+    if (clen) memcpy(dst + off, e->channel, clen);
+    off += clen;
+    if (dlen) memcpy(dst + off, e->display_name, dlen);
+    off += dlen;
+    if (e->content_len) memcpy(dst + off, e->content, e->content_len);
+
+    transcript_index_t ix = {
+        .timestamp_ns = rec.timestamp_ns,
+        .offset       = t->seg_used,
+        .channel_hash = transcript_hash(e->channel ? e->channel : "", clen)
+    };
+    memcpy(t->idx + t->idx_used, &ix, sizeof(ix));
+    t->idx_used += sizeof(ix);
+
+    // Publish: readers treat a zero length as the end of the segment
+    __atomic_store_n(&((transcript_record_t *)dst)->length, (uint32_t)total, __ATOMIC_RELEASE);
+    t->seg_used += total;
+}
+
+void transcript_close(transcript_t *t) {
+    if (!t) return;
+    finish_segment(t);
+}
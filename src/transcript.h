@@ -0,0 +1,128 @@
+#ifndef TRANSCRIPT_H
+#define TRANSCRIPT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// On-disk layout
+//
+//   <prefix>.<NNNNNN>.seg   segment header followed by 8-byte aligned records
+//   <prefix>.<NNNNNN>.idx   one transcript_index_t per record (time/channel lookup)
+//
+// Segments are preallocated, memory-mapped and filled with memcpy only; a
+// record becomes visible when its length field is stored, which happens last.
+// A zero length (or index offset) marks the end of a segment that was not
+// closed cleanly.
+
+#define TRANSCRIPT_MAGIC        0x52544B49u  // "IKTR"
+#define TRANSCRIPT_VERSION      1
+#define TRANSCRIPT_SEGMENT_SIZE (64u << 20)  // 64 MiB per segment
+#define TRANSCRIPT_ALIGN        8
+
+// Transport of a record
+enum {
+    TRANSCRIPT_TCP = 0,
+    TRANSCRIPT_UDP = 1
+};
+
+// Direction of a record
+enum {
+    TRANSCRIPT_RX = 0,
+    TRANSCRIPT_TX = 1
+};
+
+// Message type codes: IPK25-CHAT UDP wire values, used for both transports
+enum {
+    TRANSCRIPT_CONFIRM = 0x00,
+    TRANSCRIPT_REPLY   = 0x01,
+    TRANSCRIPT_AUTH    = 0x02,
+    TRANSCRIPT_JOIN    = 0x03,
+    TRANSCRIPT_MSG     = 0x04,
+    TRANSCRIPT_PING    = 0xFD,
+    TRANSCRIPT_ERR     = 0xFE,
+    TRANSCRIPT_BYE     = 0xFF
+};
+
+// Record flags
+#define TRANSCRIPT_F_HAS_ID    0x01  // message_id is valid (UDP)
+#define TRANSCRIPT_F_REPLY_OK  0x02  // REPLY result was OK
+
+// Header at offset 0 of every segment
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t segment;
+    uint32_t reserved;
+    uint64_t created_ns;
+    uint8_t  pad[40];
+} transcript_segment_header_t;
+
+// Fixed record header, followed by channel, display name and content bytes
+typedef struct {
+    uint64_t timestamp_ns;   // CLOCK_REALTIME
+    uint32_t length;         // whole record incl. padding; written last
+    uint32_t content_len;
+    uint16_t message_id;
+    uint8_t  transport;
+    uint8_t  direction;
+    uint8_t  type;
+    uint8_t  channel_len;
+    uint8_t  dname_len;
+    uint8_t  flags;
+} transcript_record_t;
+
+// Sidecar index entry
+typedef struct {
+    uint64_t timestamp_ns;
+    uint32_t offset;         // record offset in the segment (never 0)
+    uint32_t channel_hash;   // transcript_hash() of the channel name
+} transcript_index_t;
+
+// What a transport hands to the writer
+typedef struct {
+    uint8_t     transport;
+    uint8_t     direction;
+    uint8_t     type;
+    uint8_t     flags;
+    uint16_t    message_id;
+    const char *channel;       // may be NULL
+    const char *display_name;  // may be NULL
+    const char *content;       // may be NULL
+    size_t      content_len;
+} transcript_entry_t;
+
+// Writer state
+typedef struct {
+    char      prefix[256];
+    uint32_t  segment;
+    int       seg_fd;
+    int       idx_fd;
+    uint8_t  *seg;
+    uint8_t  *idx;
+    size_t    seg_used;
+    size_t    idx_used;
+    size_t    idx_size;
+} transcript_t;
+
+// Opens a writer; new segments are numbered after any existing ones
+int transcript_open(transcript_t *t, const char *prefix);
+
+// Appends one record (no syscalls unless a segment is rotated)
+void transcript_log(transcript_t *t, const transcript_entry_t *e);
+
+// Trims the current segment to its used size and unmaps it
+void transcript_close(transcript_t *t);
+
+// 32-bit FNV-1a hash used for channel lookups
+uint32_t transcript_hash(const char *s, size_t len);
+
+// Short name of a message type code
+const char *transcript_type_name(uint8_t type);
+
+// Builds "<prefix>.<NNNNNN>.<ext>"
+void transcript_segment_path(char *out, size_t out_len, const char *prefix,
+                             uint32_t segment, const char *ext);
+
+#endif // TRANSCRIPT_H
@@ -0,0 +1,213 @@
+// ipk25chat-transcript: dumps and filters transcript segments written by the client
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glob.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "transcript.h"
+
+typedef struct {
+    const char *channel;     // only records of this channel
+    uint32_t    channel_hash;
+    size_t      channel_len;
+    uint64_t    from_ns;     // inclusive
+    uint64_t    until_ns;    // exclusive, 0 = no limit
+    int         direction;   // -1 = both
+} filter_t;
+
+static void print_usage(void)
+{
+    fprintf(stderr, "Usage: ipk25chat-transcript [OPTIONS] <prefix>\n");
+    fprintf(stderr, "  -c <channel>        Only records of a channel\n");
+    fprintf(stderr, "  -f <unix_time>      Only records at or after the time (seconds, fractions allowed)\n");
+    fprintf(stderr, "  -u <unix_time>      Only records before the time\n");
+    fprintf(stderr, "  -d <rx|tx>          Only received or sent records\n");
+    fprintf(stderr, "  -h                  Print this help\n");
+}
+
+// Maps a whole file read-only; returns NULL for missing or empty files
+static const uint8_t *map_file(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    posix_madvise(p, st.st_size, POSIX_MADV_SEQUENTIAL);
+    *size = st.st_size;
+    return p;
+}
+
+static void print_record(const transcript_record_t *rec)
+{
+    // Cache the formatted second; consecutive records mostly share it
+    static time_t last_sec = -1;
+    static char sec_buf[32];
+
+    time_t sec = rec->timestamp_ns / 1000000000ull;
+    if (sec != last_sec) {
+        struct tm tm;
+        gmtime_r(&sec, &tm);
+        strftime(sec_buf, sizeof(sec_buf), "%Y-%m-%dT%H:%M:%S", &tm);
+        last_sec = sec;
+    }
+
+    const char *p = (const char *)(rec + 1);
+    const char *channel = p;
+    const char *dname = channel + rec->channel_len;
+    const char *content = dname + rec->dname_len;
+
+    printf("%s.%09lluZ %s %s %-7s", sec_buf,
+           (unsigned long long)(rec->timestamp_ns % 1000000000ull),
+           rec->transport == TRANSCRIPT_UDP ? "udp" : "tcp",
+           rec->direction == TRANSCRIPT_TX ? "tx" : "rx",
+           transcript_type_name(rec->type));
+    if (rec->flags & TRANSCRIPT_F_HAS_ID) printf(" id=%u", rec->message_id);
+    if (rec->type == TRANSCRIPT_REPLY) printf(" %s", rec->flags & TRANSCRIPT_F_REPLY_OK ? "OK" : "NOK");
+    if (rec->channel_len) printf(" #%.*s", rec->channel_len, channel);
+    if (rec->dname_len) printf(" %.*s:", rec->dname_len, dname);
+    if (rec->content_len) {
+        putchar(' ');
+        fwrite(content, 1, rec->content_len, stdout);
+    }
+    putchar('\n');
+}
+
+static bool record_matches(const transcript_record_t *rec, const filter_t *f)
+{
+    if (rec->timestamp_ns < f->from_ns) return false;
+    if (f->until_ns && rec->timestamp_ns >= f->until_ns) return false;
+    if (f->direction >= 0 && rec->direction != f->direction) return false;
+    if (f->channel) {
+        if (rec->channel_len != f->channel_len) return false;
+        if (memcmp(rec + 1, f->channel, f->channel_len) != 0) return false;
+    }
+    return true;
+}
+
+// Uses the index: binary search for the start time, hash compare for the channel
+static void dump_indexed(const uint8_t *seg, size_t seg_size,
+                         const transcript_index_t *idx, size_t count, const filter_t *f)
+{
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx[mid].timestamp_ns < f->from_ns) lo = mid + 1;
+        else hi = mid;
+    }
+
+    for (size_t i = lo; i < count; i++) {
+        if (idx[i].offset == 0 || idx[i].offset >= seg_size) break;
+        if (f->until_ns && idx[i].timestamp_ns >= f->until_ns) break;
+        if (f->channel && idx[i].channel_hash != f->channel_hash) continue;
+
+        const transcript_record_t *rec = (const transcript_record_t *)(seg + idx[i].offset);
+        if (rec->length == 0 || idx[i].offset + rec->length > seg_size) break;
+        if (record_matches(rec, f)) print_record(rec);
+    }
+}
+
+// Fallback when the index is missing: walk the records
+static void dump_linear(const uint8_t *seg, size_t seg_size, const filter_t *f)
+{
+    size_t off = sizeof(transcript_segment_header_t);
+    while (off + sizeof(transcript_record_t) <= seg_size) {
+        const transcript_record_t *rec = (const transcript_record_t *)(seg + off);
+        if (rec->length == 0 || off + rec->length > seg_size) break;
+        if (record_matches(rec, f)) print_record(rec);
+        off += rec->length;
+    }
+}
+
+static void dump_segment(const char *seg_path, const filter_t *f)
+{
+    size_t seg_size;
+    const uint8_t *seg = map_file(seg_path, &seg_size);
+    if (!seg) return;
+
+    const transcript_segment_header_t *hdr = (const transcript_segment_header_t *)seg;
+    if (seg_size < sizeof(*hdr) || hdr->magic != TRANSCRIPT_MAGIC ||
+        hdr->version != TRANSCRIPT_VERSION) {
+        fprintf(stderr, "%s: not a transcript segment\n", seg_path);
+        munmap((void *)seg, seg_size);
+        return;
+    }
+
+    char idx_path[4096];
+    size_t n = strlen(seg_path);
+    snprintf(idx_path, sizeof(idx_path), "%.*sidx", (int)(n - 3), seg_path);
+
+    size_t idx_size;
+    const uint8_t *idx = map_file(idx_path, &idx_size);
+    if (idx) {
+        dump_indexed(seg, seg_size, (const transcript_index_t *)idx,
+                     idx_size / sizeof(transcript_index_t), f);
+        munmap((void *)idx, idx_size);
+    } else {
+        dump_linear(seg, seg_size, f);
+    }
+    munmap((void *)seg, seg_size);
+}
+
+int main(int argc, char *argv[])
+{
+    filter_t f;
+    memset(&f, 0, sizeof(f));
+    f.direction = -1;
+    const char *prefix = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0) {
+            print_usage();
+            return 0;
+        } else if (strcmp(argv[i], "-c") == 0 && (i+1 < argc)) {
+            f.channel = argv[++i];
+            f.channel_len = strlen(f.channel);
+            f.channel_hash = transcript_hash(f.channel, f.channel_len);
+        } else if (strcmp(argv[i], "-f") == 0 && (i+1 < argc)) {
+            f.from_ns = (uint64_t)(strtod(argv[++i], NULL) * 1e9);
+        } else if (strcmp(argv[i], "-u") == 0 && (i+1 < argc)) {
+            f.until_ns = (uint64_t)(strtod(argv[++i], NULL) * 1e9);
+        } else if (strcmp(argv[i], "-d") == 0 && (i+1 < argc)) {
+            i++;
+            f.direction = strcmp(argv[i], "tx") == 0 ? TRANSCRIPT_TX : TRANSCRIPT_RX;
+        } else if (argv[i][0] != '-' && !prefix) {
+            prefix = argv[i];
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (!prefix) {
+        print_usage();
+        return 1;
+    }
+
+    // Large stdout buffer: dumping is bound by output, not by reading the mapping
+    static char outbuf[1 << 20];
+    setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+
+    char pattern[4096];
+    snprintf(pattern, sizeof(pattern), "%s.[0-9][0-9][0-9][0-9][0-9][0-9].seg", prefix);
+    glob_t g;
+    if (glob(pattern, 0, NULL, &g) != 0) {
+        fprintf(stderr, "No transcript segments found for %s\n", prefix);
+        return 1;
+    }
+    // glob() sorts, and the fixed-width numbering keeps segments in order
+    for (size_t i = 0; i < g.gl_pathc; i++)
+        dump_segment(g.gl_pathv[i], &f);
+    globfree(&g);
+    return 0;
+}
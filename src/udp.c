@@ -1,6 +1,13 @@
+#define _DEFAULT_SOURCE  // SO_RXQ_OVFL
 #include "udp.h"
 #include "utils.h"
 #include "client.h"
+#include "validate.h"
+#include "buffer.h"
+#include "trace.h"
+#include "binlog.h"
+#include "fsm.h"
+#include "shmring.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,27 +16,14 @@
 #include <poll.h>
 #include <arpa/inet.h>
 #include <errno.h>
-#include <stdarg.h>
-#include <assert.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <signal.h>
 #include <time.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
 
 
-#define CHECK_LAST_NULL(packet, offset) do { \
-    if ((offset) > 0 && (packet)[(offset)-1] != '\0') (packet)[(offset)++] = '\0'; \
-} while (0)
-
-static void debug(const char *fmt, ...) {
-#ifdef DEBUG_PRINT
-    va_list args;
-    va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
-    va_end(args);
-#endif
-}
-
 // Global flag for program termination
 volatile sig_atomic_t terminate_udp = 0;
 
@@ -43,10 +37,40 @@ uint16_t udp_next_message_id(UdpClient *client) {
     return client->message_id++;
 }
 
+// Protocol state of a new client for 'server', without the socket
+static void udp_client_setup(UdpClient *client, const struct sockaddr_in *server,
+                             uint16_t timeout_ms, uint8_t max_retries) {
+    memset(client, 0, sizeof(UdpClient));
+    client->sockfd = -1;
+    client->server_addr = *server;
+    client->dyn_server_addr = *server;
+    client->addr_len = sizeof(struct sockaddr_in);
+    client->message_id = 0;
+    client->timeout_ms = timeout_ms;
+    client->max_retries = max_retries;
+    client->state = FSM_START;
+    client->reply_deadline = -1;
+    msgid_buffer_init(&client->seen_ids);
+}
+
+void udp_client_init_io(UdpClient *client, const struct sockaddr_in *server,
+                        uint16_t timeout_ms, uint8_t max_retries, const ipk_io_t *io) {
+    udp_client_setup(client, server, timeout_ms, max_retries);
+    client->io = io;
+}
+
 // Initializes the UDP client, sets up the socket, server address, timeout and retry settings.
 int udp_client_init(UdpClient *client, const char *server_host, uint16_t port,
     uint16_t timeout_ms, uint8_t max_retries) {
-    memset(client, 0, sizeof(UdpClient));
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(struct sockaddr_in));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    if (resolve_server_address(server_host, port, &server) != 0) {
+        fprintf(stderr, "Failed to resolve server address\n");
+        return -1;
+    }
+    udp_client_setup(client, &server, timeout_ms, max_retries);
 
     client->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (client->sockfd < 0) {
@@ -54,414 +78,1161 @@ int udp_client_init(UdpClient *client, const char *server_host, uint16_t port,
         return -1;
     }
 
-    memset(&client->server_addr, 0, sizeof(struct sockaddr_in));
-    client->server_addr.sin_family = AF_INET;
-    client->server_addr.sin_port = htons(port);
-    if (resolve_server_address(server_host, port, &client->server_addr) != 0) {
-        fprintf(stderr, "Failed to resolve server address\n");
-        return -1;
-    }
-
-    memcpy(&client->dyn_server_addr, &client->server_addr, sizeof(struct sockaddr_in));
-    client->addr_len = sizeof(struct sockaddr_in);
-    client->message_id = 0;
-    client->timeout_ms = timeout_ms;
-    client->max_retries = max_retries;
-
-    msgid_buffer_init(&client->seen_ids);
+    // Kernel drop counter on every received datagram
+    int on = 1;
+    if (setsockopt(client->sockfd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) != 0)
+        perror("setsockopt(SO_RXQ_OVFL)");
+    // Kernel RX time on every received datagram; software TX times on the
+    // error queue, numbered by send and without the datagram itself
+    if (setsockopt(client->sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) != 0)
+        perror("setsockopt(SO_TIMESTAMPNS)");
+    int tx_stamps = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                    SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    setsockopt(client->sockfd, SOL_SOCKET, SO_TIMESTAMPING, &tx_stamps, sizeof(tx_stamps));
+    socklen_t optlen = sizeof(int);
+    getsockopt(client->sockfd, SOL_SOCKET, SO_RCVBUF, &client->stats.rcvbuf, &optlen);
+    optlen = sizeof(int);
+    getsockopt(client->sockfd, SOL_SOCKET, SO_SNDBUF, &client->stats.sndbuf, &optlen);
     return 0;
 }
 
+// False while a replay or a simulation stands in for the socket
+static bool udp_has_socket(const UdpClient *client) {
+    return !client->replay && !client->io;
+}
 
+// Grows a socket buffer so that twice the observed burst fits. The kernel
+// charges a queued datagram its length plus UDP_SKB_OVERHEAD and reports (and
+// enforces) double the requested size. Buffers only grow: a burst that was
+// seen once comes again.
+static void udp_autosize(UdpClient *client, int opt, uint32_t burst, uint32_t len) {
+    int *current = opt == SO_RCVBUF ? &client->stats.rcvbuf : &client->stats.sndbuf;
+    int64_t want = 2 * (int64_t)burst * (len + UDP_SKB_OVERHEAD);
+    if (want > UDP_SOCKBUF_MAX) want = UDP_SOCKBUF_MAX;
+    if (want <= *current) return;
+
+    int request = (int)(want / 2);
+    socklen_t optlen = sizeof(int);
+    if (setsockopt(client->sockfd, SOL_SOCKET, opt, &request, sizeof(request)) != 0 ||
+        getsockopt(client->sockfd, SOL_SOCKET, opt, current, &optlen) != 0)
+        return;
+    if (opt == SO_RCVBUF)
+        BLOG(LOG_UDP_RCVBUF, *current, burst, len);
+    else
+        BLOG(LOG_UDP_SNDBUF, *current, burst, len);
+}
 
-// Helper function: checks that the rest of the message has the correct number of zero bytes,
-// each of them is followed by non-zero data and the last byte is 0
-static int check_tail_zero_fields(uint8_t *buf, size_t len, int expected_zeros) {
-    if (len == 0) return 0;
-    if (buf[len - 1] != 0) return 1;
+static int64_t udp_realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-    int zero_count = 0;
-    int last_nonzero = 0;
+// Timestamp of a send or receive for the RTT samples; a simulation's own clock
+static int64_t udp_stamp_ns(const UdpClient *client) {
+    if (client->io) return client->io->now_ms(client->io->ctx) * 1000000;
+    return udp_realtime_ns();
+}
 
-    for (size_t i = 0; i < len; ++i) {
-        if (buf[i] == 0) {
-            if (!last_nonzero) return 1; // \0 bez předchozího datového bajtu
-            zero_count++;
-            last_nonzero = 0;
-        } else {
-            last_nonzero = 1;
+// Picks the kernel's RX time and drop counter out of a received datagram's
+// ancillary data
+static void udp_note_control(UdpClient *client, struct msghdr *msg) {
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR(msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            client->rx_stamp_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+            continue;
+        }
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SO_RXQ_OVFL) continue;
+        uint32_t total;
+        memcpy(&total, CMSG_DATA(c), sizeof(total));
+        if (total <= client->stats.kernel_drops) continue;
+        uint32_t dropped = total - client->stats.kernel_drops;
+        client->stats.kernel_drops = total;
+        BLOG(LOG_UDP_KERNEL_DROP, dropped, total);
+        // The burst that overflowed was at least what was read plus what was lost
+        udp_autosize(client, SO_RCVBUF, client->stats.rx_burst_max + dropped,
+                     client->stats.rx_len_max ? client->stats.rx_len_max : MAX_MESSAGE_SIZE);
+    }
+}
+
+// Replaces user-space TX times with the kernel's from the error queue
+static void udp_read_tx_stamps(UdpClient *client) {
+    if (!udp_has_socket(client)) return;
+    for (;;) {
+        char data[64];
+        union {
+            // SO_TIMESTAMPNS adds its own stamp next to SO_TIMESTAMPING's
+            char buf[CMSG_SPACE(sizeof(struct timespec)) +
+                     CMSG_SPACE(sizeof(struct scm_timestamping)) +
+                     CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in))];
+            struct cmsghdr align;
+        } control;
+        struct iovec iov = { .iov_base = data, .iov_len = sizeof(data) };
+        struct msghdr msg = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control.buf,
+            .msg_controllen = sizeof(control.buf)
+        };
+        if (recvmsg(client->sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) return;
+
+        int64_t stamp = -1;
+        bool numbered = false;
+        uint32_t seq = 0;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING) {
+                struct scm_timestamping ts;
+                memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                stamp = (int64_t)ts.ts[0].tv_sec * 1000000000 + ts.ts[0].tv_nsec;
+            } else if (c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_RECVERR) {
+                struct sock_extended_err ee;
+                memcpy(&ee, CMSG_DATA(c), sizeof(ee));
+                numbered = ee.ee_origin == SO_EE_ORIGIN_TIMESTAMPING;
+                seq = ee.ee_data;
+            }
         }
+        if (stamp <= 0 || !numbered) continue;
+        client->stats.tx_kernel_stamps++;
+        if (client->inflight && seq == client->head_seq) client->head_sent_ns = stamp;
+        if (client->reply_deadline >= 0 && seq == client->reply_seq) client->reply_sent_ns = stamp;
     }
+}
 
-    return zero_count != expected_zeros;
+// Retransmission timeout: -d, or with -A the RFC 6298 estimate capped by -d
+static int udp_rto_ms(const UdpClient *client) {
+    if (!client->adaptive_rto || client->srtt_us == 0) return client->timeout_ms;
+    int64_t var = 4 * client->rttvar_us > 1000 ? 4 * client->rttvar_us : 1000;
+    int64_t rto = (client->srtt_us + var + 999) / 1000;
+    if (rto < UDP_RTO_MIN_MS) rto = UDP_RTO_MIN_MS;
+    return rto < client->timeout_ms ? (int)rto : client->timeout_ms;
 }
 
-// Validates whether a received UDP packet is malformed based on its type and structure.
-int udp_is_malformed(uint8_t *buf, size_t len) {
-    if (len < 3) return 1;
+static void udp_sample(uint64_t *n, uint64_t *sum, uint32_t *min, uint32_t *max, int64_t us) {
+    if (*n == 0 || us < *min) *min = us;
+    if (us > *max) *max = us;
+    (*n)++;
+    *sum += us;
+}
 
-    uint8_t type = buf[0];
+// A datagram was confirmed on its first attempt (Karn: retransmitted ones
+// cannot tell which copy the CNFRM answers)
+static void udp_rtt_sample(UdpClient *client, uint16_t id) {
+    int64_t us = (client->rx_stamp_ns - client->head_sent_ns) / 1000;
+    if (client->head_sent_ns == 0 || us < 0) return;
+    udp_stats_t *s = &client->stats;
+    udp_sample(&s->rtt_samples, &s->rtt_sum_us, &s->rtt_min_us, &s->rtt_max_us, us);
+
+    if (client->srtt_us == 0) {
+        client->srtt_us = us > 0 ? us : 1;
+        client->rttvar_us = us / 2;
+    } else {
+        int64_t err = client->srtt_us - us;
+        client->rttvar_us = (3 * client->rttvar_us + (err < 0 ? -err : err)) / 4;
+        client->srtt_us = (7 * client->srtt_us + us) / 8;
+        if (client->srtt_us == 0) client->srtt_us = 1;
+    }
+    BLOG(LOG_UDP_RTT, id, us, client->srtt_us, udp_rto_ms(client));
+}
 
-    switch (type) {
-        case MSG_CNFRM:
-        case MSG_PING:
-            return len != 3;
 
-        case MSG_REPLY: 
-            if (buf[3] != 0 && buf[3] != 1) return 1;
-            return check_tail_zero_fields(buf+6, len-6, 1);
 
-        case MSG_AUTH: 
-            return check_tail_zero_fields(buf+3, len-3, 3);
+// Records a raw datagram in the transcript, splitting out the fields of its type
+static void udp_log_packet(UdpClient *client, uint8_t direction, const uint8_t *buf, size_t len) {
+    if (!client->transcript || len < 3) return;
 
-        case MSG_JOIN:
-        case MSG_MSG:
-        case MSG_ERR:
-            return check_tail_zero_fields(buf+3, len-3, 2);
+    uint16_t id;
+    memcpy(&id, &buf[1], sizeof(uint16_t));
 
-        case MSG_BYE:
-            return check_tail_zero_fields(buf+3, len-3, 1);
+    transcript_entry_t e = {
+        .transport  = TRANSCRIPT_UDP,
+        .direction  = direction,
+        .type       = buf[0],
+        .flags      = TRANSCRIPT_F_HAS_ID,
+        .message_id = ntohs(id),
+        .channel    = client->channel
+    };
 
-        default:
-            return 1;
+    ipk_msg_t m;
+    if (ipk_udp_decode(buf, len, &m)) {
+        if (m.result) e.flags |= TRANSCRIPT_F_REPLY_OK;
+        if (m.channel.ptr) e.channel = m.channel.ptr;
+        e.display_name = m.display.ptr;
+        // An AUTH is logged with its username; the secret stays out of the log
+        ipk_text_t content = m.type == MSG_AUTH ? m.username : m.content;
+        e.content = content.ptr;
+        e.content_len = content.len;
     }
+    transcript_log(client->transcript, &e);
 }
 
+// Validates a received UDP packet against the message schema
+int udp_is_malformed(const uint8_t *buf, size_t len) {
+    ipk_msg_t m;
+    return !ipk_udp_decode(buf, len, &m);
+}
 
-// Processes and prints the contents of the ERR message from the server
-void handle_error_message(const uint8_t *buf, size_t length) {
-    assert(buf != NULL);
-
-    const char *display_name = (const char *)&buf[3];
-    size_t name_len = strnlen(display_name, length - 3);
 
-    const char *message = display_name + name_len + 1;
+// Prints the ERR message from the server
+static void handle_error_message(const ipk_msg_t *msg) {
+    fprintf(stdout, "ERROR FROM %s: %s\n", msg->display.ptr, msg->content.ptr);
+}
 
-    fprintf(stdout, "ERROR FROM %s: %s\n", display_name, message);
+// Monotonic milliseconds, or the simulation's clock
+static int64_t udp_now_ms(const UdpClient *client) {
+    if (client->io) return client->io->now_ms(client->io->ctx);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+// Closes the socket and frees the queues; the closing BYE is part of the
+// protocol run by udp_event
 void udp_client_close(UdpClient *client) {
-    packetContent_t pkt = { .type = MSG_BYE, .payload = NULL, .length = 0 };
-    udp_send_with_confirm(client, &pkt);
-    if (client->sockfd > 0)
+    if (client->sockfd >= 0)
         close(client->sockfd);
+    client->sockfd = -1;
+    udp_ring_free(&client->confirms);
+    udp_ring_free(&client->sendq);
+    udp_ring_free(&client->bulk);
+    udp_ring_free(&client->held);
+    arena_free(&client->arena);
 }
 
-// Sends a CNFRM message with a given message ID to acknowledge receipt of a packet.
-int udp_send_confirm(UdpClient *client, uint16_t ref_msg_id) {
+// MessageID field of a serialized datagram
+static uint16_t udp_packet_id(const uint8_t *buf) {
+    uint16_t id;
+    memcpy(&id, &buf[1], sizeof(uint16_t));
+    return ntohs(id);
+}
+
+// Bytes of a datagram that may go to the binary log: AUTH is cut before the secret
+static size_t udp_loggable_len(const uint8_t *buf, size_t len) {
+    if (len < 3 || buf[0] != MSG_AUTH) return len;
+    size_t off = 3;
+    for (int field = 0; field < 2 && off < len; field++)
+        off += strnlen((const char *)buf + off, len - off) + 1;
+    return off < len ? off : len;
+}
+
+// Puts a serialized datagram on the wire and records it. During a replay the
+// datagram is compared with the capture instead of being sent.
+static int udp_transmit(UdpClient *client, const uint8_t *buf, size_t len) {
+    if (client->replay) {
+        replay_note_tx(client->replay, buf, len);
+    } else if (client->io) {
+        // A simulated network loses datagrams silently, like a real one
+        client->io->send_to(client->io->ctx, buf, len, &client->dyn_server_addr);
+    } else {
+        ssize_t sent = client->connected
+            ? send(client->sockfd, buf, len, 0)
+            : sendto(client->sockfd, buf, len, 0,
+                     (struct sockaddr *)&client->dyn_server_addr, client->addr_len);
+        if (sent < 0) {
+            if (errno == ECONNREFUSED)
+                client->unreachable = true;
+            else
+                perror("sendto");
+            return -1;
+        }
+        client->tx_seq++;
+    }
+    client->stats.tx_datagrams++;
+    client->stats.tx_bytes += len;
+    if (len > client->stats.tx_len_max) client->stats.tx_len_max = len;
+    trace_instant(buf[0] == MSG_CNFRM ? "udp.tx_confirm" : "udp.tx", udp_packet_id(buf));
+    BLOG_BLOB(LOG_UDP_TX, buf, udp_loggable_len(buf, len), len, BINLOG_ADDR(&client->dyn_server_addr));
+    capture_record(client->capture, CAPTURE_TX, &client->dyn_server_addr, buf, len);
+    udp_log_packet(client, TRANSCRIPT_TX, buf, len);
+    return 0;
+}
+
+// --- Outbound scheduler ---
+// CNFRMs wait in their own ring and always go out first, so acknowledgements
+// of server messages never queue behind our own traffic. Everything else is
+// delivered reliably with one datagram in flight: it stays in flight until its
+// CNFRM (or, for AUTH/JOIN, its REPLY) arrives and is retransmitted by
+// udp_client_on_timer meanwhile. The send queue (requests, typed messages,
+// ERR and BYE, in order) goes ahead of the bulk ring of /sendfile chunks, so
+// a command never waits for more than the one chunk already in flight.
+
+// Appends a copy of a datagram. Returns false when the ring is full.
+bool udp_ring_push(udp_ring_t *ring, const uint8_t *buf, size_t len) {
+    if (ring->count == UDP_RING_SIZE) return false;
+    buffer_t *slot = &ring->items[(ring->head + ring->count) % UDP_RING_SIZE];
+    buffer_clear(slot);
+    if (!buffer_append(slot, buf, len)) return false;
+    ring->count++;
+    return true;
+}
+
+// Removes the oldest datagram; it stays valid until the next push
+buffer_t *udp_ring_pop(udp_ring_t *ring) {
+    if (ring->count == 0) return NULL;
+    buffer_t *slot = &ring->items[ring->head];
+    ring->head = (ring->head + 1) % UDP_RING_SIZE;
+    ring->count--;
+    return slot;
+}
+
+void udp_ring_free(udp_ring_t *ring) {
+    for (int i = 0; i < UDP_RING_SIZE; ++i)
+        buffer_free(&ring->items[i]);
+    ring->head = ring->count = 0;
+}
+
+// Ring whose head is (or goes) in flight
+static udp_ring_t *udp_head_ring(UdpClient *client) {
+    return client->inflight_bulk ? &client->bulk : &client->sendq;
+}
+
+// (Re)transmits the head in flight and arms its retransmission timer;
+// the first transmission of AUTH/JOIN also starts the REPLY timer
+static int udp_send_head(UdpClient *client, int64_t now) {
+    udp_ring_t *ring = udp_head_ring(client);
+    buffer_t *b = &ring->items[ring->head];
+    const uint8_t *buf = (const uint8_t *)b->data;
+
+    if (client->attempts == 0) {
+        client->head_seq = client->tx_seq;
+        client->head_sent_ns = udp_stamp_ns(client);
+        if (buf[0] == MSG_AUTH || buf[0] == MSG_JOIN) {
+            client->reply_ref = udp_packet_id(buf);
+            client->reply_deadline = now + UDP_REPLY_TIMEOUT_MS;
+            client->reply_seq = client->tx_seq;
+            client->reply_sent_ns = client->head_sent_ns;
+            client->t_reply = trace_now();
+        }
+    }
+    client->inflight = true;
+    client->inflight_id = udp_packet_id(buf);
+    client->attempts++;
+    client->resend_at = now + udp_rto_ms(client);
+    client->t_attempt = trace_now();
+    return udp_transmit(client, buf, b->len);
+}
+
+int udp_flush(UdpClient *client) {
+    int rc = 0;
+    uint32_t burst = 0;
+    buffer_t *b;
+    while ((b = udp_ring_pop(&client->confirms)) != NULL) {
+        if (udp_transmit(client, (const uint8_t *)b->data, b->len) != 0)
+            rc = -1;
+        burst++;
+    }
+    if (!client->inflight && client->sendq.count + client->bulk.count > 0) {
+        client->inflight_bulk = client->sendq.count == 0;
+        client->attempts = 0;
+        if (udp_send_head(client, udp_now_ms(client)) != 0)
+            rc = -1;  // the retransmission timer tries again
+        burst++;
+    }
+    if (burst > client->stats.tx_burst_max && udp_has_socket(client)) {
+        client->stats.tx_burst_max = burst;
+        udp_autosize(client, SO_SNDBUF, burst, client->stats.tx_len_max);
+    }
+    return rc;
+}
+
+// The datagram in flight was confirmed; the next one may go
+static void udp_delivered(UdpClient *client) {
+    trace_span("udp.attempt", client->t_attempt, client->inflight_id);
+    if (client->attempts == 1) {
+        pacer_on_delivered(&client->pacer);
+        udp_rtt_sample(client, client->inflight_id);
+    }
+    udp_ring_pop(udp_head_ring(client));
+    client->inflight = false;
+}
+
+// Forgets every datagram not yet confirmed, including the one in flight
+static void udp_drop_pending(UdpClient *client) {
+    client->sendq.head = client->sendq.count = 0;
+    client->bulk.head = client->bulk.count = 0;
+    client->inflight = false;
+    client->reply_deadline = -1;
+}
+
+static int udp_queue_confirm(UdpClient *client, uint16_t ref_msg_id) {
     uint8_t packet[3];
     packet[0] = MSG_CNFRM;
     uint16_t net_id = htons(ref_msg_id);
     memcpy(&packet[1], &net_id, sizeof(uint16_t));
 
-    debug("Sending\n");
-    #ifdef DEBUG_PRINT
-    udp_print_packet(packet, sizeof(packet));
-    #endif
-    debug("[DEBUG] Sending CNFRM for ID %u to %s:%u\n",
-          ref_msg_id, inet_ntoa(client->dyn_server_addr.sin_addr),
-          ntohs(client->dyn_server_addr.sin_port));
-    int sent = sendto(client->sockfd, packet, sizeof(packet), 0,
-                      (struct sockaddr *)&client->dyn_server_addr, client->addr_len);
-    if (sent < 0) {
-        perror("sendto (confirm)");
+    BLOG(LOG_UDP_CONFIRM_QUEUED, ref_msg_id);
+    if (!udp_ring_push(&client->confirms, packet, sizeof(packet))) {
+        if (udp_flush(client) != 0 || !udp_ring_push(&client->confirms, packet, sizeof(packet)))
+            return -1;
+    }
+    return 0;
+}
+
+// Sends a CNFRM message with a given message ID to acknowledge receipt of a packet.
+int udp_send_confirm(UdpClient *client, uint16_t ref_msg_id) {
+    if (udp_queue_confirm(client, ref_msg_id) != 0)
         return -1;
+    return udp_flush(client);
+}
+
+// Queues the CNFRM for a server datagram and filters retransmissions.
+// Returns true the first time a MessageID is seen.
+static bool udp_accept(UdpClient *client, const uint8_t *buf) {
+    if (buf[0] == MSG_CNFRM) return true;
+
+    uint16_t id;
+    memcpy(&id, &buf[1], sizeof(uint16_t));
+    id = ntohs(id);
+
+    udp_queue_confirm(client, id);
+    if (msgid_buffer_contains(&client->seen_ids, id)) {
+        client->stats.rx_duplicates++;
+        return false;
     }
+    msgid_buffer_add(&client->seen_ids, id);
+    return true;
+}
 
-    debug("[DEBUG] Sent CNFRM for ID %u\n", ref_msg_id);
-    return 0;
+// Serializes a packet into 'packet', which must hold UDP_ENCODED_MAX(content->length)
+// bytes. Returns the encoded length, or 0 for an unknown message type.
+size_t udp_encode(const packetContent_t *content, const char *username,
+                  const char *display_name, uint8_t *packet) {
+    // The payload is whichever of secret, channel and content the type carries
+    ipk_text_t payload = { (const char *)content->payload, 0 };
+    if (content->payload) payload.len = strnlen(payload.ptr, content->length);
+    ipk_msg_t m = {
+        .type = content->type,
+        .id = content->messageID,
+        .result = content->result,
+        .ref = content->ref_messageID,
+        .username = ipk_text(username),
+        .display = ipk_text(display_name),
+        .secret = payload,
+        .channel = payload,
+        .content = payload
+    };
+    size_t len = ipk_udp_encode(&m, packet);
+    if (len == 0) fprintf(stderr, "udp_encode: Unknown message type\n");
+    return len;
 }
 
-// Serializes and sends a message to the server based on the given packet content.
+// Serializes a message under the next MessageID and queues it in 'ring' for
+// reliable delivery
+static int udp_queue_message(UdpClient *client, udp_ring_t *ring, packetContent_t *content) {
+    // Header, the client's own strings and their terminators must fit next to the payload
+    if (UDP_ENCODED_MAX(content->length) > MAX_MESSAGE_SIZE)
+        return -1;
+    if (ring->count == UDP_RING_SIZE)
+        return -1;
+
+    content->messageID = udp_next_message_id(client);
+
+    // Serialized in the arena and released once the send queue holds a copy
+    arena_mark_t mark = arena_mark(&client->arena);
+    uint8_t *packet = arena_alloc(&client->arena, UDP_ENCODED_MAX(content->length));
+    if (!packet) return -1;
+
+    uint64_t t_encode = trace_now();
+    size_t offset = udp_encode(content, client->username, client->display_name, packet);
+    trace_span("udp.encode", t_encode, content->messageID);
+    bool queued = offset > 0 && offset <= MAX_MESSAGE_SIZE &&
+                  udp_ring_push(ring, packet, offset);
+    arena_rewind(&client->arena, mark);
+    if (!queued)
+        return -1;
+
+    pacer_consume(&client->pacer);
+    return udp_flush(client);
+}
+
+// Queues a message behind the ones before it; it is sent as soon as nothing
+// else is in flight.
 int udp_send_message(UdpClient *client, packetContent_t *content) {
     if (!client || !content) return -1;
+    return udp_queue_message(client, &client->sendq, content);
+}
+
+// Reads one pending datagram into the arena (sized to the datagram) without
+// waiting. Returns its length, 0 when nothing is pending and -1 on error.
+int udp_receive_message(UdpClient *client, const uint8_t **data,
+                        struct sockaddr_in *source_addr) {
+    int ret;
+    const uint8_t *buffer;
+    if (client->replay) {
+        // The next captured datagram is pending once it falls due
+        if (replay_next_due_ms(client->replay) != 0) return 0;
+        ret = replay_next_rx(client->replay, &buffer, source_addr);
+        if (ret < 0) return 0;
+        client->rx_stamp_ns = udp_realtime_ns();
+    } else if (client->io) {
+        const ipk_io_t *io = client->io;
+        ssize_t size = io->recv_from(io->ctx, NULL, 0, MSG_PEEK | MSG_TRUNC, NULL);
+        if (size < 0)
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        uint8_t *dst = arena_alloc(&client->arena, size > 0 ? size : 1);
+        if (!dst) return -1;
+        ret = io->recv_from(io->ctx, dst, size > 0 ? size : 1, 0, source_addr);
+        if (ret < 0) return -1;
+        client->rx_stamp_ns = udp_stamp_ns(client);
+        buffer = dst;
+    } else {
+        // Size the arena block to the pending datagram instead of the UDP maximum
+        ssize_t size = recv(client->sockfd, NULL, 0, MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+        if (size < 0)
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        uint8_t *dst = arena_alloc(&client->arena, size > 0 ? size : 1);
+        if (!dst) return -1;
+
+        // Only the server can be the source of a connected socket
+        struct iovec iov = { .iov_base = dst, .iov_len = size > 0 ? size : 1 };
+        union {
+            char buf[CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(struct timespec))];
+            struct cmsghdr align;
+        } control;
+        client->rx_stamp_ns = 0;
+        struct msghdr msg = {
+            .msg_name = client->connected ? NULL : source_addr,
+            .msg_namelen = client->connected ? 0 : sizeof(struct sockaddr_in),
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control.buf,
+            .msg_controllen = sizeof(control.buf)
+        };
+        ret = recvmsg(client->sockfd, &msg, MSG_DONTWAIT);
+        if (ret < 0) return -1;
+        if (client->connected) *source_addr = client->dyn_server_addr;
+        udp_note_control(client, &msg);
+        lowlat_sample(&client->lowlat, client->rx_stamp_ns);
+        if (client->rx_stamp_ns == 0) client->rx_stamp_ns = udp_realtime_ns();
+        capture_record(client->capture, CAPTURE_RX, source_addr, dst, ret);
+        buffer = dst;
+    }
 
-    uint8_t packet[MAX_MESSAGE_SIZE];
-    size_t offset = 0;
+    client->stats.rx_datagrams++;
+    client->stats.rx_bytes += ret;
+    if ((uint32_t)ret > client->stats.rx_len_max) client->stats.rx_len_max = ret;
+    BLOG_BLOB(LOG_UDP_RX, buffer, udp_loggable_len(buffer, ret), ret, BINLOG_ADDR(source_addr));
+    *data = buffer;
+    return ret;
+}
 
-    packet[offset++] = (uint8_t)content->type;
-    uint16_t net_id = htons(content->messageID);
-    memcpy(&packet[offset], &net_id, sizeof(uint16_t));
-    offset += 2;
+// --- Protocol state machine ---
 
-    switch (content->type) {
-        case MSG_CNFRM:
-            memcpy(&packet[1], &net_id, sizeof(uint16_t));
-            offset = 3;
-            break;
-        case MSG_REPLY: {
-            packet[offset++] = content->result;
-            uint16_t net_ref = htons(content->ref_messageID);
-            memcpy(&packet[offset], &net_ref, sizeof(uint16_t));
-            offset += 2;
-            if (content->payload && content->length > 0) {
-                memcpy(&packet[offset], content->payload, content->length);
-                offset += content->length;
-                CHECK_LAST_NULL(packet, offset);
+// Drops what is still pending and queues the closing ERR (when 'err' is set)
+// and BYE
+static void udp_shutdown(UdpClient *client, const char *err) {
+    udp_drop_pending(client);
+    if (err) {
+        packetContent_t pkt = { .type = MSG_ERR, .payload = (uint8_t *)err, .length = strlen(err) + 1 };
+        udp_send_message(client, &pkt);
+    }
+    packetContent_t pkt = { .type = MSG_BYE, .payload = NULL, .length = 0 };
+    udp_send_message(client, &pkt);
+}
+
+// Publishes a server message to the shared-memory ring (-O)
+static void udp_publish(const UdpClient *client, uint8_t type, const ipk_msg_t *msg) {
+    if (!shmring_enabled() || !msg) return;
+    uint8_t flags = type == IPK_RING_REPLY && msg->result == 1 ? IPK_RING_F_OK : 0;
+    shmring_publish(type, flags, IPK_RING_UDP, msg->display.ptr, msg->display.len,
+                    client->channel, strlen(client->channel), msg->content.ptr, msg->content.len);
+}
+
+static void udp_resume_reply(UdpClient *client, fsm_state_e prev, bool ok, const char *content);
+static bool udp_command(UdpClient *client, fsm_event_e event, packetContent_t *pkt);
+static void udp_login_reply(UdpClient *client, fsm_state_e prev, bool ok);
+
+// Feeds an event through the shared state machine and performs the resulting
+// action. 'msg' is the server datagram behind an RX event; 'err' is the ERR
+// content sent if the event turns out to be a protocol error.
+static void udp_event(UdpClient *client, fsm_event_e event, const char *err,
+                      const ipk_msg_t *msg) {
+    fsm_state_e prev = client->state;
+    fsm_action_e action = fsm_step(&client->state, event);
+    uint64_t t_out = trace_now();
+
+    switch (action) {
+        case FSM_ACT_REPLY: {
+            client->reply_deadline = -1;
+            trace_span("udp.await_reply", client->t_reply, client->reply_ref);
+            bool ok = msg->result == 1;
+            if (resume_active(&client->resume)) {
+                udp_resume_reply(client, prev, ok, msg->content.ptr);
+                break;
             }
+            printf(ok ? "Action Success: %s\n" : "Action Failure: %s\n", msg->content.ptr);
+            if (ok && prev == FSM_AUTH)
+                printf("Authorized as %s.\n", client->display_name);
+            if (ok && prev == FSM_JOIN)
+                strcpy(client->channel, client->joining);
+            udp_publish(client, IPK_RING_REPLY, msg);
+            if (client->login_pending) udp_login_reply(client, prev, ok);
+            trace_span("output", t_out, TRACE_NO_ID);
             break;
         }
-        case MSG_AUTH: {
-            size_t ulen = strlen(client->username) + 1;
-            size_t dlen = strlen(client->display_name) + 1;
-            memcpy(&packet[offset], client->username, ulen);
-            offset += ulen;
-            CHECK_LAST_NULL(packet, offset);
-            memcpy(&packet[offset], client->display_name, dlen);
-            offset += dlen;
-            CHECK_LAST_NULL(packet, offset);
-            if (content->payload && content->length > 0) {
-                memcpy(&packet[offset], content->payload, content->length);
-                offset += content->length;
-                CHECK_LAST_NULL(packet, offset);
-            }
+        case FSM_ACT_DELIVER:
+            if (shmring_enabled())
+                udp_publish(client, IPK_RING_MSG, msg);
+            else
+                printf("%s: %s\n", msg->display.ptr, msg->content.ptr);
+            trace_span("output", t_out, TRACE_NO_ID);
             break;
-        }
-        case MSG_JOIN: {
-            if (content->payload && content->length > 0) {
-                memcpy(&packet[offset], content->payload, content->length);
-                offset += content->length;
-                CHECK_LAST_NULL(packet, offset);
-                size_t dlen = strlen(client->display_name) + 1;
-                memcpy(&packet[offset], client->display_name, dlen);
-                offset += dlen;
-                CHECK_LAST_NULL(packet, offset);
-            }
+        case FSM_ACT_REMOTE_ERR:
+            handle_error_message(msg);
+            udp_publish(client, IPK_RING_ERR, msg);
+            udp_shutdown(client, NULL);
             break;
-        }
-        case MSG_MSG:
-        case MSG_ERR: {
-            size_t dlen = strlen(client->display_name) + 1;
-            memcpy(&packet[offset], client->display_name, dlen);
-            offset += dlen;
-            CHECK_LAST_NULL(packet, offset);
-            if (content->payload && content->length > 0) {
-                memcpy(&packet[offset], content->payload, content->length);
-                offset += content->length;
-                CHECK_LAST_NULL(packet, offset);
-            }
+        case FSM_ACT_ERR_BYE:
+            udp_shutdown(client, err);
+            client->failed = true;
             break;
-        }
-        case MSG_BYE: {
-            size_t dlen = strlen(client->display_name) + 1;
-            memcpy(&packet[offset], client->display_name, dlen);
-            offset += dlen;
-            CHECK_LAST_NULL(packet, offset);
+        case FSM_ACT_BYE: {
+            // Behind the messages still queued, they are delivered first. A
+            // file being sent is given up: its queued chunks are dropped and
+            // only the one in flight is waited for.
+            if (filesend_active(&client->file)) {
+                filesend_abort(&client->file, "session ending");
+                client->bulk.count = client->inflight && client->inflight_bulk;
+            }
+            packetContent_t pkt = { .type = MSG_BYE, .payload = NULL, .length = 0 };
+            udp_send_message(client, &pkt);
             break;
         }
-        case MSG_PING:
+        case FSM_ACT_FINISH:
+            if (msg && msg->type == MSG_BYE) udp_publish(client, IPK_RING_BYE, msg);
+            udp_drop_pending(client);
             break;
         default:
-            fprintf(stderr, "udp_send_message: Unknown message type\n");
-            return -1;
+            break;
     }
+}
 
+// Connects the socket to the server's dynamic endpoint once AUTH is answered.
+// The kernel then drops datagrams from other senders before they are read,
+// sends skip the per-datagram route lookup and an ICMP port unreachable fails
+// the next send or recv with ECONNREFUSED instead of running out the retries.
+static void udp_connect_server(UdpClient *client) {
+    if (client->connected || !udp_has_socket(client)) return;
+    if (connect(client->sockfd, (struct sockaddr *)&client->dyn_server_addr, client->addr_len) != 0) {
+        perror("connect");  // stays unconnected, sendto/recvfrom still work
+        return;
+    }
+    client->connected = true;
+    BLOG(LOG_UDP_CONNECTED, BINLOG_ADDR(&client->dyn_server_addr));
+}
 
-    if (offset > MAX_MESSAGE_SIZE) return -1;
+// --- Session resume (-K) ---
+
+// The server stopped answering: CONFIRMs ran out, its port is unreachable or
+// a replayed request got no REPLY. Schedules a resume and returns true, or
+// returns false when the session ends as usual.
+static bool udp_resume_lost(UdpClient *client) {
+    if (!udp_has_socket(client)) return false;
+    bool resuming = resume_active(&client->resume);
+    if (!resuming && client->state != FSM_OPEN && client->state != FSM_JOIN) return false;
+    if (!resume_lost(&client->resume)) {
+        udp_ring_free(&client->held);
+        return false;
+    }
 
-    debug("Sending\n");
-    #ifdef DEBUG_PRINT
-    udp_print_packet(packet, offset);
-    #endif
-    debug("[DEBUG] Sending %zu bytes to %s:%u\n",
-          offset, inet_ntoa(client->dyn_server_addr.sin_addr),
-          ntohs(client->dyn_server_addr.sin_port));
-    ssize_t sent = sendto(client->sockfd, packet, offset, 0,
-                          (struct sockaddr *)&client->dyn_server_addr, client->addr_len);
-    if (sent < 0) {
-        perror("sendto");
-        return -1;
+    client->login_pending = false;
+    if (!resuming) {
+        if (client->state == FSM_JOIN)
+            fprintf(stdout, "ERROR: JOIN interrupted by the lost connection.\n");
+        // User messages and file chunks not confirmed yet wait until AUTH
+        // and JOIN are through; chunks stay in order behind the typed lines
+        buffer_t *b;
+        while ((b = udp_ring_pop(&client->sendq)) != NULL) {
+            if (b->data[0] == MSG_MSG)
+                udp_ring_push(&client->held, (const uint8_t *)b->data, b->len);
+        }
+        while ((b = udp_ring_pop(&client->bulk)) != NULL)
+            udp_ring_push(&client->held, (const uint8_t *)b->data, b->len);
     }
+    udp_drop_pending(client);
+    client->confirms.head = client->confirms.count = 0;
+
+    // Back to the well-known port; the new server session numbers from 0 again
+    if (client->connected) {
+        struct sockaddr unspec = { .sa_family = AF_UNSPEC };
+        connect(client->sockfd, &unspec, sizeof(unspec));
+        client->connected = false;
+    }
+    client->unreachable = false;
+    client->dyn_server_addr = client->server_addr;
+    msgid_buffer_init(&client->seen_ids);
+    fsm_step(&client->state, FSM_EV_RESUME);
+    return true;
+}
 
-    return 0;
+// A resume attempt is due: AUTH under the kept identity. The state machine
+// already waits for its REPLY.
+static void udp_resume_auth(UdpClient *client) {
+    packetContent_t pkt = {
+        .type = MSG_AUTH,
+        .payload = (uint8_t *)client->secret,
+        .length = strlen(client->secret) + 1
+    };
+    if (udp_send_message(client, &pkt) != 0 && !udp_resume_lost(client))
+        udp_event(client, FSM_EV_CLOSED, NULL, NULL);
 }
 
-// Waits for an incoming message using poll() and reads it into a buffer.
-// If the message is malformed, sends an error and terminates the client.
-int udp_receive_message(UdpClient *client, uint8_t *buffer, size_t buffer_size,
-                        struct sockaddr_in *source_addr) {
-    struct pollfd pfd = { .fd = client->sockfd, .events = POLLIN };
-    int ready = poll(&pfd, 1, client->timeout_ms);
-    if (ready < 0) {
-        return -1;
-    } else if (ready == 0) {
-        debug("[DEBUG] Timeout waiting for message\n");
-        return 0;
+// REPLY to a replayed AUTH or JOIN
+static void udp_resume_reply(UdpClient *client, fsm_state_e prev, bool ok, const char *content) {
+    if (prev == FSM_AUTH && !ok) {
+        // The identity is no longer accepted: nothing to resume
+        printf("Action Failure: %s\n", content);
+        client->resume.phase = RESUME_IDLE;
+        udp_ring_free(&client->held);
+        client->failed = true;
+        udp_event(client, FSM_EV_CMD_BYE, NULL, NULL);
+        return;
+    }
+    if (prev == FSM_AUTH && client->channel[0]) {
+        packetContent_t pkt = {
+            .type = MSG_JOIN,
+            .payload = (uint8_t *)client->channel,
+            .length = strlen(client->channel) + 1
+        };
+        if (udp_command(client, FSM_EV_CMD_JOIN, &pkt)) {
+            client->resume.phase = RESUME_JOIN;
+            return;
+        }
+    }
+    if (prev == FSM_JOIN && !ok) {
+        printf("Action Failure: %s\n", content);
+        client->channel[0] = '\0';
     }
 
-    socklen_t addr_len = sizeof(struct sockaddr_in);
-    int ret = recvfrom(client->sockfd, buffer, buffer_size, 0,
-        (struct sockaddr *)source_addr, &addr_len);
+    buffer_t *b;
+    while ((b = udp_ring_pop(&client->held)) != NULL)
+        udp_ring_push(&client->sendq, (const uint8_t *)b->data, b->len);
+    udp_flush(client);
+    resume_done(&client->resume);
+}
 
-    if (udp_is_malformed(buffer, ret)) {
+// Translates a received datagram into a state machine event
+static void udp_handle_datagram(UdpClient *client, const uint8_t *buf, size_t len,
+                                const struct sockaddr_in *source) {
+    ipk_msg_t msg;
+    if (!ipk_udp_decode(buf, len, &msg)) {
+        BLOG_BLOB(LOG_UDP_MALFORMED, buf, udp_loggable_len(buf, len), len);
         fprintf(stdout, "ERROR: Malformed packet\n");
+        udp_event(client, FSM_EV_RX_INVALID, "Malformed packet", NULL);
+        return;
+    }
 
-        packetContent_t pkt_confirm = { .type = MSG_CNFRM, .payload = NULL, .length = 0};
-        udp_send_with_confirm(client, &pkt_confirm);
-
-        char *payload = "ERROR: Malformed packet\n";
-        packetContent_t pkt_error = { .type = MSG_ERR, .payload = (uint8_t *)payload, .length = strlen(payload) + 1 };
-        udp_send_with_confirm(client, &pkt_error);
+    udp_log_packet(client, TRANSCRIPT_RX, buf, len);
+    uint16_t id = udp_packet_id(buf);
+    trace_instant(buf[0] == MSG_CNFRM ? "udp.rx_confirm" :
+                  buf[0] == MSG_REPLY ? "udp.rx_reply" : "udp.rx", id);
 
-        udp_client_close(client);
-        exit(-1);
+    if (buf[0] == MSG_CNFRM) {
+        if (client->inflight && id == client->inflight_id) {
+            udp_delivered(client);
+            udp_flush(client);
+        }
+        return;
     }
 
-    debug("Recevied\n");
-    #ifdef DEBUG_PRINT
-    udp_print_packet(buffer, ret);
-    #endif
+    // Confirmed before it is acted on; retransmissions get nothing but the CNFRM
+    bool fresh = udp_accept(client, buf);
+    udp_flush(client);
+    if (!fresh) return;
 
-    return ret;
+    fsm_event_e event;
+    switch (buf[0]) {
+        case MSG_REPLY: {
+            uint16_t ref = msg.ref;
+            if (fsm_awaiting_reply(client->state)) {
+                if (ref != client->reply_ref) return;  // not the request we wait for
+                int64_t us = (client->rx_stamp_ns - client->reply_sent_ns) / 1000;
+                if (us >= 0) {
+                    udp_stats_t *s = &client->stats;
+                    udp_sample(&s->reply_samples, &s->reply_sum_us, &s->reply_min_us, &s->reply_max_us, us);
+                    BLOG(LOG_UDP_REPLY_RTT, ref, us);
+                }
+                // The server continues from its dynamic port
+                if (source->sin_port != client->dyn_server_addr.sin_port)
+                    BLOG(LOG_UDP_PORT_SWITCH, ntohs(source->sin_port));
+                memcpy(&client->dyn_server_addr, source, sizeof(struct sockaddr_in));
+                if (client->state == FSM_AUTH) udp_connect_server(client);
+                // A REPLY implies the CNFRM of its request
+                if (client->inflight && client->inflight_id == ref) {
+                    udp_delivered(client);
+                    udp_flush(client);
+                }
+            }
+            event = msg.result == 1 ? FSM_EV_RX_REPLY_OK : FSM_EV_RX_REPLY_NOK;
+            break;
+        }
+        case MSG_MSG:  event = FSM_EV_RX_MSG; break;
+        case MSG_ERR:  event = FSM_EV_RX_ERR; break;
+        case MSG_BYE:  event = FSM_EV_RX_BYE; break;
+        case MSG_PING: return;
+        default:       event = FSM_EV_RX_INVALID; break;
+    }
+    udp_event(client, event, "Unexpected message", &msg);
 }
 
+int64_t udp_client_deadline(const UdpClient *client) {
+    int64_t deadline = client->reply_deadline;
+    if (client->inflight && (deadline < 0 || client->resend_at < deadline))
+        deadline = client->resend_at;
+    return deadline;
+}
 
-// Sends a message and waits for a CNFRM (confirmation) response from the server.
-// Retries sending if confirmation is not received within the timeout.
-int udp_send_with_confirm(UdpClient *client, packetContent_t *packet) {
-    if (!client || !packet) return -1;
-
-    uint16_t msg_id = udp_next_message_id(client);
-    packet->messageID = msg_id;
-
-    // Internal buffer for receiving messages
-    uint8_t recv_buf[3];
-
-    for (int attempt = 0; attempt <= client->max_retries; ++attempt) {
-        if (udp_send_message(client, packet) != 0)
-            return -1;
-
-        struct timespec start = start_timer();
-
-        while (get_elapsed_ms(start) < client->timeout_ms) {
-            struct sockaddr_in source;
-            int ret = udp_receive_message(client, recv_buf, sizeof(recv_buf), &source);
+int udp_client_timeout(const UdpClient *client) {
+    int64_t deadline = udp_client_deadline(client);
+    if (deadline < 0) return -1;
+    int64_t left = deadline - udp_now_ms(client);
+    return left > 0 ? (int)left : 0;
+}
 
-            uint8_t type = recv_buf[0];
-            uint16_t id;
-            memcpy(&id, &recv_buf[1], sizeof(uint16_t));
-            id = ntohs(id);
+void udp_client_on_timer(UdpClient *client) {
+    int64_t now = udp_now_ms(client);
 
-            if (type == MSG_ERR && id == msg_id) {
-                handle_error_message(recv_buf, ret);
-                return -1;
-            }
+    if (client->reply_deadline >= 0 && now >= client->reply_deadline) {
+        client->reply_deadline = -1;
+        BLOG(LOG_UDP_REPLY_LOST, client->reply_ref);
+        if (resume_active(&client->resume)) {
+            if (!udp_resume_lost(client))
+                udp_event(client, FSM_EV_CLOSED, NULL, NULL);
+            return;
+        }
+        fprintf(stdout, "ERROR: REPLY not received within %d ms.\n", UDP_REPLY_TIMEOUT_MS);
+        udp_event(client, FSM_EV_TIMEOUT, "No REPLY received", NULL);
+    }
 
-            if (type == MSG_CNFRM && id == msg_id)
-                return 0;
+    if (client->inflight && now >= client->resend_at) {
+        uint16_t id = client->inflight_id;
+        trace_span("udp.attempt_timeout", client->t_attempt, id);
+        if (client->attempts > client->max_retries) {
+            BLOG(LOG_UDP_CONFIRM_LOST, id, client->max_retries);
+            if (udp_resume_lost(client)) return;
+            // Only the closing datagrams are left after END: a server that
+            // went away meanwhile does not make the session a failure
+            if (client->state != FSM_END)
+                fprintf(stdout, "ERROR: CONFIRM not received after %d tries.\n", client->max_retries);
+            udp_ring_pop(udp_head_ring(client));
+            client->inflight = false;
+            udp_event(client, FSM_EV_TIMEOUT, "Confirm not received", NULL);
+        } else {
+            pacer_on_retransmit(&client->pacer);
+            client->stats.retransmits++;
+            trace_instant("udp.retransmit", id);
+            BLOG(LOG_UDP_RETRANSMIT, id, client->attempts);
+            udp_send_head(client, now);
         }
     }
-    fprintf(stdout, "ERROR: CONFIRM not received after %d tries.\n", client->max_retries);
+    udp_flush(client);
+}
 
-    char *payload = "ERROR: Confirm not received\n";
-    packetContent_t pkt = { .type = MSG_ERR, .payload = (uint8_t *)payload, .length = strlen(payload) + 1 };
-    udp_send_with_confirm(client, &pkt);
-    udp_client_close(client);
-    exit(-1);
+int udp_client_poll(UdpClient *client) {
+    struct sockaddr_in source;
+    const uint8_t *buf;
+    int ret;
+    uint32_t burst = 0;
+    udp_read_tx_stamps(client);
+    while ((ret = udp_receive_message(client, &buf, &source)) > 0) {
+        burst++;
+        udp_handle_datagram(client, buf, ret, &source);
+        arena_reset(&client->arena);
+    }
+    if (burst > client->stats.rx_burst_max && udp_has_socket(client)) {
+        client->stats.rx_burst_max = burst;
+        udp_autosize(client, SO_RCVBUF, burst, client->stats.rx_len_max);
+    }
+    if (ret < 0 && errno == ECONNREFUSED) {
+        client->unreachable = true;
+        ret = 0;
+    }
+    // Nobody listens on the server port any more: nothing can be delivered
+    if (client->unreachable && client->state != FSM_END) {
+        BLOG(LOG_UDP_UNREACHABLE, BINLOG_ADDR(&client->dyn_server_addr));
+        if (udp_resume_lost(client)) return ret;
+        fprintf(stdout, "ERROR: Server unreachable.\n");
+        client->failed = true;
+        udp_event(client, FSM_EV_CLOSED, NULL, NULL);
+    }
+    if (client->unreachable) udp_drop_pending(client);
+    return ret;
 }
 
+bool udp_client_done(const UdpClient *client) {
+    return client->state == FSM_END && !client->inflight && client->sendq.count == 0 &&
+           client->bulk.count == 0;
+}
 
-// Sends a message and waits first for CNFRM, then for a REPLY message.
-// Updates the server's dynamic port based on the REPLY message.
-int udp_send_with_reply(UdpClient *client, packetContent_t *packet,
-                        uint8_t *buf, size_t buf_len) {
-    if (!client || !packet || !buf) return -1;
+void udp_report_stats(const UdpClient *client, bool print) {
+    const udp_stats_t *s = &client->stats;
+    BLOG(LOG_UDP_STATS, s->tx_datagrams, s->tx_bytes, s->rx_datagrams, s->rx_bytes,
+         s->retransmits, s->rx_duplicates, s->kernel_drops);
+    uint64_t rtt_avg = s->rtt_samples ? s->rtt_sum_us / s->rtt_samples : 0;
+    uint64_t reply_avg = s->reply_samples ? s->reply_sum_us / s->reply_samples : 0;
+    BLOG(LOG_UDP_RTT_STATS, s->rtt_samples, s->rtt_min_us, rtt_avg, s->rtt_max_us,
+         s->reply_samples, s->reply_min_us, reply_avg, s->reply_max_us);
+    if (!print) return;
+    fprintf(stderr, "udp: tx %llu datagrams (%llu bytes, largest %u, burst %u), "
+                    "rx %llu datagrams (%llu bytes, largest %u, burst %u)\n",
+            (unsigned long long)s->tx_datagrams, (unsigned long long)s->tx_bytes,
+            s->tx_len_max, s->tx_burst_max,
+            (unsigned long long)s->rx_datagrams, (unsigned long long)s->rx_bytes,
+            s->rx_len_max, s->rx_burst_max);
+    fprintf(stderr, "udp: network loss: %llu retransmitted, %llu duplicates received; "
+                    "kernel drops: %u; buffers: rcv %d, snd %d bytes\n",
+            (unsigned long long)s->retransmits, (unsigned long long)s->rx_duplicates,
+            s->kernel_drops, s->rcvbuf, s->sndbuf);
+    fprintf(stderr, "udp: rtt min/avg/max %u/%llu/%u us over %llu samples (%llu kernel TX stamps), "
+                    "reply min/avg/max %u/%llu/%u us over %llu, rto %d ms\n",
+            s->rtt_min_us, (unsigned long long)rtt_avg, s->rtt_max_us,
+            (unsigned long long)s->rtt_samples, (unsigned long long)s->tx_kernel_stamps,
+            s->reply_min_us, (unsigned long long)reply_avg, s->reply_max_us,
+            (unsigned long long)s->reply_samples, udp_rto_ms(client));
+}
 
-    uint16_t msg_id = client->message_id;
 
-    // First send and wait for confirm
-    if (udp_send_with_confirm(client, packet) != 0)
-        return -1;
+// Parses arguments from an /auth command and fills an AUTH packet.
+// Also updates the client's username and display name once all fields are valid.
+// Prints the usage for a wrong argument count and the offending field otherwise.
+bool parse_auth_payload(UdpClient *client, const char *args, packetContent_t *out_packet) {
+    if (!client || !args || !out_packet) return false;
 
-    for (int attempt = 0; attempt <= client->max_retries; ++attempt) {
-        struct timespec start = start_timer();
+    static char payload[IPK_MAX_SECRET_LEN + 1];
+    char username[IPK_MAX_USERNAME_LEN + 1];
 
-        while (get_elapsed_ms(start) < 5000) {
-            struct sockaddr_in source;
-            int ret = udp_receive_message(client, buf, buf_len, &source);
+    const char *user = args;
+    const char *next = strchr(user, ' ');
+    const char *secret = next ? next + 1 : NULL;
+    if (secret) next = strchr(secret, ' ');
+    if (!secret || !next) {
+        fprintf(stdout, "ERROR: Usage: /auth <username> <secret> <display_name>\n");
+        return false;
+    }
+    size_t ulen = secret - 1 - user;
+    size_t slen = next - secret;
 
-            uint8_t type = buf[0];
-            uint16_t id;
-            memcpy(&id, &buf[1], sizeof(uint16_t));
-            id = ntohs(id);
+    const char *display_name = next + 1;
 
-            if (type == MSG_ERR && id == msg_id) {
-                handle_error_message(buf, ret);
-                udp_send_confirm(client, id);
-                return -1;
-            }
+    if (!validate_field(FIELD_USERNAME, user, ulen)) {
+        fprintf(stdout, "ERROR: Invalid %s.\n", validate_field_name(FIELD_USERNAME));
+        return false;
+    }
+    if (!validate_field(FIELD_SECRET, secret, slen)) {
+        fprintf(stdout, "ERROR: Invalid %s.\n", validate_field_name(FIELD_SECRET));
+        return false;
+    }
+    if (!validate_outgoing(FIELD_DISPLAY_NAME, display_name)) return false;
 
-            if (type == MSG_REPLY) {
-                uint16_t ref_id;
-                memcpy(&ref_id, &buf[4], sizeof(uint16_t));
-                ref_id = ntohs(ref_id);
+    memcpy(username, user, ulen);
+    username[ulen] = '\0';
+    strcpy(client->username, username);
+    strcpy(client->display_name, display_name);
 
-                if (ref_id == msg_id) {
-                    memcpy(&client->dyn_server_addr, &source, sizeof(struct sockaddr_in));
-                    debug("[DEBUG] Updated server port to %u based on REPLY\n", ntohs(source.sin_port));
+    memcpy(payload, secret, slen);
+    payload[slen] = '\0';
+    strcpy(client->secret, payload);
 
-                    udp_send_confirm(client, id);
+    out_packet->type = MSG_AUTH;
+    out_packet->payload = (uint8_t *)payload;
+    out_packet->length = slen + 1;
+    return true;
+}
 
-                    return 0;
-                }
-            }
 
-            if (type != MSG_CNFRM) udp_send_confirm(client, id);
+// Runs a user command through the state machine and queues its datagram.
+// Returns false (after saying why) when the command is refused.
+static bool udp_command(UdpClient *client, fsm_event_e event, packetContent_t *pkt) {
+    fsm_transition_t t = fsm_lookup(client->state, event);
+    if (t.action == FSM_ACT_BUSY) {
+        fprintf(stdout, "ERROR: Waiting for the REPLY to the previous request.\n");
+        return false;
+    }
+    if (t.action == FSM_ACT_DENY) {
+        fprintf(stdout, "ERROR: Not allowed in the %s state.\n", fsm_state_name(client->state));
+        return false;
+    }
+    if (udp_send_message(client, pkt) != 0) {
+        fprintf(stdout, "ERROR: Message could not be queued.\n");
+        return false;
+    }
+    client->state = t.next;
+    return true;
+}
+
+void udp_client_input(UdpClient *client, char *line) {
+    if (strncmp(line, "/auth ", 6) == 0) {
+        if (fsm_lookup(client->state, FSM_EV_CMD_AUTH).action == FSM_ACT_DENY) {
+            fprintf(stdout, "ERROR: Already authorized.\n");
+            return;
         }
+        packetContent_t pkt;
+        if (!parse_auth_payload(client, &line[6], &pkt)) return;
+        udp_command(client, FSM_EV_CMD_AUTH, &pkt);
+    } else if (strcmp(line, "/help") == 0) {
+        printf("Commands:\n");
+        printf("  /auth <username> <secret> <display_name>\n");
+        if (client->state != FSM_START) {
+            printf("  /join <channel>\n  /rename <name>\n  /sendfile <path>\n  /quit\n");
+        }
+    } else if (strcmp(line, "/quit") == 0) {
+        udp_event(client, FSM_EV_CMD_BYE, NULL, NULL);
+    } else if (client->state == FSM_START) {
+        fprintf(stdout, "ERROR: Please authenticate first using /auth.\n");
+    } else if (strncmp(line, "/join ", 6) == 0) {
+        if (!validate_outgoing(FIELD_CHANNEL, &line[6])) return;
+        packetContent_t pkt = {
+            .type = MSG_JOIN,
+            .payload = (uint8_t *)&line[6],
+            .length = strlen(&line[6]) + 1
+        };
+        if (udp_command(client, FSM_EV_CMD_JOIN, &pkt))
+            strcpy(client->joining, &line[6]);
+    } else if (strncmp(line, "/rename ", 8) == 0) {
+        if (!validate_outgoing(FIELD_DISPLAY_NAME, &line[8])) return;
+        strncpy(client->display_name, &line[8], sizeof(client->display_name) - 1);
+        client->display_name[sizeof(client->display_name) - 1] = 0;
+        BLOG_BLOB(LOG_RENAMED, client->display_name, strlen(client->display_name));
+    } else if (strcmp(line, "/sendfile") == 0 || strncmp(line, "/sendfile ", 10) == 0) {
+        // The path is the rest of the line, spaces inside it included
+        const char *path = &line[9] + strspn(&line[9], " ");
+        if (!*path)
+            fprintf(stdout, "ERROR: Usage: /sendfile path\n");
+        else if (filesend_active(&client->file))
+            fprintf(stdout, "ERROR: A file is already being sent.\n");
+        // Chunks wait out a pending REPLY in the pump, but never leave an ended session
+        else if (fsm_lookup(client->state, FSM_EV_CMD_MSG).action == FSM_ACT_DENY)
+            fprintf(stdout, "ERROR: Not authorized\n");
+        else
+            filesend_open(&client->file, path);
+    } else if (validate_outgoing(FIELD_CONTENT, line)) {
+        packetContent_t pkt = {
+            .type = MSG_MSG,
+            .payload = (uint8_t *)line,
+            .length = strlen(line) + 1
+        };
+        udp_command(client, FSM_EV_CMD_MSG, &pkt);
     }
+}
 
-    fprintf(stdout, "ERROR: REPLY not received after %d ms timeout.\n", client->timeout_ms);
+// Queues file chunks while the state machine allows MSG and the pacer has
+// tokens. Datagrams are delivered in order with one in flight, so the window
+// is the bulk ring: a few chunks wait behind the head and the next leaves
+// the moment the CNFRM of the previous one arrives, unless a typed line or
+// command is queued meanwhile. Chunks queued when the server stops answering
+// are kept across a resume like any user message.
+static void udp_filesend_pump(UdpClient *client) {
+    static char chunk[IPK_MAX_CONTENT_LEN + 1];
+    filesend_t *file = &client->file;
+    if (!filesend_active(file) || resume_active(&client->resume)) return;
+
+    while (!filesend_eof(file) && client->bulk.count < UDP_FILESEND_DEPTH) {
+        fsm_action_e action = fsm_lookup(client->state, FSM_EV_CMD_MSG).action;
+        if (action == FSM_ACT_DENY) {
+            filesend_abort(file, "session not open");
+            return;
+        }
+        if (action == FSM_ACT_BUSY || pacer_delay_ms(&client->pacer) > 0) break;
+
+        size_t len = filesend_next(file, chunk);
+        if (len == 0) continue;
+        chunk[len] = '\0';
+        packetContent_t pkt = {
+            .type = MSG_MSG,
+            .payload = (uint8_t *)chunk,
+            .length = len + 1
+        };
+        if (udp_queue_message(client, &client->bulk, &pkt) != 0) {
+            filesend_abort(file, "message could not be queued");
+            return;
+        }
+    }
+    if (filesend_eof(file) && client->bulk.count == 0 && client->sendq.count == 0)
+        filesend_finish(file);
+    else
+        filesend_progress(file);
+}
 
-    char *payload = "No REPLY recevied\n";
-    packetContent_t pkt = { .type = MSG_ERR, .payload = (uint8_t *)payload, .length = strlen(payload) + 1 };
-    udp_send_with_confirm(client, &pkt);
-    udp_client_close(client);
-    exit(-1);
+// The pump can take another chunk now; otherwise a CNFRM, a REPLY or the
+// pacer's timeout comes first
+static bool udp_filesend_ready(const UdpClient *client) {
+    return filesend_active(&client->file) && !filesend_eof(&client->file) &&
+           !resume_active(&client->resume) && client->bulk.count < UDP_FILESEND_DEPTH &&
+           fsm_lookup(client->state, FSM_EV_CMD_MSG).action == FSM_ACT_SEND;
 }
 
+// --- Non-interactive start (-U) ---
+// AUTH is queued before the loop first waits. The JOIN goes out on the AUTH
+// REPLY: it is addressed to the server's dynamic port, which that REPLY
+// announces, so no earlier moment is possible.
+
+// Queues the JOIN of the next channel on the startup list
+static void udp_login_join(UdpClient *client) {
+    const char *channel = client->login->channels[client->login_next++];
+    packetContent_t pkt = {
+        .type = MSG_JOIN,
+        .payload = (uint8_t *)channel,
+        .length = strlen(channel) + 1
+    };
+    if (udp_command(client, FSM_EV_CMD_JOIN, &pkt))
+        strcpy(client->joining, channel);
+    else
+        client->login_pending = false;
+}
 
-// Parses arguments from an /auth command and fills an AUTH packet.
-// Also updates the client's username and display name.
-bool parse_auth_payload(UdpClient *client, const char *args, packetContent_t *out_packet) {
-    if (!client || !args || !out_packet) return false;
+static void udp_login_start(UdpClient *client, const client_config_t *cfg) {
+    client->login = cfg;
+    client->login_pending = true;
+    strcpy(client->username, cfg->username);
+    strcpy(client->secret, cfg->secret);
+    strcpy(client->display_name, cfg->display_name);
+    packetContent_t pkt = {
+        .type = MSG_AUTH,
+        .payload = (uint8_t *)client->secret,
+        .length = strlen(client->secret) + 1
+    };
+    if (!udp_command(client, FSM_EV_CMD_AUTH, &pkt))
+        client->login_pending = false;
+}
 
-    static char payload[128];
-    size_t offset = 0;
-
-    const char *username = args;
-    const char *next = strchr(username, ' ');
-    if (!next) return false;
-    size_t len = next - username;
-    if (len >= sizeof(client->username)) return false;
-    strncpy(client->username, username, len);
-    client->username[len] = '\0';
-
-    const char *secret = next + 1;
-    next = strchr(secret, ' ');
-    if (!next) return false;
-    len = next - secret;
-    if (len >= 64) return false;
-    memcpy(&payload[offset], secret, len);
-    offset += len;
-    payload[offset++] = '\0';
+// REPLY during the non-interactive start. A refused AUTH ends the session;
+// a refused channel is followed by the next one on the list.
+static void udp_login_reply(UdpClient *client, fsm_state_e prev, bool ok) {
+    if (prev == FSM_AUTH && !ok) {
+        client->login_pending = false;
+        client->failed = true;
+        udp_event(client, FSM_EV_CMD_BYE, NULL, NULL);
+        return;
+    }
+    if (!(prev == FSM_JOIN && ok) && client->login_next < client->login->channel_count) {
+        udp_login_join(client);
+        return;
+    }
+    client->login_pending = false;
+}
 
-    const char *display_name = next + 1;
-    len = strlen(display_name);
-    if (len >= sizeof(client->display_name)) return false;
-    strncpy(client->display_name, display_name, sizeof(client->display_name) - 1);
-    client->display_name[sizeof(client->display_name) - 1] = '\0';
+// Next input line may be taken: no REPLY is outstanding (requests are answered
+// one at a time), the startup handshake is through and the queues keep room
+// for a closing ERR and BYE (and fit the held ring of a resume)
+bool udp_client_accepts_input(const UdpClient *client) {
+    return client->state != FSM_END && !fsm_awaiting_reply(client->state) &&
+           !resume_active(&client->resume) && !client->login_pending &&
+           client->sendq.count + client->bulk.count < UDP_RING_SIZE - 2;
+}
 
-    out_packet->type = MSG_AUTH;
-    out_packet->payload = (uint8_t *)payload;
-    out_packet->length = offset;
-    return true;
+// Releases the run-local resources of udp_run
+static void udp_client_cleanup(UdpClient *client, line_reader_t *input) {
+    line_reader_free(input);
+    if (client->transcript) transcript_close(client->transcript);
+    if (client->capture) capture_close(client->capture);
+    if (client->replay) replay_close(client->replay);
 }
 
-// Main loop for running the UDP client: handles user input and incoming messages,
-// manages authorization and command execution.
+// Main loop for running the UDP client. Nothing in it blocks apart from poll():
+// user input, datagrams and timers are events for the protocol state machine.
 int udp_run(const client_config_t *cfg) {
     UdpClient client;
-    client_state_t_udp state = STATE_INIT;
     signal(SIGINT, handle_sigint_udp);
 
     if (udp_client_init(&client, cfg->server, cfg->port,
@@ -471,139 +1242,130 @@ int udp_run(const client_config_t *cfg) {
     strncpy(client.display_name, "anonymous", sizeof(client.display_name) - 1);
     strncpy(client.username, "anonymous", sizeof(client.username) - 1);
 
-    uint8_t buffer[MAX_MESSAGE_SIZE];
+    transcript_t transcript;
+    if (cfg->transcript[0]) {
+        if (transcript_open(&transcript, cfg->transcript) != 0) {
+            close(client.sockfd);
+            return 1;
+        }
+        client.transcript = &transcript;
+    }
 
-    debug("Connected as %s. Type /help for commands.\n", client.display_name);
+    capture_t capture;
+    if (cfg->capture[0]) {
+        if (capture_open(&capture, cfg->capture) != 0) {
+            close(client.sockfd);
+            return 1;
+        }
+        client.capture = &capture;
+    }
+
+    replay_t replay;
+    if (cfg->replay[0]) {
+        if (replay_open(&replay, cfg->replay, cfg->replay_speed) != 0) {
+            close(client.sockfd);
+            return 1;
+        }
+        client.replay = &replay;
+    }
+
+    pacer_init(&client.pacer, cfg->pace_rate, cfg->pace_burst);
+    client.adaptive_rto = cfg->adaptive_rto;
+    resume_init(&client.resume, cfg->resume_ms);
+    if (lowlat_init(&client.lowlat, cfg->lowlat_spin_us, cfg->cpu) != 0) {
+        close(client.sockfd);
+        return 1;
+    }
+    lowlat_socket(&client.lowlat, client.sockfd, false);
+
+    line_reader_t input;
+    line_reader_init(&input, "\n", IPK_MAX_CONTENT_LEN);
+
+    BLOG_BLOB(LOG_UDP_START, client.display_name, strlen(client.display_name));
+    if (cfg->username[0]) udp_login_start(&client, cfg);
 
     struct pollfd pfds[2] = {
         { .fd = STDIN_FILENO, .events = POLLIN },
         { .fd = client.sockfd, .events = POLLIN }
     };
 
-    while (1) {
-        if (terminate_udp) {
-            packetContent_t pkt = { .type = MSG_BYE, .payload = NULL, .length = 0 };
-            udp_send_with_confirm(&client, &pkt);
-            break;
+    while (!udp_client_done(&client)) {
+        if (terminate_udp)
+            udp_event(&client, FSM_EV_CMD_BYE, NULL, NULL);
+
+        if (client.state != FSM_END && resume_due(&client.resume))
+            udp_resume_auth(&client);
+        int poll_timeout = udp_client_timeout(&client);
+        int resume_in = resume_timeout(&client.resume);
+        if (resume_in >= 0 && (poll_timeout < 0 || resume_in < poll_timeout))
+            poll_timeout = resume_in;
+
+        // In replay mode the next captured datagram plays the role of the socket
+        if (client.replay) {
+            long due = replay_next_due_ms(client.replay);
+            if (due < 0) {
+                BLOG(LOG_REPLAY_DONE);
+                break;
+            }
+            if (poll_timeout < 0 || due < poll_timeout) poll_timeout = due;
         }
 
-        if (poll(pfds, 2, -1) < 0) {
+        // Lines that may not be sent yet (pacer, outstanding REPLY) stay in the
+        // input buffer and stdin is not read until they are taken (backpressure
+        // on the producer)
+        bool backlog = line_reader_pending(&input);
+        pfds[0].fd = (backlog || input.eof) ? -1 : STDIN_FILENO;  // -1: poll() skips it
+        if ((backlog && udp_client_accepts_input(&client)) || udp_filesend_ready(&client)) {
+            int pace = (int)pacer_delay_ms(&client.pacer);
+            if (poll_timeout < 0 || pace < poll_timeout) poll_timeout = pace;
+        }
+
+        int ready = lowlat_poll(&client.lowlat, pfds, 2, poll_timeout);
+        if (ready < 0) {
             if (errno == EINTR) continue; // interrupted by signal
             perror("poll");
             break;
         }
 
-        if (pfds[0].revents & POLLIN) {
-            char line[512];
-            if (!fgets(line, sizeof(line), stdin)) {
-                terminate_udp = 1;
-                continue;
-            }
-            line[strcspn(line, "\n")] = 0;
-        
-            if (strncmp(line, "/auth ", 6) == 0) {
-                if (state == STATE_AUTHORIZED) {
-                    fprintf(stdout, "ERROR: Already authorized.\n");
-                    continue;
-                }
-                packetContent_t pkt;
-                if (!parse_auth_payload(&client, &line[6], &pkt)) {
-                    fprintf(stdout, "ERROR: Usage: /auth <username> <secret> <display_name>\n");
-                    continue;
-                }
-                if (udp_send_with_reply(&client, &pkt, buffer, sizeof(buffer)) != 0) {
-                    fprintf(stdout, "ERROR: Authorization failed.\n");
-                    continue;
-                }
-
-                uint8_t result = buffer[3];
-                const char *msg = (const char *)&buffer[6];
-                printf(result ? "Action Success: %s\n" : "Action Failure: %s\n", msg);
-                if (result) {
-                    state = STATE_AUTHORIZED;
-                    printf("Authorized as %s.\n", client.display_name);
-                }
-            } else if (strcmp(line, "/help") == 0) {
-                printf("Commands:\n");
-                printf("  /auth <username> <secret> <display_name>\n");
-                if (state == STATE_AUTHORIZED) {
-                    printf("  /join <channel>\n  /rename <name>\n  /quit\n");
-                }
-            } else if (strcmp(line, "/quit") == 0) {
-                packetContent_t pkt = { .type = MSG_BYE, .payload = NULL, .length = 0 };
-                udp_send_with_confirm(&client, &pkt);
+        if (pfds[0].revents & (POLLIN | POLLHUP)) {
+            if (line_reader_fill(&input, STDIN_FILENO) < 0) {
+                perror("read");
                 break;
-            } else if (state != STATE_AUTHORIZED) {
-                fprintf(stdout, "ERROR: Please authenticate first using /auth.\n");
-            } else if (strncmp(line, "/join ", 6) == 0) {
-                packetContent_t pkt = {
-                    .type = MSG_JOIN,
-                    .payload = (uint8_t *)&line[6],
-                    .length = strlen(&line[6]) + 1
-                };
-                if (udp_send_with_reply(&client, &pkt, buffer, sizeof(buffer)) == 0) {
-                    uint8_t result = buffer[3];
-                    const char *msg = (const char *)&buffer[6];
-                    printf(result ? "Action Success: %s\n" : "Action Failure: %s\n", msg);
-                } else {
-                    fprintf(stdout, "ERROR: Join failed.\n");
-                }
-            } else if (strncmp(line, "/rename ", 8) == 0) {
-                strncpy(client.display_name, &line[8], sizeof(client.display_name) - 1);
-                client.display_name[sizeof(client.display_name) - 1] = 0;
-                debug("Display name set to: %s\n", client.display_name);
-            } else {
-                packetContent_t pkt = {
-                    .type = MSG_MSG,
-                    .payload = (uint8_t *)line,
-                    .length = strlen(line) + 1
-                };
-                udp_send_with_confirm(&client, &pkt);
             }
         }
-        
-
-        if (pfds[1].revents & POLLIN) {
-            struct sockaddr_in src;
-            int ret = udp_receive_message(&client, buffer, sizeof(buffer), &src);
-            if (ret <= 0) continue;
-
-            uint8_t type = buffer[0];
-            uint16_t msg_id;
-            memcpy(&msg_id, &buffer[1], sizeof(uint16_t));
-            msg_id = ntohs(msg_id);
-
-            if (msgid_buffer_contains(&client.seen_ids, msg_id)) {
-                if (type != MSG_CNFRM) {
-                    udp_send_confirm(&client, msg_id);
-                    continue;
-                }
-            }
 
-            msgid_buffer_add(&client.seen_ids, msg_id);
-            if (type != MSG_CNFRM) 
-                udp_send_confirm(&client, msg_id);
-            
-            if (type == MSG_REPLY) {
-                uint8_t result = buffer[3];
-                const char *msg = (const char *)&buffer[6];
-                printf(result ? "Action Success: %s\n" : "Action Failure: %s\n", msg);
-            } else if (type == MSG_MSG) {
-                const char *display = (const char *)&buffer[3];
-                const char *message = (const char *)&buffer[3 + strlen(display) + 1];
-                printf("%s: %s\n", display, message);
-            } else if (type == MSG_ERR) {
-                handle_error_message(buffer, ret);
-                break;
-            } else if (type == MSG_BYE) {
-                packetContent_t pkt = { .type = MSG_BYE, .payload = NULL, .length = 0 };
-                udp_send_with_confirm(&client, &pkt);
-                udp_client_close(&client);
-                return 0;
-            }
+        char *line;
+        size_t len;
+        while (udp_client_accepts_input(&client) && pacer_delay_ms(&client.pacer) == 0 &&
+               (line = line_reader_next(&input, &len)) != NULL) {
+            arena_reset(&client.arena);
+            udp_client_input(&client, line);
+        }
+
+        if (input.overflow) {
+            fprintf(stdout, "ERROR: Message longer than %d characters.\n", IPK_MAX_CONTENT_LEN);
+            input.overflow = false;
+        }
+        if (udp_client_poll(&client) < 0) {
+            perror("recvfrom");
+            break;
+        }
+        udp_client_on_timer(&client);
+        udp_filesend_pump(&client);
+
+        // End of input is a /quit that waits its turn behind the lines (and the
+        // file) before it
+        if (input.eof && !line_reader_pending(&input) && udp_client_accepts_input(&client) &&
+            !filesend_active(&client.file)) {
+            BLOG(LOG_STDIN_EOF);
+            udp_event(&client, FSM_EV_CMD_BYE, NULL, NULL);
         }
     }
 
+    if (filesend_active(&client.file)) filesend_abort(&client.file, "session ended");
+    udp_report_stats(&client, cfg->print_stats);
+    lowlat_report(&client.lowlat, "udp", cfg->print_stats || client.lowlat.enabled);
     udp_client_close(&client);
-    return 0;
+    udp_client_cleanup(&client, &input);
+    return client.failed ? 1 : 0;
 }
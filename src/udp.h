@@ -7,22 +7,58 @@
 #include <stddef.h>
 #include "utils.h"   // for msgid_buffer_t
 #include "client.h"  // for client_config_t
+#include "validate.h"
+#include "transcript.h"
+#include "capture.h"
+#include "pacer.h"
+#include "buffer.h"
+#include "arena.h"
+#include "fsm.h"
+#include "lowlat.h"
+#include "resume.h"
+#include "filesend.h"
+#include "schema.h"  // UdpMessageType and the wire codecs
+#include "session_io.h"
 
 #define MAX_MESSAGE_SIZE 65507  // Maximum safe UDP payload size
 #define MAX_RETRIES 3
 #define DEFAULT_TIMEOUT_MS 250
-
-// IPK25-CHAT UDP message types
-typedef enum {
-    MSG_CNFRM = 0x00,  // Confirmation
-    MSG_REPLY = 0x01,  // Server reply to action
-    MSG_AUTH  = 0x02,  // Authorization request
-    MSG_JOIN  = 0x03,  // Join a channel
-    MSG_MSG   = 0x04,  // Regular chat message
-    MSG_PING  = 0xFD,  // Ping
-    MSG_ERR   = 0xFE,  // Error message
-    MSG_BYE   = 0xFF   // Disconnect
-} UdpMessageType;
+#define UDP_REPLY_TIMEOUT_MS 5000  // AUTH/JOIN REPLY, counted from the first transmission
+#define UDP_RING_SIZE 64           // Queued CNFRMs / queued reliable datagrams
+#define UDP_FILESEND_DEPTH 4       // /sendfile chunks queued, the one in flight included
+// Upper bound of an encoded packet whose payload is 'len' bytes (names below 64 characters)
+#define UDP_ENCODED_MAX(len) ((len) + 6 + 2 * 64)
+#define UDP_SKB_OVERHEAD 768       // Kernel accounting per queued datagram beyond its payload
+#define UDP_SOCKBUF_MAX (4 << 20)  // Socket buffer auto-sizing stops here
+#define UDP_RTO_MIN_MS 20          // Adaptive retransmission timeout floor
+
+// FIFO of serialized datagrams
+typedef struct {
+    buffer_t items[UDP_RING_SIZE];
+    int head;
+    int count;
+} udp_ring_t;
+
+// Socket statistics. Datagrams the kernel discarded because the receive queue
+// was full (SO_RXQ_OVFL) are counted apart from what the network lost, which
+// shows up as retransmissions and as duplicates the server sent again.
+typedef struct {
+    uint64_t tx_datagrams, tx_bytes;
+    uint64_t rx_datagrams, rx_bytes;
+    uint64_t retransmits;          // Our datagrams sent again for lack of a CNFRM
+    uint64_t rx_duplicates;        // Server datagrams received more than once
+    uint32_t kernel_drops;         // Receive queue overflows reported by the kernel
+    uint32_t rx_burst_max;         // Most datagrams read in one wakeup
+    uint32_t tx_burst_max;         // Most datagrams sent in one flush
+    uint32_t rx_len_max, tx_len_max;
+    int rcvbuf, sndbuf;            // Kernel buffer sizes (as reported by getsockopt)
+    // Round trips timed at the socket boundary (microseconds)
+    uint64_t rtt_samples, rtt_sum_us;
+    uint32_t rtt_min_us, rtt_max_us;      // datagram -> its CNFRM
+    uint64_t reply_samples, reply_sum_us;
+    uint32_t reply_min_us, reply_max_us;  // AUTH/JOIN -> its REPLY
+    uint64_t tx_kernel_stamps;     // TX times taken from the kernel, not user space
+} udp_stats_t;
 
 // UDP client state structure
 typedef struct {
@@ -30,6 +66,8 @@ typedef struct {
     struct sockaddr_in server_addr;     // Initial server address (for AUTH)
     struct sockaddr_in dyn_server_addr; // Dynamic address after AUTH
     socklen_t addr_len;
+    bool connected;                     // Socket connected to dyn_server_addr
+    bool unreachable;                   // ICMP error reported for the server
 
     uint16_t message_id;           // Counter for unique MessageIDs
     msgid_buffer_t seen_ids;       // Buffer to track received MessageIDs
@@ -38,14 +76,51 @@ typedef struct {
     uint8_t max_retries;           // Max send attempts
     char display_name[64];         // Display name of the user
     char username[64];             // Username
+    char secret[IPK_MAX_SECRET_LEN + 1];   // Kept for resuming the session
+    char channel[IPK_MAX_CHANNEL_LEN + 1]; // Channel joined last
+    char joining[IPK_MAX_CHANNEL_LEN + 1]; // Channel a pending JOIN asks for
+    transcript_t *transcript;      // Optional audit transcript
+    capture_t *capture;            // Optional raw datagram capture
+    replay_t *replay;              // Replay source replacing the socket
+    const ipk_io_t *io;            // Simulated clock and network replacing the socket (sim.c)
+    pacer_t pacer;                 // Outgoing message pacing
+    arena_t arena;                 // Scratch for serialized and received datagrams
+
+    fsm_state_e state;             // Protocol state
+    bool failed;                   // Ended by a protocol error or timeout
+    udp_ring_t confirms;           // CNFRMs, sent ahead of everything else
+    udp_ring_t sendq;              // Reliable datagrams in order, the head is in flight
+    udp_ring_t bulk;               // /sendfile chunks, sent while sendq is empty
+    bool inflight;                 // Head of sendq (or bulk) sent and not yet confirmed
+    bool inflight_bulk;            // ... and it is the head of bulk
+    uint16_t inflight_id;
+    int attempts;                  // Transmissions of the head so far
+    int64_t resend_at;             // Retransmission time of the head (monotonic ms)
+    uint16_t reply_ref;            // MessageID of the AUTH/JOIN awaiting its REPLY
+    int64_t reply_deadline;        // -1 when no REPLY is awaited
+    uint64_t t_attempt, t_reply;   // Trace timestamps of the attempt / request
+
+    // Socket boundary timestamps (CLOCK_REALTIME ns). A TX time starts as the
+    // user-space clock right before the send and is replaced by the kernel's
+    // once it arrives on the error queue, numbered by send (OPT_ID).
+    uint32_t tx_seq;               // Successful sends so far
+    uint32_t head_seq;             // Send number of the in-flight head's first attempt
+    int64_t head_sent_ns;
+    uint32_t reply_seq;            // Send number of the AUTH/JOIN awaiting its REPLY
+    int64_t reply_sent_ns;
+    int64_t rx_stamp_ns;           // Kernel RX time of the datagram being handled
+    bool adaptive_rto;             // Retransmission timeout from the RTT, -d caps it
+    int64_t srtt_us, rttvar_us;    // RFC 6298 estimator, srtt 0 until the first sample
+    udp_stats_t stats;
+    lowlat_t lowlat;               // Low-latency mode and socket-to-handler latency
+    resume_t resume;               // Session resume after the server stopped answering
+    udp_ring_t held;               // User messages not confirmed yet, kept across a resume
+    filesend_t file;               // /sendfile in progress
+    const client_config_t *login;  // Non-interactive start (-U): channels to try
+    int login_next;                // ... the next of them
+    bool login_pending;            // Input waits for the startup AUTH and JOIN
 } UdpClient;
 
-// Client state (initial / authorized)
-typedef enum {
-    STATE_INIT,
-    STATE_AUTHORIZED
-} client_state_t_udp;
-
 
 // Representation of an outgoing message
 typedef struct {
@@ -60,28 +135,64 @@ typedef struct {
 // --- Initialization and shutdown ---
 int udp_client_init(UdpClient *client, const char *server_ip, uint16_t port,
                     uint16_t timeout_ms, uint8_t max_retries);
+// The same without a socket: time and datagrams come from 'io', which must
+// outlive the client
+void udp_client_init_io(UdpClient *client, const struct sockaddr_in *server,
+                        uint16_t timeout_ms, uint8_t max_retries, const ipk_io_t *io);
+// Closes the socket and frees the queues (the BYE is sent by the state
+// machine beforehand)
 void udp_client_close(UdpClient *client);
 
 // --- Message ID generator ---
 uint16_t udp_next_message_id(UdpClient *client);
 
+// --- Wire format ---
+size_t udp_encode(const packetContent_t *content, const char *username,
+                  const char *display_name, uint8_t *packet);
+int udp_is_malformed(const uint8_t *buf, size_t len);
+
+// --- Scheduler rings ---
+bool udp_ring_push(udp_ring_t *ring, const uint8_t *buf, size_t len);
+buffer_t *udp_ring_pop(udp_ring_t *ring);
+void udp_ring_free(udp_ring_t *ring);
+
 // --- Sending messages ---
+// Assigns the next MessageID and queues the message for reliable, in-order
+// delivery; never waits
 int udp_send_message(UdpClient *client, packetContent_t *content);
 int udp_send_confirm(UdpClient *client, uint16_t ref_msg_id);
 
-// Sends a message and waits for CNFRM (no REPLY expected)
-// 'buf' must be a buffer of at least MAX_MESSAGE_SIZE bytes
-int udp_send_with_confirm(UdpClient *client, packetContent_t *packet);
-
-// Sends a message and waits for CNFRM and then REPLY
-// On REPLY, the client's dynamic address is updated
-int udp_send_with_reply(UdpClient *client, packetContent_t *packet,
-                        uint8_t *buf, size_t buf_len);
+// Sends the queued CNFRMs and starts the next reliable datagram if none is in flight
+int udp_flush(UdpClient *client);
 
 // --- Receiving messages ---
-int udp_receive_message(UdpClient *client, uint8_t *buffer, size_t buffer_size,
+// Reads one pending datagram into the client's arena (sized to the datagram)
+// without waiting. Returns its length, 0 when nothing is pending, -1 on error.
+int udp_receive_message(UdpClient *client, const uint8_t **data,
                         struct sockaddr_in *source_addr);
 
+// --- Event loop hooks ---
+// A client is driven by poll(): udp_client_poll when the socket is readable,
+// udp_client_on_timer once udp_client_timeout has elapsed. Any number of
+// clients can share one loop.
+
+// Handles every pending datagram. Returns 0, or -1 on a socket error.
+int udp_client_poll(UdpClient *client);
+// Next retransmission or REPLY deadline in the client's milliseconds, -1 when none
+int64_t udp_client_deadline(const UdpClient *client);
+// Milliseconds until then, -1 when none
+int udp_client_timeout(const UdpClient *client);
+// Retransmits or gives up on what is due
+void udp_client_on_timer(UdpClient *client);
+// True once the session has ended and its closing datagrams are settled
+bool udp_client_done(const UdpClient *client);
+// True when udp_client_input may take the next line now
+bool udp_client_accepts_input(const UdpClient *client);
+// Handles one line of user input: a command or a message
+void udp_client_input(UdpClient *client, char *line);
+// Logs the socket statistics and, when 'print' is set, writes them to stderr
+void udp_report_stats(const UdpClient *client, bool print);
+
 // --- Client main loop ---
 int udp_run(const client_config_t *cfg);
 
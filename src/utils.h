@@ -23,8 +23,5 @@ bool msgid_buffer_contains(const msgid_buffer_t *buf, uint16_t id);
 // Add ID to buffer (overwrite oldest if full)
 void msgid_buffer_add(msgid_buffer_t *buf, uint16_t id);
 
-// Print the contents of a UDP packet
-void udp_print_packet(const uint8_t *buf, size_t len);
-
 
 #endif // UTILS_H
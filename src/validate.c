@@ -0,0 +1,76 @@
+#include "validate.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define CLS_ID      (1u << FIELD_USERNAME | 1u << FIELD_CHANNEL | 1u << FIELD_SECRET)
+#define CLS_DNAME   (1u << FIELD_DISPLAY_NAME)
+#define CLS_CONTENT (1u << FIELD_CONTENT)
+
+// One 256-entry table; bit N of an entry is set when the character belongs to
+// field class N. Lookups stay branch-free and the whole table fits in 4 cache lines.
+static const unsigned char field_chars[256] = {
+    ['\n']        = CLS_CONTENT,
+    [' ']         = CLS_CONTENT,
+    ['!' ... ','] = CLS_DNAME | CLS_CONTENT,
+    ['-']         = CLS_ID | CLS_DNAME | CLS_CONTENT,
+    // The reference server uses dotted channel names (e.g. "discord.general")
+    ['.']         = 1u << FIELD_CHANNEL | CLS_DNAME | CLS_CONTENT,
+    ['/']         = CLS_DNAME | CLS_CONTENT,
+    ['0' ... '9'] = CLS_ID | CLS_DNAME | CLS_CONTENT,
+    [':' ... '@'] = CLS_DNAME | CLS_CONTENT,
+    ['A' ... 'Z'] = CLS_ID | CLS_DNAME | CLS_CONTENT,
+    ['[' ... '^'] = CLS_DNAME | CLS_CONTENT,
+    ['_']         = CLS_ID | CLS_DNAME | CLS_CONTENT,
+    ['`']         = CLS_DNAME | CLS_CONTENT,
+    ['a' ... 'z'] = CLS_ID | CLS_DNAME | CLS_CONTENT,
+    ['{' ... '~'] = CLS_DNAME | CLS_CONTENT,
+};
+
+static const size_t field_max_len[FIELD_COUNT] = {
+    [FIELD_USERNAME]     = IPK_MAX_USERNAME_LEN,
+    [FIELD_CHANNEL]      = IPK_MAX_CHANNEL_LEN,
+    [FIELD_SECRET]       = IPK_MAX_SECRET_LEN,
+    [FIELD_DISPLAY_NAME] = IPK_MAX_DNAME_LEN,
+    [FIELD_CONTENT]      = IPK_MAX_CONTENT_LEN,
+};
+
+static const char *const field_names[FIELD_COUNT] = {
+    [FIELD_USERNAME]     = "username",
+    [FIELD_CHANNEL]      = "channel ID",
+    [FIELD_SECRET]       = "secret",
+    [FIELD_DISPLAY_NAME] = "display name",
+    [FIELD_CONTENT]      = "message content",
+};
+
+bool validate_char(field_class_e cls, unsigned char c) {
+    return field_chars[c] & (1u << cls);
+}
+
+bool validate_field(field_class_e cls, const char *s, size_t len) {
+    if (!s || len == 0 || len > field_max_len[cls]) return false;
+
+    const unsigned char mask = 1u << cls;
+    const unsigned char *p = (const unsigned char *)s;
+    for (size_t i = 0; i < len; i++) {
+        if (!(field_chars[p[i]] & mask)) return false;
+    }
+    return true;
+}
+
+bool validate_field_str(field_class_e cls, const char *s) {
+    if (!s) return false;
+    // Bounded scan so an overlong field is rejected without walking all of it
+    size_t len = strnlen(s, field_max_len[cls] + 1);
+    return validate_field(cls, s, len);
+}
+
+const char *validate_field_name(field_class_e cls) {
+    return field_names[cls];
+}
+
+bool validate_outgoing(field_class_e cls, const char *s) {
+    if (validate_field_str(cls, s)) return true;
+    fprintf(stdout, "ERROR: Invalid %s.\n", field_names[cls]);
+    return false;
+}
@@ -0,0 +1,39 @@
+#ifndef VALIDATE_H
+#define VALIDATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Field length limits from the IPK25-CHAT specification
+#define IPK_MAX_USERNAME_LEN  20
+#define IPK_MAX_CHANNEL_LEN   20
+#define IPK_MAX_SECRET_LEN    128
+#define IPK_MAX_DNAME_LEN     20
+#define IPK_MAX_CONTENT_LEN   60000
+
+// Character classes of protocol fields
+typedef enum {
+    FIELD_USERNAME,
+    FIELD_CHANNEL,
+    FIELD_SECRET,
+    FIELD_DISPLAY_NAME,
+    FIELD_CONTENT,
+    FIELD_COUNT
+} field_class_e;
+
+// Returns true if the character may appear in a field of the given class
+bool validate_char(field_class_e cls, unsigned char c);
+
+// Checks length (1..max) and character class of a field
+bool validate_field(field_class_e cls, const char *s, size_t len);
+
+// Same as validate_field for a NUL-terminated string
+bool validate_field_str(field_class_e cls, const char *s);
+
+// Human readable field name used in local error messages
+const char *validate_field_name(field_class_e cls);
+
+// Validates a field before it is encoded; prints a local ERROR line when it is rejected
+bool validate_outgoing(field_class_e cls, const char *s);
+
+#endif // VALIDATE_H